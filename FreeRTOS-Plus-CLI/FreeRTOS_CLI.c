@@ -62,12 +62,6 @@ one of the application files:
     #define configAPPLICATION_PROVIDES_cOutputBuffer 0
 #endif
 
-typedef struct xCOMMAND_INPUT_LIST
-{
-    const CLI_Command_Definition_t *pxCommandLineDefinition;
-    struct xCOMMAND_INPUT_LIST *pxNext;
-} CLI_Definition_List_Item_t;
-
 /*
  * The callback function that is executed when "help" is entered.  This is the
  * only default command that is always present.
@@ -79,18 +73,18 @@ static void cmd_help( char *chp,  int argc, const char *argv[] );
  */
 static int8_t prvGetNumberOfParameters( char *pcCommandString, const char *args[]);
 
-/* The definition of the "help" command.  This command is always at the front
-of the list of registered commands. */
+/* The definition of the "help" command.  This command is always present in
+the table of registered commands. */
 static const CLI_Command_Definition_t x_cmd_help = {
 "help", "lists all the registered commands\r\n", cmd_help, 0};
 
-/* The definition of the list of commands.  Commands that are registered are
-added to this list. */
-static CLI_Definition_List_Item_t xRegisteredCommands =
+/* 已注册的命令，按命令名排序，查找时二分。"help" 一开始就在表里，
+不需要注册。 */
+static const CLI_Command_Definition_t *pxRegisteredCommands[ configCLI_MAX_COMMANDS ] =
 {
-    &x_cmd_help,  /* The first command in the list is always the help command, defined in this file. */
-    NULL            /* The next pointer is initialised to NULL, as there are no other registered commands yet. */
+    &x_cmd_help
 };
+static UBaseType_t uxRegisteredCommands = 1;
 
 /* A buffer into which command outputs can be written is declared here, rather
 than in the command console implementation, to allow multiple command consoles
@@ -115,130 +109,109 @@ buffer needs to be placed at a fixed address (rather than by the linker). */
 
 BaseType_t FreeRTOS_CLIRegisterCommand( const CLI_Command_Definition_t * const pxCommandToRegister )
 {
-    static CLI_Definition_List_Item_t *pxLastCommandInList = &xRegisteredCommands;
-    CLI_Definition_List_Item_t *pxNewListItem;
+    UBaseType_t i;
+    int cmp = 1;
     BaseType_t xReturn = pdFAIL;
 
     /* Check the parameter is not NULL. */
     configASSERT( pxCommandToRegister );
 
-    /* Create a new list item that will reference the command being registered. */
-    pxNewListItem = ( CLI_Definition_List_Item_t * ) pvPortMalloc( sizeof( CLI_Definition_List_Item_t ) );
-    configASSERT( pxNewListItem );
-
-    if( pxNewListItem != NULL )
+    taskENTER_CRITICAL();
     {
-        taskENTER_CRITICAL();
+        /* 插入排序：从表尾往前找插入位置，比它大的后移一格。
+        注册只在启动时做一次，查找时就不用逐个比较了。 */
+        for( i = uxRegisteredCommands; i > 0; i-- )
         {
-            /* Reference the command being registered from the newly created
-            list item. */
-            pxNewListItem->pxCommandLineDefinition = pxCommandToRegister;
+            cmp = strcmp( pxRegisteredCommands[ i - 1 ]->pcCommand, pxCommandToRegister->pcCommand );
+            if( cmp <= 0 )
+            {
+                break;
+            }
+        }
 
-            /* The new list item will get added to the end of the list, so
-            pxNext has nowhere to point. */
-            pxNewListItem->pxNext = NULL;
+        /* 表满或命令重名时不注册，返回 pdFAIL (不停机，其余命令照常可用) */
+        if( ( uxRegisteredCommands < configCLI_MAX_COMMANDS ) && ( cmp != 0 ) )
+        {
+            memmove( &pxRegisteredCommands[ i + 1 ], &pxRegisteredCommands[ i ],
+                     ( uxRegisteredCommands - i ) * sizeof( pxRegisteredCommands[ 0 ] ) );
+            pxRegisteredCommands[ i ] = pxCommandToRegister;
+            uxRegisteredCommands++;
+            xReturn = pdPASS;
+        }
+    }
+    taskEXIT_CRITICAL();
 
-            /* Add the newly created list item to the end of the already existing
-            list. */
-            pxLastCommandInList->pxNext = pxNewListItem;
+    return xReturn;
+}
+/*-----------------------------------------------------------*/
 
-            /* Set the end of list marker to the new list item. */
-            pxLastCommandInList = pxNewListItem;
-        }
-        taskEXIT_CRITICAL();
+/*
+ * 在排序表中二分查找命令名，pcName 必须已经以 0 结尾
+ */
+static const CLI_Command_Definition_t *prvFindCommand( const char *pcName )
+{
+    UBaseType_t uxLow = 0, uxHigh = uxRegisteredCommands, uxMid;
+    int cmp;
 
-        xReturn = pdPASS;
+    while( uxLow < uxHigh )
+    {
+        uxMid = ( uxLow + uxHigh ) / 2;
+        cmp = strcmp( pcName, pxRegisteredCommands[ uxMid ]->pcCommand );
+        if( cmp == 0 )
+        {
+            return pxRegisteredCommands[ uxMid ];
+        }
+        else if( cmp < 0 )
+        {
+            uxHigh = uxMid;
+        }
+        else
+        {
+            uxLow = uxMid + 1;
+        }
     }
 
-    return xReturn;
+    return NULL;
 }
 /*-----------------------------------------------------------*/
 
 BaseType_t FreeRTOS_CLIProcessCommand( char * pcCommandInput, char * pcWriteBuffer, size_t xWriteBufferLen  )
 {
-    static const CLI_Definition_List_Item_t *pxCommand = NULL;
-    BaseType_t xReturn = pdTRUE;
-    const char *pcRegisteredCommandString;
-    size_t xCommandStringLength;
-    static int n = 0;
-    const char *args[10 + 1];
+    const CLI_Command_Definition_t *pxCommand;
+    const char *args[ configCLI_MAX_ARGS ];
+    int8_t n;
 
     /* Note:  This function is not re-entrant.  It must not be called from more
     thank one task. */
+    ( void ) xWriteBufferLen;
 
-    if( pxCommand == NULL )
+    while( *pcCommandInput == ' ' )
     {
-        /* Search for the command string in the list of registered commands. */
-        for( pxCommand = &xRegisteredCommands; pxCommand != NULL; pxCommand = pxCommand->pxNext )
-        {
-            pcRegisteredCommandString = pxCommand->pxCommandLineDefinition->pcCommand;
-            xCommandStringLength = strlen( pcRegisteredCommandString );
-
-            /* To ensure the string lengths match exactly, so as not to pick up
-            a sub-string of a longer command, check the byte after the expected
-            end of the string is either the end of the string or a space before
-            a parameter. */
-            if( ( pcCommandInput[ xCommandStringLength ] == ' ' ) || ( pcCommandInput[ xCommandStringLength ] == 0x00 ) )
-            {
-                if( strncmp( pcCommandInput, pcRegisteredCommandString, xCommandStringLength ) == 0 )
-                {
-                    /* The command has been found.  Check it has the expected
-                    number of parameters.  If cExpectedNumberOfParameters is -1,
-                    then there could be a variable number of parameters and no
-                    check is made. */
-                    if( pxCommand->pxCommandLineDefinition->cExpectedNumberOfParameters >= 0 )
-                    {
-                        n = prvGetNumberOfParameters( pcCommandInput, args);
-                        if( n != pxCommand->pxCommandLineDefinition->cExpectedNumberOfParameters )
-                        {
-                            xReturn = pdFALSE; // 参数不匹配
-                        }
-                    } else {
-                        n = prvGetNumberOfParameters( pcCommandInput, args);
-                    }
-
-                    break;
-                }
-            }
-        }
+        pcCommandInput++;
     }
 
-    if( ( pxCommand != NULL ) && ( xReturn == pdFALSE ) ) /* 命令找到，但命令参数不匹配 */
+    /* 先就地切分参数，命令名随之以 0 结尾，再查表 */
+    n = prvGetNumberOfParameters( pcCommandInput, args );
+    pxCommand = prvFindCommand( pcCommandInput );
+
+    if( pxCommand == NULL ) /* 命令没找到 */
+    {
+        dbprintf("Command not recognised.\r\n");
+    }
+    else if( ( n < 0 ) /* 命令找到，但命令参数不匹配 */
+        || ( ( pxCommand->cExpectedNumberOfParameters >= 0 ) && ( n != pxCommand->cExpectedNumberOfParameters ) ) )
     {
         /* The command was found, but the number of parameters with the command
         was incorrect. */
-        #if 0
-        strncpy( pcWriteBuffer, "Incorrect command parameter(s).\r\n", xWriteBufferLen );
-        #endif
         dbprintf("Incorrect command parameter(s).\r\n");
-        pxCommand = NULL;
     }
-    else if( pxCommand != NULL ) /* 命令执行 */
+    else /* 命令执行 */
     {
-        /* Call the callback function that is registered to this command. */
         /* 传入参数个数和参数指针 */
-        pxCommand->pxCommandLineDefinition->pxCommandInterpreter( pcWriteBuffer, n, args);
-        xReturn = pdFALSE;
-
-        /* If xReturn is pdFALSE, then no further strings will be returned
-        after this one, and    pxCommand can be reset to NULL ready to search
-        for the next entered command. */
-        if( xReturn == pdFALSE )  /* 修改后所有命令都只执行一次 */
-        {
-            pxCommand = NULL;
-        }
-    }
-    else /* 命令没找到 */
-    {
-        /* pxCommand was NULL, the command was not found. */
-        #if 0
-        strncpy( pcWriteBuffer, "Command not recognised.\r\n", xWriteBufferLen );
-        #endif
-        dbprintf("Command not recognised.\r\n");
-        xReturn = pdFALSE;
+        pxCommand->pxCommandInterpreter( pcWriteBuffer, n, args );
     }
 
-    return xReturn; // 总是返回 pdFALSE
+    return pdFALSE; // 所有命令都只执行一次
 }
 /*-----------------------------------------------------------*/
 
@@ -306,71 +279,60 @@ const char *FreeRTOS_CLIGetParameter( const char *pcCommandString, UBaseType_t u
 
 static void cmd_help( char *chp, int argc, const char *argv[])
 {
-    const CLI_Definition_List_Item_t * pxCommand = NULL;
+    const CLI_Command_Definition_t *pxCommand;
+    UBaseType_t x;
     int i, space;
 
     (void)chp;
-    // (void)argc;
-    // (void)argv;
+    (void)argc;
+    (void)argv;
 
-    pxCommand = &xRegisteredCommands;
     dbprintf("There are all commands\r\n");
 
-    while (pxCommand != NULL)
+    /* 表是排好序的，按字母顺序列出 */
+    for( x = 0; x < uxRegisteredCommands; x++ )
     {
-        /* Return the next command help string, before moving the pointer on to
-        the next command in the list. */
-        #if 0
-        strcpy( chp, pxCommand->pxCommandLineDefinition->pcHelpString);
-        #endif
-        dbprintf("%s:", pxCommand->pxCommandLineDefinition->pcCommand);
-        space = 20 - strlen(pxCommand->pxCommandLineDefinition->pcCommand);
+        pxCommand = pxRegisteredCommands[ x ];
+        dbprintf("%s:", pxCommand->pcCommand);
+        space = 20 - strlen(pxCommand->pcCommand);
         for (i = 0; i<space; i++ ) {
             dbprintf(" ");
         }
-        dbprintf("%s", pxCommand->pxCommandLineDefinition->pcHelpString);
-        pxCommand = pxCommand->pxNext;
-    }
-
-    #if 0
-    dbprintf("\r\ntotal %d args\r\n", argc);
-    for (i = 0; i<argc; i++ ) {
-        dbprintf("%s\r\n", argv[i]);
+        dbprintf("%s", pxCommand->pcHelpString);
     }
-    #endif
 }
 /*-----------------------------------------------------------*/
 
 static int8_t prvGetNumberOfParameters( char *pcCommandString, const char *args[])
 {
     int8_t cParameters = 0;
-    BaseType_t xLastCharacterWasSpace = pdFALSE;
 
-    /* Count the number of space delimited words in pcCommandString. */
-    while( *pcCommandString != 0x00 )
+    /* 跳过命令名 */
+    while( ( *pcCommandString != 0x00 ) && ( *pcCommandString != ' ' ) )
     {
-        if( ( *pcCommandString ) == ' ' )
-        {
-            if( xLastCharacterWasSpace != pdTRUE )
-            {
-                *pcCommandString = 0;
-                args[cParameters++] = pcCommandString+1; /* 存储参数的地址 */
-                xLastCharacterWasSpace = pdTRUE;
-            }
-        }
-        else
-        {
-            xLastCharacterWasSpace = pdFALSE;
-        }
-
         pcCommandString++;
     }
 
-    /* If the command string ended with spaces, then there will have been too
-    many parameters counted. */
-    if( xLastCharacterWasSpace == pdTRUE )
+    for( ;; )
     {
-        cParameters--;
+        /* 分隔的空格全部改成 0，参数指针指向每个词的第一个字符 */
+        while( *pcCommandString == ' ' )
+        {
+            *pcCommandString++ = 0;
+        }
+        if( *pcCommandString == 0x00 )
+        {
+            break;
+        }
+        if( cParameters >= configCLI_MAX_ARGS )
+        {
+            return -1; /* 参数太多 */
+        }
+        args[ cParameters++ ] = pcCommandString;
+        while( ( *pcCommandString != 0x00 ) && ( *pcCommandString != ' ' ) )
+        {
+            pcCommandString++;
+        }
     }
 
     /* The value returned is one less than the number of space delimited words,
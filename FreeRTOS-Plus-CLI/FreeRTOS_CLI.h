@@ -44,6 +44,8 @@
 #define COMMAND_INTERPRETER_H
 
 #define config_MAX_OUTPUT_SIZE 2000
+#define configCLI_MAX_COMMANDS 64  /* 可注册的命令数，含 help；现在注册了约 40 个，留出余量 (每个 4 字节) */
+#define configCLI_MAX_ARGS     10  /* 每条命令最多的参数个数 */
 
 /* The prototype to which callback functions used to process command line
 commands must comply.  pcWriteBuffer is a buffer into which the output from
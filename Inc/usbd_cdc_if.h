@@ -90,6 +90,14 @@
   */
 
 /* USER CODE BEGIN EXPORTED_TYPES */
+/* USB 串口收发统计，link 命令显示 */
+typedef struct {
+  uint32_t rx_packets;
+  uint32_t rx_bytes;
+  uint32_t tx_bytes;
+  uint32_t tx_transfers;  // USBD_CDC_TransmitPacket 次数
+  uint32_t tx_packets;    // 64 字节包数，含零长度包
+} cdc_stats_t;
 
 /* USER CODE END EXPORTED_TYPES */
 
@@ -119,6 +127,7 @@
 extern USBD_CDC_ItfTypeDef USBD_Interface_fops_FS;
 
 /* USER CODE BEGIN EXPORTED_VARIABLES */
+extern cdc_stats_t cdc_stats;
 
 /* USER CODE END EXPORTED_VARIABLES */
 
@@ -134,7 +143,12 @@ extern USBD_CDC_ItfTypeDef USBD_Interface_fops_FS;
 uint8_t CDC_Transmit_FS(uint8_t* Buf, uint16_t Len);
 
 /* USER CODE BEGIN EXPORTED_FUNCTIONS */
-
+void CDC_TxComplete_FS(void);
+uint8_t CDC_TryTransmit_FS(uint8_t* Buf, uint16_t Len);
+void CDC_TxHold_FS(uint8_t hold);
+void CDC_TxLock_FS(uint8_t lock);
+int32_t CDC_RxPeek_FS(uint8_t **buf);
+void CDC_RxRelease_FS(void);
 /* USER CODE END EXPORTED_FUNCTIONS */
 
 /**
@@ -161,6 +161,10 @@ int main(void)
   /* USER CODE BEGIN 2 */
   // MY_SDIO_IO_Init();
   // MX_SDIO_SD_Init();
+  /* LCD 刷新用的 DMA1 通道7 (nt35510.c 直接操作寄存器) 不在 NanoVNA-F.ioc 里，
+     中断在这里打开，CubeMX 重新生成 MX_DMA_Init 时不会丢掉 */
+  HAL_NVIC_SetPriority(DMA1_Channel7_IRQn, 6, 0);
+  HAL_NVIC_EnableIRQ(DMA1_Channel7_IRQn);
   __enable_irq();
   /* USER CODE END 2 */
 
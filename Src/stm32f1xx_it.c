@@ -37,6 +37,7 @@
 #include "cmsis_os.h"
 
 /* USER CODE BEGIN 0 */
+#include "nt35510.h"
 
 /* USER CODE END 0 */
 
@@ -244,6 +245,14 @@ void TIM4_IRQHandler(void)
 }
 
 /* USER CODE BEGIN 1 */
+/**
+* @brief LCD 刷新的 DMA1 通道7，见 nt35510.c。
+* 这个通道不在 NanoVNA-F.ioc 里，放在用户代码段，重新生成时保留
+*/
+void DMA1_Channel7_IRQHandler(void)
+{
+  nt35510_dma_irq();
+}
 
 /* USER CODE END 1 */
 /************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
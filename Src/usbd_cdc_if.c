@@ -51,7 +51,9 @@
 #include "usbd_cdc_if.h"
 
 /* USER CODE BEGIN INCLUDE */
-
+#include <string.h>
+#include "cmsis_os.h"
+#include "task.h"
 /* USER CODE END INCLUDE */
 
 /* Private typedef -----------------------------------------------------------*/
@@ -93,8 +95,10 @@ extern void vUARTInterruptHandler(uint8_t* Buf, uint32_t *Len);
 /* USER CODE BEGIN PRIVATE_DEFINES */
 /* Define size for the receive and transmit buffer over CDC */
 /* It's up to user to redefine and/or remove those define */
-#define APP_RX_DATA_SIZE  1000
-#define APP_TX_DATA_SIZE  1000
+#define APP_RX_SLOTS      8     // 接收包槽数
+#define APP_RX_DATA_SIZE  (APP_RX_SLOTS * CDC_DATA_FS_MAX_PACKET_SIZE)
+#define APP_TX_RING_SIZE  1024  // 发送环形缓冲区，2 的幂
+#define APP_TX_DATA_SIZE  (APP_TX_RING_SIZE + CDC_DATA_FS_MAX_PACKET_SIZE)  // 末尾多一包，见 CDC_TxStart
 /* USER CODE END PRIVATE_DEFINES */
 
 /**
@@ -127,7 +131,30 @@ uint8_t UserRxBufferFS[APP_RX_DATA_SIZE];
 uint8_t UserTxBufferFS[APP_TX_DATA_SIZE];
 
 /* USER CODE BEGIN PRIVATE_VARIABLES */
-
+/*
+ * UserTxBufferFS 作为发送环形缓冲区
+ * CDC_Transmit_FS 只把数据拷进来就返回，IN 传输完成中断接着发送剩下的数据，
+ * 传输进行中写进来的数据合并成下一次传输，按 64 字节整包发出。
+ * 末尾多出一包，跨过末尾的传输把开头的数据复制过来凑成整包。
+ * 缓冲区发空时，如果最后一次传输是整包，补一个零长度包结束传输
+ */
+static volatile uint16_t tx_head;  // 写入位置，任务里修改
+static volatile uint16_t tx_tail;  // 发送位置，中断里修改
+static volatile uint16_t tx_len;   // 正在发送的长度
+static volatile uint8_t tx_zlp;    // 需要补零长度包
+static volatile uint8_t tx_writer; // 有任务正在写入，中断和 CDC_TryTransmit_FS 不插进来
+static volatile uint8_t tx_locked; // 命令执行中，输出只属于这条命令，见 CDC_TxLock_FS
+static volatile uint8_t tx_hold;   // 批处理中，只发整包，结束时再发剩下的
+
+/*
+ * UserRxBufferFS 分成 APP_RX_SLOTS 个 64 字节的槽，OUT 包直接收到槽里，
+ * 命令任务按包取走，不再逐字节拷贝和入队。
+ * 槽全满时不再准备接收，主机那边自然等待，CDC_RxRelease_FS 腾出槽后恢复
+ */
+static volatile uint8_t rx_head;     // 正在接收的槽
+static volatile uint8_t rx_tail;     // 最早收到、还没取走的槽
+static volatile uint8_t rx_stalled;  // 槽满，暂停接收
+static uint8_t rx_len[APP_RX_SLOTS];
 /* USER CODE END PRIVATE_VARIABLES */
 
 /**
@@ -142,6 +169,7 @@ uint8_t UserTxBufferFS[APP_TX_DATA_SIZE];
 extern USBD_HandleTypeDef hUsbDeviceFS;
 
 /* USER CODE BEGIN EXPORTED_VARIABLES */
+cdc_stats_t cdc_stats;
 
 /* USER CODE END EXPORTED_VARIABLES */
 
@@ -160,7 +188,8 @@ static int8_t CDC_Control_FS(uint8_t cmd, uint8_t* pbuf, uint16_t length);
 static int8_t CDC_Receive_FS(uint8_t* pbuf, uint32_t *Len);
 
 /* USER CODE BEGIN PRIVATE_FUNCTIONS_DECLARATION */
-
+static void CDC_TxStart(void);
+static uint16_t CDC_TxWrite(const uint8_t *Buf, uint16_t Len);
 /* USER CODE END PRIVATE_FUNCTIONS_DECLARATION */
 
 /**
@@ -185,6 +214,8 @@ static int8_t CDC_Init_FS(void)
   /* USER CODE BEGIN 3 */
   /* Set Application Buffers */
   USBD_CDC_SetTxBuffer(&hUsbDeviceFS, UserTxBufferFS, 0);
+  rx_head = rx_tail = 0;
+  rx_stalled = 0;
   USBD_CDC_SetRxBuffer(&hUsbDeviceFS, UserRxBufferFS);
   return (USBD_OK);
   /* USER CODE END 3 */
@@ -291,8 +322,18 @@ static int8_t CDC_Control_FS(uint8_t cmd, uint8_t* pbuf, uint16_t length)
 static int8_t CDC_Receive_FS(uint8_t* Buf, uint32_t *Len)
 {
   /* USER CODE BEGIN 6 */
-  USBD_CDC_SetRxBuffer(&hUsbDeviceFS, &Buf[0]);
-  USBD_CDC_ReceivePacket(&hUsbDeviceFS);
+  uint8_t next = (rx_head + 1) % APP_RX_SLOTS;
+
+  rx_len[rx_head] = *Len;
+  rx_head = next;
+  cdc_stats.rx_packets++;
+  cdc_stats.rx_bytes += *Len;
+  if (next != rx_tail) {  // 下一个槽空闲，继续接收
+    USBD_CDC_SetRxBuffer(&hUsbDeviceFS, &UserRxBufferFS[next * CDC_DATA_FS_MAX_PACKET_SIZE]);
+    USBD_CDC_ReceivePacket(&hUsbDeviceFS);
+  } else {
+    rx_stalled = 1;
+  }
   /* RX INT */
   vUARTInterruptHandler(Buf, Len);
   return (USBD_OK);
@@ -314,33 +355,193 @@ uint8_t CDC_Transmit_FS(uint8_t* Buf, uint16_t Len)
 {
   uint8_t result = USBD_OK;
   /* USER CODE BEGIN 7 */
-  USBD_CDC_HandleTypeDef *hcdc = (USBD_CDC_HandleTypeDef*)hUsbDeviceFS.pClassData;
-  // if (hcdc->TxState != 0){
-    // return USBD_BUSY;
-  // }
-  while (hcdc->TxState != 0);  //  can not always wait
-  // USBD_CDC_SetTxBuffer(&hUsbDeviceFS, Buf, Len);
-  // result = USBD_CDC_TransmitPacket(&hUsbDeviceFS);
-  if((Len % 64) == 0)
-  {
-    USBD_CDC_SetTxBuffer(&hUsbDeviceFS, Buf, Len);
-    result = USBD_CDC_TransmitPacket(&hUsbDeviceFS);
-    while (hcdc->TxState != 0);
-    USBD_CDC_SetTxBuffer(&hUsbDeviceFS, Buf, 0);
-    result = USBD_CDC_TransmitPacket(&hUsbDeviceFS);
+  uint16_t n;
+
+  if (__get_IPSR() != 0) {  // 中断里不能挂起调度器，也不能等待，放不下时整段丢弃
+    if (hUsbDeviceFS.pClassData == NULL || tx_writer || tx_locked ||
+        ((tx_tail - tx_head - 1) & (APP_TX_RING_SIZE - 1)) < Len)
+      return USBD_BUSY;
+    CDC_TxWrite(Buf, Len);
+    return USBD_OK;
   }
-  else
-  {
-    USBD_CDC_SetTxBuffer(&hUsbDeviceFS, Buf, Len);
-    result = USBD_CDC_TransmitPacket(&hUsbDeviceFS);
-    while (hcdc->TxState != 0);
+  tx_writer = 1;
+  while (Len > 0) {
+    if (hUsbDeviceFS.dev_state != USBD_STATE_CONFIGURED || hUsbDeviceFS.pClassData == NULL) {
+      result = USBD_FAIL;  // 没有连接，丢掉
+      break;
+    }
+    vTaskSuspendAll();
+    n = CDC_TxWrite(Buf, Len);
+    xTaskResumeAll();
+    if (n == 0) {  // 缓冲区满，等中断发出一部分
+      if (osKernelRunning())
+        osDelay(1);
+      continue;
+    }
+    Buf += n;
+    Len -= n;
   }
+  tx_writer = 0;
   /* USER CODE END 7 */
   return result;
 }
 
 /* USER CODE BEGIN PRIVATE_FUNCTIONS_IMPLEMENTATION */
+/*
+ * 尽量多地拷进发送缓冲区并启动发送，返回拷入的字节数
+ * 调用者保证没有其他任务同时写入
+ */
+static uint16_t CDC_TxWrite(const uint8_t *Buf, uint16_t Len)
+{
+  uint16_t n, space, done = 0;
+
+  while (Len > 0) {
+    space = (tx_tail - tx_head - 1) & (APP_TX_RING_SIZE - 1);
+    n = APP_TX_RING_SIZE - tx_head;  // 到缓冲区末尾
+    if (n > space)
+      n = space;
+    if (n > Len)
+      n = Len;
+    if (n == 0)
+      break;
+    memcpy(&UserTxBufferFS[tx_head], Buf, n);
+    tx_head = (tx_head + n) & (APP_TX_RING_SIZE - 1);
+    Buf += n;
+    Len -= n;
+    done += n;
+  }
+  if (done) {
+    __disable_irq();
+    CDC_TxStart();
+    __enable_irq();
+  }
+  return done;
+}
 
+/*
+ * 不等待的发送，放不下或者有其他任务正在写时整段丢弃，返回 USBD_BUSY
+ * 扫描任务推送数据用，不能被 USB 拖慢
+ */
+uint8_t CDC_TryTransmit_FS(uint8_t* Buf, uint16_t Len)
+{
+  uint8_t result = USBD_BUSY;
+
+  if (hUsbDeviceFS.dev_state != USBD_STATE_CONFIGURED || hUsbDeviceFS.pClassData == NULL)
+    return USBD_FAIL;
+  vTaskSuspendAll();
+  if (!tx_writer && !tx_locked && ((tx_tail - tx_head - 1) & (APP_TX_RING_SIZE - 1)) >= Len) {
+    tx_writer = 1;  // 写入途中来的中断不能插进来
+    CDC_TxWrite(Buf, Len);
+    tx_writer = 0;
+    result = USBD_OK;
+  }
+  xTaskResumeAll();
+  return result;
+}
+
+/*
+ * 端点空闲时开始下一次传输：从 tx_tail 到缓冲区末尾或 tx_head 的数据一次发出
+ * 跨过末尾时，末尾不满一包的零头接上开头的数据 (复制到末尾多出的一包里)，
+ * 只有整个缓冲区的最后一包可能不满
+ * 在中断里或关中断时调用
+ */
+static void CDC_TxStart(void)
+{
+  USBD_CDC_HandleTypeDef *hcdc = (USBD_CDC_HandleTypeDef*)hUsbDeviceFS.pClassData;
+  uint16_t n, wrap, k;
+
+  if (hcdc == NULL || hcdc->TxState != 0)
+    return;
+  n = (tx_head - tx_tail) & (APP_TX_RING_SIZE - 1);
+  if (n == 0) {
+    if (tx_zlp) {
+      tx_zlp = 0;
+      tx_len = 0;
+      cdc_stats.tx_transfers++;
+      cdc_stats.tx_packets++;
+      USBD_CDC_SetTxBuffer(&hUsbDeviceFS, UserTxBufferFS, 0);
+      USBD_CDC_TransmitPacket(&hUsbDeviceFS);
+    }
+    return;
+  }
+  if (n > APP_TX_RING_SIZE - tx_tail) {
+    wrap = n - (APP_TX_RING_SIZE - tx_tail);  // 绕回开头的数据
+    n = APP_TX_RING_SIZE - tx_tail;
+    k = (CDC_DATA_FS_MAX_PACKET_SIZE - n % CDC_DATA_FS_MAX_PACKET_SIZE) % CDC_DATA_FS_MAX_PACKET_SIZE;
+    if (k > wrap)
+      k = wrap;
+    memcpy(&UserTxBufferFS[APP_TX_RING_SIZE], UserTxBufferFS, k);
+    n += k;
+  }
+  if (tx_hold)  // 批处理中不发零头
+    n -= n % CDC_DATA_FS_MAX_PACKET_SIZE;
+  if (n == 0)
+    return;
+  tx_len = n;
+  tx_zlp = (n % CDC_DATA_FS_MAX_PACKET_SIZE) == 0;
+  cdc_stats.tx_transfers++;
+  cdc_stats.tx_packets += (n + CDC_DATA_FS_MAX_PACKET_SIZE - 1) / CDC_DATA_FS_MAX_PACKET_SIZE;
+  cdc_stats.tx_bytes += n;
+  USBD_CDC_SetTxBuffer(&hUsbDeviceFS, &UserTxBufferFS[tx_tail], n);
+  USBD_CDC_TransmitPacket(&hUsbDeviceFS);
+}
+
+/*
+ * 暂缓发送不满一包的数据，批处理命令的输出合并成整包
+ * hold = 0 时立即发出剩下的数据
+ */
+void CDC_TxHold_FS(uint8_t hold)
+{
+  __disable_irq();
+  tx_hold = hold;
+  if (!hold)
+    CDC_TxStart();
+  __enable_irq();
+}
+
+/*
+ * 命令执行期间占住发送缓冲区 (appcmd.c 的 prvRunCommand)
+ * 一条命令的输出分多次写入，中间 CDC_TryTransmit_FS 和中断里的写入
+ * 都返回 USBD_BUSY，推送的数据只会出现在两条命令的输出之间
+ */
+void CDC_TxLock_FS(uint8_t lock)
+{
+  tx_locked = lock;
+}
+
+/*
+ * CDC IN 端点传输完成，HAL_PCD_DataInStageCallback 调用
+ */
+void CDC_TxComplete_FS(void)
+{
+  tx_tail = (tx_tail + tx_len) & (APP_TX_RING_SIZE - 1);
+  tx_len = 0;
+  CDC_TxStart();
+}
+
+/*
+ * 取最早收到的一个包，返回长度，没有数据返回 -1
+ * 用完后调用 CDC_RxRelease_FS
+ */
+int32_t CDC_RxPeek_FS(uint8_t **buf)
+{
+  if (rx_tail == rx_head && !rx_stalled)
+    return -1;
+  *buf = &UserRxBufferFS[rx_tail * CDC_DATA_FS_MAX_PACKET_SIZE];
+  return rx_len[rx_tail];
+}
+
+void CDC_RxRelease_FS(void)
+{
+  __disable_irq();
+  rx_tail = (rx_tail + 1) % APP_RX_SLOTS;
+  if (rx_stalled) {  // 腾出了槽，恢复接收
+    rx_stalled = 0;
+    USBD_CDC_SetRxBuffer(&hUsbDeviceFS, &UserRxBufferFS[rx_head * CDC_DATA_FS_MAX_PACKET_SIZE]);
+    USBD_CDC_ReceivePacket(&hUsbDeviceFS);
+  }
+  __enable_irq();
+}
 /* USER CODE END PRIVATE_FUNCTIONS_IMPLEMENTATION */
 
 /**
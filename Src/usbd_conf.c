@@ -55,6 +55,7 @@
 #include "usbd_cdc.h"
 
 /* USER CODE BEGIN Includes */
+#include "usbd_cdc_if.h"
 
 /* USER CODE END Includes */
 
@@ -82,7 +83,21 @@ void _Error_Handler(char * file, int line);
 /* Private functions ---------------------------------------------------------*/
 
 /* USER CODE BEGIN 1 */
+/*
+ * IN 传输完成后发送环形缓冲区里的下一段 (usbd_cdc_if.c 的 CDC_TxComplete_FS)。
+ * CubeMX 重新生成时 USER CODE 以外的部分会被改写，HAL_PCD_DataInStageCallback
+ * 里又没有 USER CODE 段，所以在这里把它调用的 USBD_LL_DataInStage 换成
+ * 先交给 USB 库 (清 TxState)、再开始下一次传输的版本
+ */
+static USBD_StatusTypeDef USBD_LL_DataInStage_Tx(USBD_HandleTypeDef *pdev, uint8_t epnum, uint8_t *pdata)
+{
+  USBD_StatusTypeDef ret = USBD_LL_DataInStage(pdev, epnum, pdata);
 
+  if (epnum == (CDC_IN_EP & 0x7F))
+    CDC_TxComplete_FS();
+  return ret;
+}
+#define USBD_LL_DataInStage  USBD_LL_DataInStage_Tx
 /* USER CODE END 1 */
 
 void HAL_PCDEx_SetConnectionState(PCD_HandleTypeDef *hpcd, uint8_t state);
@@ -88,7 +88,10 @@
 #include "system.h"
 
 /* Dimensions the buffer into which input characters are placed. */
-#define cmdMAX_INPUT_SIZE           48
+#define cmdMAX_INPUT_SIZE           128  /* 批处理一行放多条命令 */
+
+/* 批处理命令的分隔符 */
+#define cmdBATCH_SEPARATOR          ';'
 
 /* Dimentions a buffer to be used by the UART driver, if the UART driver uses a
 buffer at all. */
@@ -135,6 +138,10 @@ available. */
  * The task that implements the command console processing.
  */
 void cmd_register( void );
+void cmd_lock( void );
+void cmd_unlock( void );
+void cmd_begin( void );
+void cmd_end( void );
 /*-----------------------------------------------------------*/
 
 /* Const messages output by the command console. */
@@ -150,6 +157,56 @@ static SemaphoreHandle_t xTxMutex = NULL;
 static xComPortHandle xPort = 0;
 /*-----------------------------------------------------------*/
 
+/*
+ * 执行一条命令，前后记录执行时间
+ * 执行期间占住 USB 发送，stream/event 推送的数据不会插进命令的输出
+ */
+static void prvRunCommand( char *pcCommand, char *pcOutStr )
+{
+  vSerialLock( xPort, pdTRUE );
+  cmd_begin();
+  FreeRTOS_CLIProcessCommand( pcCommand, pcOutStr, config_MAX_OUTPUT_SIZE );
+  cmd_end();
+  vSerialLock( xPort, pdFALSE );
+}
+/*-----------------------------------------------------------*/
+
+/*
+ * 执行一行命令。含 ';' 时是批处理：各条命令在同一次测量锁定内依次执行，
+ * 中间不会插入扫描；输出攒成整包，连同提示符一起发出
+ */
+static void prvProcessLine( char *pcLine, char *pcOutStr )
+{
+  char *pcNext;
+
+  if( strchr( pcLine, cmdBATCH_SEPARATOR ) == NULL )
+  {
+    prvRunCommand( pcLine, pcOutStr );
+    return;
+  }
+
+  cmd_lock();
+  while( pcLine != NULL )
+  {
+    pcNext = strchr( pcLine, cmdBATCH_SEPARATOR );
+    if( pcNext != NULL )
+    {
+      *pcNext++ = '\0';
+    }
+    while( *pcLine == ' ' )
+    {
+      pcLine++;
+    }
+    if( *pcLine != '\0' )  /* 跳过空命令，如 "a;;b" 或结尾的 ';' */
+    {
+      prvRunCommand( pcLine, pcOutStr );
+    }
+    pcLine = pcNext;
+  }
+  cmd_unlock();
+}
+/*-----------------------------------------------------------*/
+
 void cmd_init(void)
 {
   /* Create the semaphore used to access the UART Tx. */
@@ -163,9 +220,12 @@ void cmd_init(void)
 void cmd_loop( void *pvParameters )
 {
   signed char cRxedChar;
+  const signed char *pcSpan;
+  unsigned short usSpan, i;
   uint8_t ucInputIndex = 0;
   char *pcOutStr;
-  static char cInputStr[ cmdMAX_INPUT_SIZE ], cLastInputStr[ cmdMAX_INPUT_SIZE ];
+  BaseType_t xBatch;
+  static char cInputStr[ cmdMAX_INPUT_SIZE ];
   xComPortHandle xPort;
 
   ( void ) pvParameters;
@@ -195,79 +255,93 @@ void cmd_loop( void *pvParameters )
 （3）如果把xTicksToWait 设置为portMAX_DELAY，
      并且在FreeRTOSConig.h 中设定INCLUDE_vTaskSuspend 为1，那么阻塞等待将没有超时限制。
 */
-    while( xSerialGetChar( xPort, &cRxedChar, portMAX_DELAY ) != pdTRUE );
+    while( ( usSpan = usSerialGetSpan( xPort, &pcSpan, portMAX_DELAY ) ) == 0 );
 
     /* Ensure exclusive access to the UART Tx. */
     if( xSemaphoreTake( xTxMutex, cmdMAX_MUTEX_WAIT ) == pdPASS )
     {
-      /* Echo the character back. */
-      // if( cRxedChar != '\r' && cRxedChar != '\n')
-          // xSerialPutChar( xPort, cRxedChar, portMAX_DELAY );
-
-      /* Was it the end of the line? */
-      if( cRxedChar == '\n' || cRxedChar == '\r' )
+      /* 一次处理整个包，不再每个字符取一次互斥量 */
+      for( i = 0; i < usSpan; i++ )
       {
-        /* Just to space the output from the input. */
-        vSerialPutString( xPort, ( signed char * ) pcNewLine, ( unsigned short ) strlen( pcNewLine ) );
+        cRxedChar = pcSpan[ i ];
 
-        /* See if the command is empty, indicating that the last command
-        is to be executed again. */
-        if( ucInputIndex > 0)
+        /* Echo the character back. */
+        // if( cRxedChar != '\r' && cRxedChar != '\n')
+            // xSerialPutChar( xPort, cRxedChar, portMAX_DELAY );
+
+        /* Was it the end of the line? */
+        if( cRxedChar == '\n' || cRxedChar == '\r' )
         {
-          /* Get the next output string from the command interpreter. */
-          FreeRTOS_CLIProcessCommand( cInputStr, pcOutStr, config_MAX_OUTPUT_SIZE );
-
-          /* Write the generated string to the UART. */
-          /* 命令执行结果放入缓存，在这里打印 */
-          #if 0  // 改为直接在命令里打印
-          vSerialPutString( xPort, ( signed char * ) pcOutStr, ( unsigned short ) strlen( pcOutStr ) );
-          #endif
-
-          /* All the strings generated by the input command have been
-          sent.  Clear the input string ready to receive the next command.
-          Remember the command that was just processed first in case it is
-          to be processed again. */
-          strcpy( cLastInputStr, cInputStr );
-          ucInputIndex = 0;
-          memset( cInputStr, 0x00, cmdMAX_INPUT_SIZE );
-        } else {
-          /* Copy the last command back into the input string. */
-          // strcpy( cInputStr, cLastInputStr );  // 不执行上一次命令
-        }
+          /* 批处理的输出整批合并发送 */
+          xBatch = ( strchr( cInputStr, cmdBATCH_SEPARATOR ) != NULL );
+          if( xBatch )
+          {
+            vSerialHold( xPort, pdTRUE );
+          }
 
-        /* 清空队列 */
-        xSerialReset( xPort );
+          /* Just to space the output from the input. */
+          vSerialPutString( xPort, ( signed char * ) pcNewLine, ( unsigned short ) strlen( pcNewLine ) );
 
-        vSerialPutString( xPort, ( signed char * ) pcEndOfMsg, ( unsigned short ) strlen( pcEndOfMsg ) );
-      }
-      else
-      {
-        if( cRxedChar == '\b' )
-        {
-          /* Backspace was pressed.  Erase the last character in the
-          string - if any. */
-          if( ucInputIndex > 0 )
+          /* See if the command is empty, indicating that the last command
+          is to be executed again. */
+          if( ucInputIndex > 0)
+          {
+            /* Get the next output string from the command interpreter. */
+            prvProcessLine( cInputStr, pcOutStr );
+
+            /* Write the generated string to the UART. */
+            /* 命令执行结果放入缓存，在这里打印 */
+            #if 0  // 改为直接在命令里打印
+            vSerialPutString( xPort, ( signed char * ) pcOutStr, ( unsigned short ) strlen( pcOutStr ) );
+            #endif
+
+            /* All the strings generated by the input command have been
+            sent.  Clear the input string ready to receive the next command. */
+            ucInputIndex = 0;
+            memset( cInputStr, 0x00, cmdMAX_INPUT_SIZE );
+          } else {
+            /* Copy the last command back into the input string. */
+            // strcpy( cInputStr, cLastInputStr );  // 不执行上一次命令
+          }
+
+          /* 清空队列 */
+          xSerialReset( xPort );
+
+          vSerialPutString( xPort, ( signed char * ) pcEndOfMsg, ( unsigned short ) strlen( pcEndOfMsg ) );
+          if( xBatch )
           {
-            ucInputIndex--;
-            cInputStr[ ucInputIndex ] = '\0';
-            /* 删除光标左边的一个字符 */
-            MOVELEFT(1);
-            CLEAR_LINE();
+            vSerialHold( xPort, pdFALSE );
           }
         }
         else
         {
-          /* A character was entered.  Add it to the string entered so
-          far.  When a \n is entered the complete    string will be
-          passed to the command interpreter. */
-          if( ( cRxedChar >= ' ' ) && ( cRxedChar < '~' ) )
+          if( cRxedChar == '\b' )
+          {
+            /* Backspace was pressed.  Erase the last character in the
+            string - if any. */
+            if( ucInputIndex > 0 )
+            {
+              ucInputIndex--;
+              cInputStr[ ucInputIndex ] = '\0';
+              /* 删除光标左边的一个字符 */
+              MOVELEFT(1);
+              CLEAR_LINE();
+            }
+          }
+          else
           {
-            if( ucInputIndex < cmdMAX_INPUT_SIZE )
+            /* A character was entered.  Add it to the string entered so
+            far.  When a \n is entered the complete    string will be
+            passed to the command interpreter. */
+            if( ( cRxedChar >= ' ' ) && ( cRxedChar < '~' ) )
             {
-              cInputStr[ ucInputIndex ] = cRxedChar;
-              ucInputIndex++;
-              /* 屏幕 ECHO */
-              xSerialPutChar( xPort, cRxedChar, portMAX_DELAY );
+              if( ucInputIndex < cmdMAX_INPUT_SIZE - 1 )  /* 留一个结束符 */
+              {
+                cInputStr[ ucInputIndex ] = cRxedChar;
+                ucInputIndex++;
+                /* 屏幕 ECHO */
+                xSerialPutChar( xPort, cRxedChar, portMAX_DELAY );
+              }
             }
           }
         }
@@ -276,6 +350,7 @@ void cmd_loop( void *pvParameters )
       /* Must ensure to give the mutex back. */
       xSemaphoreGive( xTxMutex );
     }
+    vSerialConsume( xPort, usSpan );
   }
 }
 /*-----------------------------------------------------------*/
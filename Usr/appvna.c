@@ -24,6 +24,7 @@
 #include "fatfs.h"
 #include "fs_funs.h"
 
+#include <stddef.h>
 #include <stdio.h>
 #include <math.h>
 #include <ctype.h>
@@ -48,8 +49,14 @@ int32_t acquire = 0;
 
 // static void apply_error_term(void);
 static void apply_error_term_at(int i);
+static void apply_error_term_to(float s[2][2], float e[5][2]);
 static void apply_edelay_at(int i);
+#if USE_FIXED_POINT
+static void apply_error_term_fix(int i, fix_t s[2][2]);
+#endif
 static void cal_interpolate(int s);
+static void sweep_average_at(int i, float prev[2][2]);
+static void event_retry(void);
 
 void sweep(void);
 
@@ -74,8 +81,23 @@ int8_t frequency_updated = FALSE;
 int8_t sweep_enabled = TRUE;
 int8_t cal_auto_interpolate = TRUE;
 int8_t redraw_requested = FALSE;
+uint32_t sweep_count = 0;  // 完成的扫描次数，bindata 帧头里的序号
 int16_t vbat = 0;
 
+/*
+ * 扫描平均，直接在 measured 上做，不另外开缓存
+ * AVG_SWEEP: 前 avg_factor 次是累加平均，之后按 1/avg_factor 指数加权
+ * AVG_EXP:   每次按 avg_alpha 指数平滑
+ * 修改扫频参数、校准开关、电延时后重新开始
+ */
+enum { AVG_OFF, AVG_SWEEP, AVG_EXP };
+static uint8_t avg_mode = AVG_OFF;
+static uint16_t avg_factor = 16;
+static float avg_alpha = 0.25;
+static uint16_t avg_sweeps = 0;  // 已经平均的次数
+static float avg_weight = 1;     // 本次扫描新数据的权重
+static int16_t sweep_next = 0;   // 扫描被界面打断后从这一点继续
+
 /* 文件读写测试 */
 #define  FILE_SIZE   (4*1024)
 uint8_t  file_buf[FILE_SIZE];
@@ -99,16 +121,17 @@ void app_loop(void)
     } else {
       ui_process();
     }
-    /* calculate trace coordinates：坐标 */
-    plot_into_index(measured); // 标记要画的点
-    /* plot trace as raster */
-    draw_all_cells();
+    /* 快速扫描时不是每次扫描都重画，见 plot_frame_due */
+    if (!sweep_enabled || redraw_requested || plot_frame_due(FALSE))
+      plot_frame();  // 计算曲线坐标，标记并绘制变化的 CELL
 
     if (sweep_enabled)
     {
       vbat = (int16_t)bat_adc_display();
       // draw_battery_status();
     }
+
+    event_retry();  // 上次没发出去的扫描完成事件
   }
 }
 
@@ -127,6 +150,62 @@ void toggle_sweep(void)
   sweep_enabled = !sweep_enabled;
 }
 
+/*
+ * 批处理命令 (appcmd.c) 整批在测量互斥量内执行
+ */
+static uint8_t cmd_batch = FALSE;
+
+void cmd_lock(void)
+{
+  chMtxLock(&mutex);
+  cmd_batch = TRUE;
+}
+
+void cmd_unlock(void)
+{
+  cmd_batch = FALSE;
+  chMtxUnlock(&mutex);
+}
+
+/*
+ * 命令执行时间统计，appcmd.c 在每条命令前后调用，link 命令显示
+ * 按 2 的幂分档：第 b 档为 [2^(b-1), 2^b) us
+ */
+#define CMD_TIME_BINS  24
+
+static uint32_t cmd_time_hist[CMD_TIME_BINS];
+static uint32_t cmd_time_max;  // us
+static uint32_t cmd_cycles0;
+static TickType_t cmd_tick0;
+
+void cmd_begin(void)
+{
+  if (!(DWT->CTRL & DWT_CTRL_CYCCNTENA_Msk)) {  // 用 DWT 周期计数器计时
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+  }
+  cmd_tick0 = xTaskGetTickCount();
+  cmd_cycles0 = DWT->CYCCNT;
+}
+
+void cmd_end(void)
+{
+  uint32_t us, ms;
+  int b;
+
+  us = (DWT->CYCCNT - cmd_cycles0) / (SystemCoreClock / 1000000);
+  ms = (xTaskGetTickCount() - cmd_tick0) * portTICK_PERIOD_MS;
+  if (ms >= 1000)  // 周期计数器约 1 分钟溢出，长的 (wait) 用系统节拍
+    us = ms * 1000;
+  b = us ? 32 - __CLZ(us) : 0;
+  if (b >= CMD_TIME_BINS)
+    b = CMD_TIME_BINS - 1;
+  cmd_time_hist[b]++;
+  if (us > cmd_time_max)
+    cmd_time_max = us;
+}
+
 /*
 =======================================
     扫频暂停
@@ -444,6 +523,21 @@ void HAL_I2S_RxCpltCallback(I2S_HandleTypeDef *hi2s)
   }
 }
 
+/*
+ * 输出一个复数 "re im\r\n"，与 "%f %f" 的格式相同，不经过浮点 printf。
+ * 先格式化到本地的一行，再和其他输出一样经 chprintf 发出
+ */
+static void print_complex(BaseSequentialStream *chp, const float v[2])
+{
+  char line[40];
+  int n;
+
+  n = fmt_fixed(line, sizeof(line)/2, v[0], 6);  // 超长 (|v| > 1e12) 时截断，各占一半
+  line[n++] = ' ';
+  fmt_fixed(line+n, sizeof(line)-n, v[1], 6);
+  chprintf(chp, "%s\r\n", line);
+}
+
 /*
 =======================================
     命令：获取数据
@@ -469,13 +563,22 @@ static void cmd_data(BaseSequentialStream *chp, int argc, char *argv[])
   if (sel == 0 || sel == 1) {
     chMtxLock(&mutex);
     for (i = 0; i < sweep_points; i++) {
-      chprintf(chp, "%f %f\r\n", measured[sel][i][0], measured[sel][i][1]);
+      print_complex(chp, measured[sel][i]);
     }
     chMtxUnlock(&mutex);
   } else if (sel >= 2 && sel < 7) {
     chMtxLock(&mutex);
     for (i = 0; i < sweep_points; i++) {
-      chprintf(chp, "%f %f\r\n", cal_data[sel-2][i][0], cal_data[sel-2][i][1]);
+      print_complex(chp, cal_data[sel-2][i]);
+    }
+    chMtxUnlock(&mutex);
+  } else if (sel == 7 || sel == 8) {  // memory S11/S21
+    float v[2];
+    chMtxLock(&mutex);
+    for (i = 0; i < sweep_points; i++) {
+      if (!trace_memory_get(sel-7, i, v))
+        break;
+      print_complex(chp, v);
     }
     chMtxUnlock(&mutex);
   } else {
@@ -485,6 +588,464 @@ static void cmd_data(BaseSequentialStream *chp, int argc, char *argv[])
 static const CLI_Command_Definition_t x_cmd_data = {
 "data", "usage: data [array]\r\n", (shellcmd_t)cmd_data, -1};
 
+/*
+=======================================
+    CRC-32，与 zlib crc32() 相同
+    (多项式 0xEDB88320，初值和结果取反)，半字节查表
+=======================================
+*/
+static const uint32_t crc32_tbl[16] = {
+  0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC,
+  0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+  0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C,
+  0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+};
+
+uint32_t crc32(uint32_t crc, const void *data, int len)
+{
+  const uint8_t *p = data;
+
+  crc = ~crc;
+  while (len-- > 0) {
+    crc ^= *p++;
+    crc = (crc >> 4) ^ crc32_tbl[crc & 0x0f];
+    crc = (crc >> 4) ^ crc32_tbl[crc & 0x0f];
+  }
+  return ~crc;
+}
+
+/*
+=======================================
+    命令：二进制数据
+    bindata [z] f|0-8 ...
+    f    频率，uint32
+    0-8  同 data 命令，float 实部、虚部
+    z    后面的数组压缩发送 (BIN_FMT_U32DD / BIN_FMT_I16X2)，约为一半大小
+    每个数组一帧：16 字节帧头 (bin_header_t) 后面跟数据，
+    数据直接从测量/校准数组发出。帧之间不补齐，发送期间暂缓不满一包的数据，
+    帧头和数据合并成 64 字节整包，只有最后一包不满。
+    所有数组在同一次锁定内发送，帧头序号相同。
+    有不认识的参数时只回一行 usage，不发任何帧
+=======================================
+*/
+static void bindata_send(int array, const void *data, int format, int points, int size)
+{
+  bin_header_t h;
+
+  h.magic = BIN_MAGIC;
+  h.format = format;
+  h.array = array;
+  h.seq = sweep_count;
+  h.points = points;
+  h.size = size;
+  h.crc = crc32(0, data, size);
+  CDC_Transmit_FS((uint8_t *)&h, sizeof h);
+  CDC_Transmit_FS((uint8_t *)data, size);
+}
+
+/*
+ * 压缩格式，写到输出缓冲区的前半部分，返回字节数
+ * 展开的数据记忆放在 BIN_UNPACK_AREA 之后，两者不重叠
+ */
+#define BIN_UNPACK_AREA  1024
+
+static int bin_put_varint(uint8_t *out, uint32_t v)
+{
+  int n = 0;
+
+  while (v >= 0x80) {
+    out[n++] = (uint8_t)(v | 0x80);
+    v >>= 7;
+  }
+  out[n++] = (uint8_t)v;
+  return n;
+}
+
+/*
+ * BIN_FMT_U32DD：扫描频率等间隔，二阶差分只有取整误差，每点 1 字节
+ */
+static int bin_pack_u32(uint8_t *out, const uint32_t *v, int points)
+{
+  int i, n = 0;
+  uint32_t d, prev_d = 0;
+  int32_t dd;
+
+  if (points <= 0)
+    return 0;
+  memcpy(out, &v[0], 4);
+  n = 4;
+  for (i = 1; i < points; i++) {
+    d = v[i] - v[i-1];
+    dd = (int32_t)(d - prev_d);
+    prev_d = d;
+    n += bin_put_varint(out + n, ((uint32_t)dd << 1) ^ (uint32_t)(dd >> 31));  // zigzag
+  }
+  return n;
+}
+
+/*
+ * BIN_FMT_I16X2：块浮点，每块按最大分量取指数，|误差| <= 2^(e-1) <= 块内最大值 / 32767
+ * 直接比较 float 的位模式 (正数的大小顺序相同)，不用 frexpf/ldexpf。
+ * NaN 发 0，inf 发最大值，都不影响同块的其他点
+ */
+static int bin_pack_f32x2(uint8_t *out, const float (*v)[2], int points)
+{
+  union { float f; uint32_t i; } u;
+  int i, j, m, n = 0, e;
+  uint32_t amax;
+  float x, scale;
+  int32_t q;
+
+  for (i = 0; i < points; i += BIN_BLOCK) {
+    m = points - i < BIN_BLOCK ? points - i : BIN_BLOCK;
+    amax = 0;
+    for (j = 0; j < m * 2; j++) {
+      u.f = v[i + j/2][j & 1];
+      if ((u.i & 0x7fffffff) > amax && (u.i & 0x7f800000) != 0x7f800000)  // NaN/inf 不算
+        amax = u.i & 0x7fffffff;
+    }
+    // 阶码 emax 时 |x| < 2^(emax-126)，q = x * 2^-e < 32768；
+    // 最大值的尾数 >= 1 - 2^-15 时 q 会舍入成 32768，指数再加 1
+    e = (int)(amax >> 23) - 141;
+    if ((amax & 0x7fffff) >= 0x7fff00)
+      e++;
+    if (e < -120)
+      e = -120;
+    u.i = (uint32_t)(127 - e) << 23;
+    scale = u.f;
+    out[n++] = (uint8_t)(int8_t)e;
+    for (j = 0; j < m * 2; j++) {
+      x = v[i + j/2][j & 1] * scale;
+      if (x != x)  // NaN
+        q = 0;
+      else if (x >= 32767.0f)
+        q = 32767;
+      else if (x <= -32767.0f)
+        q = -32767;
+      else
+        q = (int32_t)(x < 0 ? x - 0.5f : x + 0.5f);
+      out[n++] = (uint8_t)q;
+      out[n++] = (uint8_t)(q >> 8);
+    }
+  }
+  return n;
+}
+
+/* 发送一个数组，pack 时先压缩 */
+static void bindata_array(int array, const void *data, int format, int points, int pack)
+{
+  uint8_t *buf = (uint8_t *)FreeRTOS_CLIGetOutputBuffer();
+
+  if (!pack) {
+    bindata_send(array, data, format, points, points * (format == BIN_FMT_U32 ? 4 : 8));
+  } else if (format == BIN_FMT_U32) {
+    bindata_send(array, buf, BIN_FMT_U32DD, points, bin_pack_u32(buf, data, points));
+  } else {
+    bindata_send(array, buf, BIN_FMT_I16X2, points, bin_pack_f32x2(buf, data, points));
+  }
+}
+
+static void cmd_bindata(BaseSequentialStream *chp, int argc, char *argv[])
+{
+  int i, n, sel;
+  int pack = FALSE;
+
+  for (n = 0; n < argc; n++) {  // 先检查全部参数
+    if (argv[n][1] != '\0' || !strchr("zf012345678", argv[n][0]))
+      break;
+  }
+  if (argc == 0 || n < argc) {
+    chprintf(chp, "usage: bindata [z] f|0-8 ...\r\n");
+    return;
+  }
+
+  chMtxLock(&mutex);
+  if (!cmd_batch)  // 批处理时整批已经暂缓
+    CDC_TxHold_FS(1);
+  for (n = 0; n < argc; n++) {
+    if (argv[n][0] == 'z') {  // 后面的数组压缩发送
+      pack = TRUE;
+      continue;
+    }
+    if (argv[n][0] == 'f') {
+      bindata_array('f', frequencies, BIN_FMT_U32, sweep_points, pack);
+      continue;
+    }
+    sel = argv[n][0] - '0';
+    if (sel == 0 || sel == 1) {
+      bindata_array(sel, measured[sel], BIN_FMT_F32X2, sweep_points, pack);
+    } else if (sel >= 2 && sel < 7) {
+      bindata_array(sel, cal_data[sel-2], BIN_FMT_F32X2, sweep_points, pack);
+    } else if (sel == 7 || sel == 8) {  // 数据记忆是压缩存放的，先展开
+      uint8_t *buf = (uint8_t *)FreeRTOS_CLIGetOutputBuffer() + BIN_UNPACK_AREA;
+      float v[2];
+      for (i = 0; i < sweep_points; i++) {
+        if (!trace_memory_get(sel-7, i, v))
+          break;
+        memcpy(buf + i * sizeof v, v, sizeof v);
+      }
+      bindata_array(sel, buf, BIN_FMT_F32X2, i, pack);
+    }
+  }
+  if (!cmd_batch)
+    CDC_TxHold_FS(0);
+  chMtxUnlock(&mutex);
+}
+static const CLI_Command_Definition_t x_cmd_bindata = {
+"bindata", "usage: bindata [z] f|0-8 ...\r\n", (shellcmd_t)cmd_bindata, -1};
+
+/*
+=======================================
+    命令：推送扫描数据
+    stream on|off
+    打开后每测完一个点推送一条 32 字节记录 (stream_rec_t)。
+    USB 发送缓冲区放不下时丢弃这条记录，下一条带 STREAM_DROPPED，
+    扫描不会被 USB 拖慢。
+    命令执行期间发送缓冲区归命令所有 (CDC_TxLock_FS)，这时的记录同样丢弃，
+    所以记录只出现在两条命令的输出之间，或者 wait 结果行的前面
+=======================================
+*/
+static uint8_t stream_enabled = FALSE;
+static uint8_t stream_dropped = FALSE;
+static uint32_t stream_drops = 0;
+
+static void stream_point(int i)
+{
+  stream_rec_t r;
+
+  r.magic = STREAM_MAGIC;
+  r.flags = 0;
+  if (i == 0)
+    r.flags |= STREAM_FIRST;
+  if (i == sweep_points - 1)
+    r.flags |= STREAM_LAST;
+  if (stream_dropped)
+    r.flags |= STREAM_DROPPED;
+  if (cal_status & CALSTAT_APPLY)
+    r.flags |= STREAM_CAL;
+  r.reserved = 0;
+  r.index = i;
+  r.seq = (uint16_t)(sweep_count + 1);  // 本次扫描完成后的 sweep_count
+  r.freq = frequencies[i];
+  memcpy(r.s11, measured[0][i], sizeof r.s11);
+  memcpy(r.s21, measured[1][i], sizeof r.s21);
+  r.crc = crc32(0, &r, offsetof(stream_rec_t, crc));
+
+  if (CDC_TryTransmit_FS((uint8_t *)&r, sizeof r) == USBD_OK) {
+    stream_dropped = FALSE;
+  } else {
+    stream_dropped = TRUE;
+    stream_drops++;
+  }
+}
+
+static void cmd_stream(BaseSequentialStream *chp, int argc, char *argv[])
+{
+  if (argc == 0) {
+    chprintf(chp, "%s dropped %u\r\n", stream_enabled ? "on" : "off", (unsigned)stream_drops);
+    return;
+  }
+  if (strcmp(argv[0], "on") == 0) {
+    stream_dropped = FALSE;
+    stream_drops = 0;
+    stream_enabled = TRUE;
+  } else if (strcmp(argv[0], "off") == 0) {
+    stream_enabled = FALSE;
+  } else {
+    chprintf(chp, "usage: stream [on|off]\r\n");
+  }
+}
+static const CLI_Command_Definition_t x_cmd_stream = {
+"stream", "usage: stream [on|off]\r\n", (shellcmd_t)cmd_stream, -1};
+
+/*
+=======================================
+    命令：等待扫描完成
+    wait [n] [timeout(ms)]
+    等到从现在起第 n 次 (默认 1) 扫描完成，打印 sweep_count。
+    正在进行的扫描也算一次，要保证整次扫描都在命令之后开始用 n = 2。
+    超时打印 "timeout"，扫描暂停时直接打印 "paused"。
+    批处理里等待期间暂时让出测量锁，扫描照常进行；
+    等待期间也放开 USB 发送，推送的记录和事件照常发出
+=======================================
+*/
+#define WAIT_TIMEOUT  5000  // ms
+
+static SemaphoreHandle_t sweep_done = NULL;  // 每次扫描完成时给出
+
+static void cmd_wait(BaseSequentialStream *chp, int argc, char *argv[])
+{
+  uint32_t target;
+  TickType_t start, elapsed, timeout = pdMS_TO_TICKS(WAIT_TIMEOUT);
+  int n = 1;
+
+  if (argc > 2) {
+    chprintf(chp, "usage: wait [n] [timeout(ms)]\r\n");
+    return;
+  }
+  if (argc >= 1)
+    n = atoi(argv[0]);
+  if (argc >= 2)
+    timeout = pdMS_TO_TICKS(atoi(argv[1]));
+  if (n < 1)
+    n = 1;
+  if (!sweep_enabled) {
+    chprintf(chp, "paused\r\n");
+    return;
+  }
+
+  if (cmd_batch)
+    chMtxUnlock(&mutex);
+  CDC_TxLock_FS(0);  // 还没有输出，推送的数据可以先发
+  target = sweep_count + n;
+  xSemaphoreTake(sweep_done, 0);  // 清掉以前的信号，下面以 sweep_count 为准
+  start = xTaskGetTickCount();
+  while ((int32_t)(sweep_count - target) < 0) {
+    elapsed = xTaskGetTickCount() - start;
+    if (elapsed >= timeout || xSemaphoreTake(sweep_done, timeout - elapsed) != pdTRUE)
+      break;
+  }
+  CDC_TxLock_FS(1);
+  if (cmd_batch)
+    chMtxLock(&mutex);
+
+  if ((int32_t)(sweep_count - target) < 0) {
+    chprintf(chp, "timeout\r\n");
+  } else {
+    chprintf(chp, "%u\r\n", (unsigned)sweep_count);
+  }
+}
+static const CLI_Command_Definition_t x_cmd_wait = {
+"wait", "usage: wait [n] [timeout(ms)]\r\n", (shellcmd_t)cmd_wait, -1};
+
+/*
+=======================================
+    命令：扫描完成事件
+    event on|off
+    打开后每次扫描完成主动发一行 "!sweep <sweep_count>"，
+    以 '!' 开头和命令输出区分。正在输出命令结果时先不发，
+    之后在 app_loop 里补发最新的一次。
+    只在持有测量锁时发送，命令执行期间发送缓冲区又归命令所有
+    (CDC_TxLock_FS)，所以事件行不会落在 bindata 的帧头和数据之间
+=======================================
+*/
+static uint8_t event_enabled = FALSE;
+static uint32_t event_seq = 0;  // 待发送的扫描序号，0 表示没有
+
+static void event_flush(void)
+{
+  char line[24];
+  int n;
+
+  if (!event_enabled || event_seq == 0)
+    return;
+  n = fmt_str(line, sizeof line, "!sweep ");
+  n += fmt_uint(line+n, sizeof line - n, event_seq, 1);
+  n += fmt_str(line+n, sizeof line - n, "\r\n");
+  if (CDC_TryTransmit_FS((uint8_t *)line, n) != USBD_BUSY)  // 没有连接也丢掉
+    event_seq = 0;
+}
+
+/* app_loop 里补发，和扫描完成时一样在测量锁内 */
+static void event_retry(void)
+{
+  if (event_seq == 0)
+    return;
+  chMtxLock(&mutex);
+  event_flush();
+  chMtxUnlock(&mutex);
+}
+
+static void cmd_event(BaseSequentialStream *chp, int argc, char *argv[])
+{
+  if (argc == 0) {
+    chprintf(chp, "%s\r\n", event_enabled ? "on" : "off");
+    return;
+  }
+  if (strcmp(argv[0], "on") == 0) {
+    event_seq = 0;
+    event_enabled = TRUE;
+  } else if (strcmp(argv[0], "off") == 0) {
+    event_enabled = FALSE;
+  } else {
+    chprintf(chp, "usage: event [on|off]\r\n");
+  }
+}
+static const CLI_Command_Definition_t x_cmd_event = {
+"event", "usage: event [on|off]\r\n", (shellcmd_t)cmd_event, -1};
+
+/*
+=======================================
+    命令：通信统计
+    link [reset]
+    从上次 reset 起的 USB 收发量、扫描速度和命令执行时间的百分位数。
+    只是设备一侧的计数，端到端的延迟和吞吐量在主机上测，见 tools/vnabench.c
+=======================================
+*/
+static TickType_t link_tick0;
+static uint32_t link_sweeps0;
+
+/*
+ * 命令执行时间的 pct 百分位数，返回所在档的上限 (us)，不超过最长的一次；
+ * 第 0 档 (不到 1 us) 为 0
+ */
+static uint32_t cmd_time_percentile(uint32_t total, int pct)
+{
+  uint32_t want = (total * pct + 99) / 100, sum = 0;
+  int b;
+
+  for (b = 0; b < CMD_TIME_BINS - 1; b++) {
+    sum += cmd_time_hist[b];
+    if (sum >= want)
+      break;
+  }
+  if (b == 0)
+    return 0;
+  return (1UL << b) < cmd_time_max ? 1UL << b : cmd_time_max;
+}
+
+static void cmd_link(BaseSequentialStream *chp, int argc, char *argv[])
+{
+  uint32_t ms, total = 0, rate;
+  int b;
+
+  if (argc == 1 && strcmp(argv[0], "reset") == 0) {
+    memset(&cdc_stats, 0, sizeof cdc_stats);
+    memset(cmd_time_hist, 0, sizeof cmd_time_hist);
+    cmd_time_max = 0;
+    link_sweeps0 = sweep_count;
+    link_tick0 = xTaskGetTickCount();
+    return;
+  } else if (argc != 0) {
+    chprintf(chp, "usage: link [reset]\r\n");
+    return;
+  }
+
+  ms = (xTaskGetTickCount() - link_tick0) * portTICK_PERIOD_MS;
+  if (ms == 0)
+    ms = 1;
+  for (b = 0; b < CMD_TIME_BINS; b++)
+    total += cmd_time_hist[b];
+
+  chprintf(chp, "time %u ms\r\n", (unsigned)ms);
+  chprintf(chp, "rx %u packets %u bytes\r\n",
+           (unsigned)cdc_stats.rx_packets, (unsigned)cdc_stats.rx_bytes);
+  rate = (uint32_t)((uint64_t)cdc_stats.tx_bytes * 1000 / ms);
+  chprintf(chp, "tx %u bytes %u transfers %u packets %u bytes/s\r\n",
+           (unsigned)cdc_stats.tx_bytes, (unsigned)cdc_stats.tx_transfers,
+           (unsigned)cdc_stats.tx_packets, (unsigned)rate);
+  rate = (uint32_t)((uint64_t)(sweep_count - link_sweeps0) * 100000 / ms);  // 0.01 次/秒
+  chprintf(chp, "sweeps %u %u.%02u/s\r\n",
+           (unsigned)(sweep_count - link_sweeps0), (unsigned)(rate / 100), (unsigned)(rate % 100));
+  if (total) {
+    chprintf(chp, "commands %u p50 %u p90 %u p99 %u max %u us\r\n", (unsigned)total,
+             (unsigned)cmd_time_percentile(total, 50), (unsigned)cmd_time_percentile(total, 90),
+             (unsigned)cmd_time_percentile(total, 99), (unsigned)cmd_time_max);
+  }
+}
+static const CLI_Command_Definition_t x_cmd_link = {
+"link", "usage: link [reset]\r\n", (shellcmd_t)cmd_link, -1};
+
 #ifdef ENABLED_DUMP
 static void cmd_dump(BaseSequentialStream *chp, int argc, char *argv[])
 {
@@ -574,7 +1135,7 @@ static void cmd_gamma(BaseSequentialStream *chp, int argc, char *argv[])
   calculate_gamma(gamma);
   chMtxUnlock(&mutex);
 
-  chprintf(chp, "%f %f\r\n", gamma[0], gamma[1]);
+  print_complex(chp, gamma);
 }
 static const CLI_Command_Definition_t x_cmd_gamma = {
 "gamma", "usage: gamma\r\n", (shellcmd_t)cmd_gamma, -1};
@@ -644,87 +1205,279 @@ void ensure_edit_config(void)
   cal_status = 0;
 }
 
-#if 0
+/*
+=======================================
+    按频率设置 codec 增益，谐波段信号弱，增益加大
+=======================================
+*/
+static void set_gain_by_frequency(uint32_t freq)
+{
+  if (freq > BASE_MAX*3) {
+    tlv320aic3204_set_gain(68, 75);
+  } else if (freq > BASE_MAX*2) {
+    tlv320aic3204_set_gain(48, 55);
+  } else if (freq > BASE_MAX) {
+    tlv320aic3204_set_gain(40, 47);
+  } else {
+    tlv320aic3204_set_gain(0, 10);
+  }
+}
+
+/*
+ * 当前校准数据在频率 f 处的线性插值，f 超出范围时取两端的值
+ * j 为上一次找到的区间，频率递增调用时总共只扫一遍
+ */
+static void cal_lookup(uint32_t f, int *j, float e[5][2])
+{
+  int eterm, k = *j;
+  float k0 = 1, k1 = 0;
+
+  if (sweep_points < 2 || f <= frequencies[0]) {
+    k = 0;
+  } else if (f >= frequencies[sweep_points-1]) {
+    k = sweep_points - 2;
+    k0 = 0;
+    k1 = 1;
+  } else {
+    if (k > sweep_points - 2 || frequencies[k] > f)
+      k = 0;
+    while (frequencies[k+1] <= f)
+      k++;
+    k1 = (float)(f - frequencies[k]) / (frequencies[k+1] - frequencies[k]);
+    k0 = 1.0f - k1;
+  }
+  for (eterm = 0; eterm < 5; eterm++) {
+    if (k1 == 0) {
+      e[eterm][0] = cal_data[eterm][k][0];
+      e[eterm][1] = cal_data[eterm][k][1];
+    } else {
+      e[eterm][0] = cal_data[eterm][k][0] * k0 + cal_data[eterm][k+1][0] * k1;
+      e[eterm][1] = cal_data[eterm][k][1] * k0 + cal_data[eterm][k+1][1] * k1;
+    }
+  }
+  *j = k;
+}
+
+/*
+ * 测量一个频率点的 S11、S21，不写 measured
+ */
+static void scan_point(uint32_t freq, int cal, int *j, float s[2][2])
+{
+  float e[5][2];
+
+  set_frequency(freq);
+  set_gain_by_frequency(freq);
+  tlv320aic3204_select_in3(); // S11:REFLECT
+  wait_dsp(4);
+  calculate_gamma(s[0]);
+  tlv320aic3204_select_in1(); // S21:TRANSMISSION
+  wait_dsp(5);
+  calculate_gamma(s[1]);
+  if (cal) {
+    cal_lookup(freq, j, e);
+    apply_error_term_to(s, e);
+  }
+}
+
+/*
+=======================================
+    命令：单次扫描
+    scan start stop points [mask]
+    不改动当前的扫频设置和显示，用当前校准数据插值后校准
+    mask: 1 频率  2 S11  4 S21  8 不校准  0x80 二进制，默认 7
+    文本每点一行 "freq s11re s11im s21re s21im"（按 mask 取列），
+    二进制输出与 bindata 相同的帧：'f'、0 (S11)、1 (S21)
+=======================================
+*/
+#define SCAN_FREQ    0x01
+#define SCAN_S11     0x02
+#define SCAN_S21     0x04
+#define SCAN_NOCAL   0x08
+#define SCAN_BINARY  0x80
+
 static void cmd_scan(BaseSequentialStream *chp, int argc, char *argv[])
 {
-  float gamma[2];
-  int i;
-  int32_t freq, step;
-  int delay;
-  (void)argc;
-  (void)argv;
+  uint32_t start, stop, freq;
+  int i, j = 0, n, points, mask = SCAN_FREQ|SCAN_S11|SCAN_S21;
+  int cal;
+  float s[2][2];
+
+  if (argc < 3 || argc > 4) {
+    chprintf(chp, "usage: scan start(Hz) stop(Hz) points [mask]\r\n");
+    return;
+  }
+  start = atoi(argv[0]);
+  stop = atoi(argv[1]);
+  points = atoi(argv[2]);
+  if (argc == 4)
+    mask = strtol(argv[3], NULL, 0);
+  if (start < START_MIN || stop > STOP_MAX || start > stop
+      || points < 1 || points > SWEEP_POINTS) {
+    chprintf(chp, "scan range: %d-%d Hz, 1-%d points\r\n", START_MIN, STOP_MAX, SWEEP_POINTS);
+    return;
+  }
 
-  pause_sweep();
   chMtxLock(&mutex);
-  freq = frequency0;
-  step = (frequency1 - frequency0) / (sweep_points-1);
-  set_frequency(freq);
-  delay = 4;
-  for (i = 0; i < sweep_points; i++) {
-    freq = freq + step;
-    wait_dsp(delay);
-    delay = set_frequency(freq);
-    palClearPad(GPIOC, GPIOC_LED);
-    calculate_gamma(gamma);
-    palSetPad(GPIOC, GPIOC_LED);
-    chprintf(chp, "%d %d\r\n", gamma[0], gamma[1]);
+  cal = (cal_status & CALSTAT_APPLY) && !(mask & SCAN_NOCAL);
+
+  if (mask & SCAN_BINARY) {
+    uint8_t *buf = (uint8_t *)FreeRTOS_CLIGetOutputBuffer();
+    float (*s11)[2] = (float (*)[2])buf;
+    float (*s21)[2] = s11 + points;  // 2 * 8 * SWEEP_POINTS 字节，输出缓冲区放得下
+
+    if (mask & SCAN_FREQ) {
+      uint32_t *f = (uint32_t *)buf;
+      for (i = 0; i < points; i++)
+        f[i] = points > 1 ? start + (uint64_t)(stop - start) * i / (points - 1) : start;
+      bindata_send('f', f, BIN_FMT_U32, points, points * sizeof f[0]);
+    }
+    for (i = 0; i < points; i++) {
+      freq = points > 1 ? start + (uint64_t)(stop - start) * i / (points - 1) : start;
+      scan_point(freq, cal, &j, s);
+      memcpy(s11[i], s[0], sizeof s11[0]);
+      memcpy(s21[i], s[1], sizeof s21[0]);
+    }
+    if (mask & SCAN_S11)
+      bindata_send(0, s11, BIN_FMT_F32X2, points, points * sizeof s11[0]);
+    if (mask & SCAN_S21)
+      bindata_send(1, s21, BIN_FMT_F32X2, points, points * sizeof s21[0]);
+  } else {
+    char line[72];
+    const int room = sizeof line - 2;  // 留出 "\r\n"
+    float v[4];
+    int k, nv;
+
+    for (i = 0; i < points; i++) {
+      freq = points > 1 ? start + (uint64_t)(stop - start) * i / (points - 1) : start;
+      scan_point(freq, cal, &j, s);
+      nv = 0;
+      if (mask & SCAN_S11) {
+        v[nv++] = s[0][0];
+        v[nv++] = s[0][1];
+      }
+      if (mask & SCAN_S21) {
+        v[nv++] = s[1][0];
+        v[nv++] = s[1][1];
+      }
+      // fmt_* 最多写到 room - 1，数值再大 (没有校准时可能很大) 也只截断这一行
+      n = 0;
+      if (mask & SCAN_FREQ)
+        n = fmt_uint(line, room, freq, 1);
+      for (k = 0; k < nv; k++) {
+        if (n > 0)
+          n += fmt_str(line+n, room - n, " ");
+        n += fmt_fixed(line+n, room - n, v[k], 6);
+      }
+      line[n++] = '\r';
+      line[n++] = '\n';
+      CDC_Transmit_FS((uint8_t *)line, n);
+    }
   }
   chMtxUnlock(&mutex);
 }
-#endif
+static const CLI_Command_Definition_t x_cmd_scan = {
+"scan", "usage: scan start stop points [mask]\r\n", (shellcmd_t)cmd_scan, -1};
 
 // main loop for measurement
 void sweep(void)
 {
   int i;
   int delay1, delay2;
+#if USE_FIXED_POINT
+  fix_t gamma_q[2][2];
+#endif
+  float prev[2][2];
+  static uint16_t avg_cal_status;
+  static float avg_edelay;
 
 rewind:
+  if (frequency_updated || avg_cal_status != (cal_status & CALSTAT_APPLY)
+      || avg_edelay != electrical_delay) {
+    avg_cal_status = cal_status & CALSTAT_APPLY;
+    avg_edelay = electrical_delay;
+    avg_sweeps = 0;
+    sweep_next = 0;
+  }
   frequency_updated = FALSE;
   delay1 = 4;
   delay2 = 5;
 
+  if (avg_sweeps == 0)
+    avg_weight = 1;
+  else if (avg_mode == AVG_SWEEP)
+    avg_weight = 1.0f / (avg_sweeps < avg_factor ? avg_sweeps + 1 : avg_factor);
+  else
+    avg_weight = avg_alpha;
+
   LED1_ON;
 
-  for (i = 0; i < sweep_points; i++)  // SWEEP_POINTS
+  for (i = sweep_next; i < sweep_points; i++)  // SWEEP_POINTS
   {
     set_frequency(frequencies[i]);
-    if (frequencies[i] > BASE_MAX*3) {
-      tlv320aic3204_set_gain(68, 75);
-    } else if (frequencies[i] > BASE_MAX*2) {
-      tlv320aic3204_set_gain(48, 55);
-    } else if (frequencies[i] > BASE_MAX) {
-      tlv320aic3204_set_gain(40, 47);
-    } else {
-      tlv320aic3204_set_gain(0, 10);
+    set_gain_by_frequency(frequencies[i]);
+
+    if (avg_weight < 1) {  // 保存上次的平均值
+      memcpy(prev[0], measured[0][i], sizeof prev[0]);
+      memcpy(prev[1], measured[1][i], sizeof prev[1]);
     }
 
     tlv320aic3204_select_in3(); // S11:REFLECT
     wait_dsp(delay1);  // 扔掉两块数据
 
     /* calculate reflection coeficient 计算反射系数 */
+#if USE_FIXED_POINT
+    calculate_gamma_fix(gamma_q[0]);
+#else
     calculate_gamma(measured[0][i]);
+#endif
     // dbprintf("%5d %5d\r\n", acc_samp_s, acc_samp_c);
 
     tlv320aic3204_select_in1(); // S21:TRANSMISSION
     wait_dsp(delay2);  // 扔掉两块数据
 
     /* calculate transmission coeficient 计算传输系数 */
+#if USE_FIXED_POINT
+    calculate_gamma_fix(gamma_q[1]);
+
+    // 应用校准数据
+    if (cal_status & CALSTAT_APPLY)
+      apply_error_term_fix(i, gamma_q);
+
+    // measured 仍然是浮点，CLI 输出和校准采集都用它
+    measured[0][i][0] = fix_to_float(gamma_q[0][0]);
+    measured[0][i][1] = fix_to_float(gamma_q[0][1]);
+    measured[1][i][0] = fix_to_float(gamma_q[1][0]);
+    measured[1][i][1] = fix_to_float(gamma_q[1][1]);
+#else
     calculate_gamma(measured[1][i]);
 
     // 应用校准数据
     if (cal_status & CALSTAT_APPLY)
       apply_error_term_at(i);  // 校准 error term 误差项 ED ES ER ET EX
+#endif
 
     if (electrical_delay != 0)
       apply_edelay_at(i);  // 校准电延时
 
+    if (avg_weight < 1)
+      sweep_average_at(i, prev);
+
+    if (stream_enabled)
+      stream_point(i);
+
+    // 慢速扫描中途也刷新显示
+    if (plot_frame_due(TRUE))
+      plot_frame();
+
     redraw_requested = FALSE;
     // request_to_draw_cells_behind_menu
     // request_to_draw_cells_behind_numeric_input
     ui_process();
-    if (redraw_requested)  // 重画（redraw）
-      return; // return to redraw screen asap. 尽快重新绘制屏幕
+    if (redraw_requested) {  // 重画（redraw）
+      // 尽快重新绘制屏幕，下次从下一点继续，前面的点已经平均过，不能再平均一次
+      sweep_next = i + 1;
+      return;
+    }
 
     if (frequency_updated)  // 修改了扫频参数，重新开始扫频
       goto rewind;
@@ -744,11 +1497,30 @@ rewind:
   } */
 
   LED1_OFF;
+  sweep_next = 0;
+
+  if (avg_mode != AVG_OFF && avg_sweeps < 0xffff)
+    avg_sweeps++;
+  sweep_count++;
+
+  xSemaphoreGive(sweep_done);  // 唤醒 wait 命令
+  if (event_enabled) {
+    event_seq = sweep_count;
+    event_flush();
+  }
 
   // if (cal_status & CALSTAT_APPLY)
       // apply_error_term();
 }
 
+static void sweep_average_at(int i, float prev[2][2])
+{
+  int n, k;
+  for (n = 0; n < 2; n++)
+    for (k = 0; k < 2; k++)
+      measured[n][i][k] = prev[n][k] + (measured[n][i][k] - prev[n][k]) * avg_weight;
+}
+
 /*
 =======================================
     更新 Mark 点位置
@@ -1243,6 +2015,98 @@ static void cmd_task(BaseSequentialStream *chp, int argc, char *argv[])
 static const CLI_Command_Definition_t x_cmd_task = {
 "task", "usage: task\r\n", (shellcmd_t)cmd_task, -1};
 
+/*
+=======================================
+    命令：绘图统计
+    render                  上一帧的绘制统计
+    render test [0|1]       暂停扫描，载入固定的测试数据后全屏重绘，
+                            输出这一帧的统计。
+                            0: 串联谐振 S11 和带通 S21，1: 传输线
+    测试完恢复原来的测量数据和扫描状态。
+    同样的数据在主机上画出的图保存在 test/host，见 test_render.c
+=======================================
+*/
+static void render_test_data(int set)
+{
+  uint32_t fc = frequencies[sweep_points / 2];
+  uint32_t fmax = frequencies[sweep_points - 1];
+  int i;
+
+  for (i = 0; i < sweep_points; i++) {
+    float f = (float)frequencies[i];
+    if (set == 0) {
+      // z = 0.5 + jx, x = Q (f/fc - fc/f), Q = 20
+      float x = 20.0f * (f / fc - fc / f);
+      float d = 2.25f + x * x;  // |z+1|^2
+      measured[0][i][0] = (x * x - 0.75f) / d;  // (z-1)/(z+1)
+      measured[0][i][1] = 2.0f * x / d;
+      measured[1][i][0] = 1.0f / (1.0f + x * x);  // 1/(1+jx)
+      measured[1][i][1] = -x / (1.0f + x * x);
+    } else {
+      // 3 圈相移的传输线，S11 相移加倍
+      float ph = -2 * (float)M_PI * 3.0f * f / fmax;
+      measured[0][i][0] = 0.7f * cosf(2 * ph);
+      measured[0][i][1] = 0.7f * sinf(2 * ph);
+      measured[1][i][0] = 0.9f * cosf(ph);
+      measured[1][i][1] = 0.9f * sinf(ph);
+    }
+  }
+}
+
+// 测试期间 measured 暂存在命令输出缓存里，输出之前恢复
+typedef char render_save_fits[sizeof measured <= config_MAX_OUTPUT_SIZE ? 1 : -1];
+
+static void cmd_render(BaseSequentialStream *chp, int argc, char *argv[])
+{
+  render_stats_t st = render_stats;
+  int8_t was_enabled;
+  int set = 0, timeout;
+  int i;
+
+  if (argc > 0) {
+    if (strcmp(argv[0], "test") != 0 || argc > 2)
+      goto usage;
+    if (argc > 1)
+      set = atoi(argv[1]);
+    if (set < 0 || set > 1)
+      goto usage;
+
+    was_enabled = sweep_enabled;
+    pause_sweep();
+    chMtxLock(&mutex);  // 等待正在进行的扫描结束
+    memcpy(FreeRTOS_CLIGetOutputBuffer(), measured, sizeof measured);
+    render_test_data(set);
+    chMtxUnlock(&mutex);
+
+    force_set_markmap();
+    // 正在画的一帧可能只画了一部分，第二帧才是完整的全屏重绘
+    render_test_frames = 2;
+    for (i = 0; i < 200 && render_test_frames; i++)
+      osDelay(10);
+    timeout = render_test_frames != 0;
+    render_test_frames = 0;
+    st = render_test_stats;
+
+    chMtxLock(&mutex);
+    memcpy(measured, FreeRTOS_CLIGetOutputBuffer(), sizeof measured);
+    chMtxUnlock(&mutex);
+    force_set_markmap();
+    if (was_enabled)
+      resume_sweep();
+    if (timeout) {
+      chprintf(chp, "timeout\r\n");
+      return;
+    }
+  }
+  chprintf(chp, "frame %u cells %u windows %u pixels %u time %u us\r\n",
+           st.frame, st.cells, st.windows, st.pixels, st.time_us);
+  return;
+usage:
+  chprintf(chp, "usage: render [test [0|1]]\r\n");
+}
+static const CLI_Command_Definition_t x_cmd_render = {
+"render", "usage: render [test [0|1]]\r\n", (shellcmd_t)cmd_render, -1};
+
 static void eterm_set(int term, float re, float im)
 {
   int i;
@@ -1406,35 +2270,97 @@ void apply_error_term(void)
   }
 }
 
-void apply_error_term_at(int i)
+/*
+ * s[0] = S11, s[1] = S21，e 为 5 个误差项 (ETERM_ED ... ETERM_EX)
+ */
+void apply_error_term_to(float s[2][2], float e[5][2])
 {
   // S11m' = S11m - Ed
   // S11a = S11m' / (Er + Es S11m')
-  float s11mr = measured[0][i][0] - cal_data[ETERM_ED][i][0];
-  float s11mi = measured[0][i][1] - cal_data[ETERM_ED][i][1];
-  float err = cal_data[ETERM_ER][i][0] + s11mr * cal_data[ETERM_ES][i][0] - s11mi * cal_data[ETERM_ES][i][1];
-  float eri = cal_data[ETERM_ER][i][1] + s11mr * cal_data[ETERM_ES][i][1] + s11mi * cal_data[ETERM_ES][i][0];
+  float s11mr = s[0][0] - e[ETERM_ED][0];
+  float s11mi = s[0][1] - e[ETERM_ED][1];
+  float err = e[ETERM_ER][0] + s11mr * e[ETERM_ES][0] - s11mi * e[ETERM_ES][1];
+  float eri = e[ETERM_ER][1] + s11mr * e[ETERM_ES][1] + s11mi * e[ETERM_ES][0];
   float sq = err*err + eri*eri;
   float s11ar = (s11mr * err + s11mi * eri) / sq;
   float s11ai = (s11mi * err - s11mr * eri) / sq;
-  measured[0][i][0] = s11ar; // real 校准反射系数
-  measured[0][i][1] = s11ai; // imag
+  s[0][0] = s11ar; // real 校准反射系数
+  s[0][1] = s11ai; // imag
 
   // CAUTION: Et is inversed for efficiency
   // S21m' = S21m - Ex
   // S21a = S21m' (1-EsS11a)Et
-  float s21mr = measured[1][i][0] - cal_data[ETERM_EX][i][0];
-  float s21mi = measured[1][i][1] - cal_data[ETERM_EX][i][1];
-  float esr = 1 - (cal_data[ETERM_ES][i][0] * s11ar - cal_data[ETERM_ES][i][1] * s11ai);
-  float esi = - (cal_data[ETERM_ES][i][1] * s11ar + cal_data[ETERM_ES][i][0] * s11ai);
-  float etr = esr * cal_data[ETERM_ET][i][0] - esi * cal_data[ETERM_ET][i][1];
-  float eti = esr * cal_data[ETERM_ET][i][1] + esi * cal_data[ETERM_ET][i][0];
-  float s21ar = s21mr * etr - s21mi * eti;
-  float s21ai = s21mi * etr + s21mr * eti;
-  measured[1][i][0] = s21ar; // real 校准传输系数
-  measured[1][i][1] = s21ai; // imag
+  float s21mr = s[1][0] - e[ETERM_EX][0];
+  float s21mi = s[1][1] - e[ETERM_EX][1];
+  float esr = 1 - (e[ETERM_ES][0] * s11ar - e[ETERM_ES][1] * s11ai);
+  float esi = - (e[ETERM_ES][1] * s11ar + e[ETERM_ES][0] * s11ai);
+  float etr = esr * e[ETERM_ET][0] - esi * e[ETERM_ET][1];
+  float eti = esr * e[ETERM_ET][1] + esi * e[ETERM_ET][0];
+  s[1][0] = s21mr * etr - s21mi * eti; // real 校准传输系数
+  s[1][1] = s21mi * etr + s21mr * eti; // imag
+}
+
+void apply_error_term_at(int i)
+{
+  float s[2][2], e[5][2];
+  int eterm;
+
+  for (eterm = 0; eterm < 5; eterm++) {
+    e[eterm][0] = cal_data[eterm][i][0];
+    e[eterm][1] = cal_data[eterm][i][1];
+  }
+  memcpy(s[0], measured[0][i], sizeof s[0]);
+  memcpy(s[1], measured[1][i], sizeof s[1]);
+  apply_error_term_to(s, e);
+  memcpy(measured[0][i], s[0], sizeof s[0]);
+  memcpy(measured[1][i], s[1], sizeof s[1]);
 }
 
+#if USE_FIXED_POINT
+/*
+ * apply_error_term_at 的定点版本，s 为 Q24 的 S11/S21 测量值
+ * cal_data 仍以浮点保存在 flash，这里逐点转换
+ */
+static void apply_error_term_fix(int i, fix_t s[2][2])
+{
+  fix_t edr = float_to_fix(cal_data[ETERM_ED][i][0]);
+  fix_t edi = float_to_fix(cal_data[ETERM_ED][i][1]);
+  fix_t esr = float_to_fix(cal_data[ETERM_ES][i][0]);
+  fix_t esi = float_to_fix(cal_data[ETERM_ES][i][1]);
+  fix_t ertr = float_to_fix(cal_data[ETERM_ER][i][0]);
+  fix_t erti = float_to_fix(cal_data[ETERM_ER][i][1]);
+  fix_t etr = float_to_fix(cal_data[ETERM_ET][i][0]);
+  fix_t eti = float_to_fix(cal_data[ETERM_ET][i][1]);
+  fix_t exr = float_to_fix(cal_data[ETERM_EX][i][0]);
+  fix_t exi = float_to_fix(cal_data[ETERM_EX][i][1]);
+
+  // S11m' = S11m - Ed
+  // S11a = S11m' / (Er + Es S11m')
+  fix_t s11mr = s[0][0] - edr;
+  fix_t s11mi = s[0][1] - edi;
+  fix_t err = ertr + fix_mul(s11mr, esr) - fix_mul(s11mi, esi);
+  fix_t eri = erti + fix_mul(s11mr, esi) + fix_mul(s11mi, esr);
+  // 复数除法分子分母都保留 Q48 精度，各项先除 2 防止相加溢出
+  int64_t sq = ((int64_t)err * err >> 1) + ((int64_t)eri * eri >> 1);
+  fix_t s11ar = fix_div64(((int64_t)s11mr * err >> 1) + ((int64_t)s11mi * eri >> 1), sq);
+  fix_t s11ai = fix_div64(((int64_t)s11mi * err >> 1) - ((int64_t)s11mr * eri >> 1), sq);
+  s[0][0] = s11ar;
+  s[0][1] = s11ai;
+
+  // CAUTION: Et is inversed for efficiency
+  // S21m' = S21m - Ex
+  // S21a = S21m' (1-EsS11a)Et
+  fix_t s21mr = s[1][0] - exr;
+  fix_t s21mi = s[1][1] - exi;
+  fix_t e1r = FIX_ONE - (fix_mul(esr, s11ar) - fix_mul(esi, s11ai));
+  fix_t e1i = - (fix_mul(esi, s11ar) + fix_mul(esr, s11ai));
+  fix_t e2r = fix_mul(e1r, etr) - fix_mul(e1i, eti);
+  fix_t e2i = fix_mul(e1r, eti) + fix_mul(e1i, etr);
+  s[1][0] = fix_mul(s21mr, e2r) - fix_mul(s21mi, e2i);
+  s[1][1] = fix_mul(s21mi, e2r) + fix_mul(s21mr, e2i);
+}
+#endif
+
 void apply_edelay_at(int i)
 {
   float w = 2 * M_PI * electrical_delay * frequencies[i] * 1E-12;
@@ -1456,10 +2382,35 @@ void apply_edelay_at(int i)
     measured 拷贝到 cal_data
 =======================================
 */
+/*
+ * 不做平均的一次完整扫描，结果写入 measured，不处理界面
+ * 开了平均时 cal_collect 用它，平均值里还有接标准件之前的数据
+ */
+static void sweep_unaveraged(void)
+{
+  float s[2][2];
+  int i, j = 0;
+
+  for (i = 0; i < sweep_points; i++) {
+    scan_point(frequencies[i], FALSE, &j, s);
+    memcpy(measured[0][i], s[0], sizeof s[0]);
+    memcpy(measured[1][i], s[1], sizeof s[1]);
+    if (cal_status & CALSTAT_APPLY)
+      apply_error_term_at(i);
+    if (electrical_delay != 0)
+      apply_edelay_at(i);
+  }
+  // 平均从这次扫描重新开始
+  avg_sweeps = 1;
+  sweep_next = 0;
+}
+
 void cal_collect(int type)
 {
   ensure_edit_config();
   chMtxLock(&mutex);
+  if (avg_mode != AVG_OFF)
+    sweep_unaveraged();
 
   switch (type) {
   case CAL_LOAD:  // 采集反射信号 Ed = S11ml; 直接采集 CAL_LOAD=ETERM_ED=0
@@ -1639,11 +2590,11 @@ static void cmd_cal(BaseSequentialStream *chp, int argc, char *argv[])
     draw_cal_status();
     return;
   } else if (strcmp(cmd, "data") == 0) {
-    chprintf(chp, "%f %f\r\n", cal_data[CAL_LOAD][0][0], cal_data[CAL_LOAD][0][1]);
-    chprintf(chp, "%f %f\r\n", cal_data[CAL_OPEN][0][0], cal_data[CAL_OPEN][0][1]);
-    chprintf(chp, "%f %f\r\n", cal_data[CAL_SHORT][0][0], cal_data[CAL_SHORT][0][1]);
-    chprintf(chp, "%f %f\r\n", cal_data[CAL_THRU][0][0], cal_data[CAL_THRU][0][1]);
-    chprintf(chp, "%f %f\r\n", cal_data[CAL_ISOLN][0][0], cal_data[CAL_ISOLN][0][1]);
+    print_complex(chp, cal_data[CAL_LOAD][0]);
+    print_complex(chp, cal_data[CAL_OPEN][0]);
+    print_complex(chp, cal_data[CAL_SHORT][0]);
+    print_complex(chp, cal_data[CAL_THRU][0]);
+    print_complex(chp, cal_data[CAL_ISOLN][0]);
     return;
   } else if (strcmp(cmd, "in") == 0) {
     int s = 0;
@@ -1800,6 +2751,17 @@ float get_trace_refpos(int t)
   return trace[t].refpos;
 }
 
+/* 群时延孔径，左右各取 n 个点 */
+void set_groupdelay_aperture(int n)
+{
+  if (n < 1) n = 1;
+  if (n > SWEEP_POINTS/4) n = SWEEP_POINTS/4;
+  if (groupdelay_aperture != n) {
+    groupdelay_aperture = n;
+    force_set_markmap();
+  }
+}
+
 double my_atof(const char *p)
 {
   int neg = FALSE;
@@ -1844,9 +2806,10 @@ static void cmd_trace(BaseSequentialStream *chp, int argc, char *argv[])
         if (trace[t].enabled) {
           const char *type = trc_type_name[trace[t].type];
           const char *channel = trc_channel_name[trace[t].channel];
-          float scale = trace[t].scale;
-          float refpos = trace[t].refpos;
-          chprintf(chp, "%d %s %s %f %f\r\n", t, type, channel, scale, refpos);
+          char scale[16], refpos[16];
+          fmt_fixed(scale, sizeof scale, trace[t].scale, 6);
+          fmt_fixed(refpos, sizeof refpos, trace[t].refpos, 6);
+          chprintf(chp, "%d %s %s %s %s\r\n", t, type, channel, scale, refpos);
         }
       }
       return;
@@ -1861,6 +2824,15 @@ static void cmd_trace(BaseSequentialStream *chp, int argc, char *argv[])
       goto exit;
     }
 
+    if (strcmp(argv[0], "aperture") == 0) {
+      if (argc > 1) {
+        set_groupdelay_aperture(atoi(argv[1]));
+      } else {
+        chprintf(chp, "%d\r\n", groupdelay_aperture);
+      }
+      goto exit;
+    }
+
     t = atoi(argv[0]);
     if (t < 0 || t >= 4)
       goto usage;
@@ -1907,6 +2879,7 @@ exit:
     return;
 usage:
     chprintf(chp, "trace {0|1|2|3|all} [logmag|phase|smith|linear|delay|swr|off] [src]\r\n");
+    chprintf(chp, "trace aperture [points]\r\n");
 }
 static const CLI_Command_Definition_t x_cmd_trace = {
 "trace", "usage: trace {id}\r\n", (shellcmd_t)cmd_trace, -1};
@@ -1927,7 +2900,9 @@ float get_electrical_delay(void)
 static void cmd_edelay(BaseSequentialStream *chp, int argc, char *argv[])
 {
   if (argc == 0) {
-    chprintf(chp, "%f\r\n", electrical_delay);
+    char buf[16];
+    fmt_fixed(buf, sizeof buf, electrical_delay, 6);
+    chprintf(chp, "%s\r\n", buf);
     return;
   }
   if (argc > 0) {
@@ -1937,6 +2912,97 @@ static void cmd_edelay(BaseSequentialStream *chp, int argc, char *argv[])
 static const CLI_Command_Definition_t x_cmd_edelay = {
 "edelay", "usage: edelay {id}\r\n", (shellcmd_t)cmd_edelay, -1};
 
+/*
+=======================================
+    命令：曲线存储和运算
+    memory store|clear
+    memory {0|1} off|div|sub  通道 0=S11 1=S21
+=======================================
+*/
+static const char * const trace_math_name[] = { "off", "div", "sub" };
+
+static void cmd_memory(BaseSequentialStream *chp, int argc, char *argv[])
+{
+  int ch, m;
+
+  if (argc == 0) {
+    chprintf(chp, "S11 %s S21 %s\r\n", trace_math_name[trace_math[0]], trace_math_name[trace_math[1]]);
+    return;
+  }
+  if (strcmp(argv[0], "store") == 0) {
+    chMtxLock(&mutex);
+    trace_memory_store();
+    chMtxUnlock(&mutex);
+    return;
+  }
+  if (strcmp(argv[0], "clear") == 0) {
+    trace_memory_clear();
+    return;
+  }
+  if (argc < 2)
+    goto usage;
+  ch = atoi(argv[0]);
+  if (ch != 0 && ch != 1)
+    goto usage;
+  for (m = MATH_OFF; m <= MATH_SUB; m++) {
+    if (strcmp(argv[1], trace_math_name[m]) == 0) {
+      set_trace_math(ch, m);
+      return;
+    }
+  }
+usage:
+  chprintf(chp, "usage: memory [store|clear|{0|1} {off|div|sub}]\r\n");
+}
+static const CLI_Command_Definition_t x_cmd_memory = {
+"memory", "usage: memory [store|clear|{0|1} {off|div|sub}]\r\n", (shellcmd_t)cmd_memory, -1};
+
+/*
+=======================================
+    命令：扫描平均
+    avg off
+    avg sweep {count}  累加平均 count 次
+    avg exp {alpha}    指数平滑，0 < alpha <= 1
+=======================================
+*/
+static void cmd_avg(BaseSequentialStream *chp, int argc, char *argv[])
+{
+  if (argc == 0) {
+    if (avg_mode == AVG_SWEEP) {
+      chprintf(chp, "sweep %d (%d)\r\n", avg_factor, avg_sweeps);
+    } else if (avg_mode == AVG_EXP) {
+      char buf[16];
+      fmt_fixed(buf, sizeof buf, avg_alpha, 6);
+      chprintf(chp, "exp %s\r\n", buf);
+    } else {
+      chprintf(chp, "off\r\n");
+    }
+    return;
+  }
+  if (strcmp(argv[0], "off") == 0) {
+    avg_mode = AVG_OFF;
+  } else if (strcmp(argv[0], "sweep") == 0 && argc > 1) {
+    int n = atoi(argv[1]);
+    if (n < 1 || n > 1000)
+      goto usage;
+    avg_factor = n;
+    avg_mode = n > 1 ? AVG_SWEEP : AVG_OFF;
+  } else if (strcmp(argv[0], "exp") == 0 && argc > 1) {
+    float a = my_atof(argv[1]);
+    if (a <= 0 || a > 1)
+      goto usage;
+    avg_alpha = a;
+    avg_mode = a < 1 ? AVG_EXP : AVG_OFF;
+  } else {
+    goto usage;
+  }
+  avg_sweeps = 0;
+  return;
+usage:
+  chprintf(chp, "usage: avg [off|sweep {count}|exp {alpha}]\r\n");
+}
+static const CLI_Command_Definition_t x_cmd_avg = {
+"avg", "usage: avg [off|sweep {count}|exp {alpha}]\r\n", (shellcmd_t)cmd_avg, -1};
+
 static void cmd_marker(BaseSequentialStream *chp, int argc, char *argv[])
 {
   int t;
@@ -2220,6 +3286,8 @@ void app_init(void)
   */
   mutex = xSemaphoreCreateRecursiveMutex();
   configASSERT( mutex );
+  sweep_done = xSemaphoreCreateBinary();
+  configASSERT( sweep_done );
 
   I2C_InitGPIO();
 
@@ -2303,6 +3371,11 @@ void cmd_register( void )
   FreeRTOS_CLIRegisterCommand( &x_cmd_saveconfig );
   FreeRTOS_CLIRegisterCommand( &x_cmd_clearconfig );
   FreeRTOS_CLIRegisterCommand( &x_cmd_data );
+  FreeRTOS_CLIRegisterCommand( &x_cmd_bindata );
+  FreeRTOS_CLIRegisterCommand( &x_cmd_stream );
+  FreeRTOS_CLIRegisterCommand( &x_cmd_wait );
+  FreeRTOS_CLIRegisterCommand( &x_cmd_event );
+  FreeRTOS_CLIRegisterCommand( &x_cmd_link );
 
 #ifdef ENABLED_DUMP
   FreeRTOS_CLIRegisterCommand( &x_cmd_dump );
@@ -2314,7 +3387,7 @@ void cmd_register( void )
   FreeRTOS_CLIRegisterCommand( &x_cmd_power );
 
   FreeRTOS_CLIRegisterCommand( &x_cmd_gamma );
-  // FreeRTOS_CLIRegisterCommand( &x_cmd_scan );
+  FreeRTOS_CLIRegisterCommand( &x_cmd_scan );
 
   FreeRTOS_CLIRegisterCommand( &x_cmd_sweep );
   FreeRTOS_CLIRegisterCommand( &x_cmd_test );
@@ -2328,6 +3401,8 @@ void cmd_register( void )
   FreeRTOS_CLIRegisterCommand( &x_cmd_trace );
   FreeRTOS_CLIRegisterCommand( &x_cmd_marker );
   FreeRTOS_CLIRegisterCommand( &x_cmd_edelay );
+  FreeRTOS_CLIRegisterCommand( &x_cmd_avg );
+  FreeRTOS_CLIRegisterCommand( &x_cmd_memory );
 
   // FreeRTOS_CLIRegisterCommand( &x_cmd_list );
   // FreeRTOS_CLIRegisterCommand( &x_cmd_fatfs );
@@ -2335,6 +3410,7 @@ void cmd_register( void )
   FreeRTOS_CLIRegisterCommand( &x_cmd_beep );
   FreeRTOS_CLIRegisterCommand( &x_cmd_lcd );
   FreeRTOS_CLIRegisterCommand( &x_cmd_task );
+  FreeRTOS_CLIRegisterCommand( &x_cmd_render );
 }
 
 /*
@@ -116,6 +116,34 @@ calculate_gamma(float gamma[2])  // gamma 就是系数的意思
   gamma[1] =  (ss * rc - sc * rs) / rr;  // 虚部？
 }
 
+#if USE_FIXED_POINT
+/*
+ * calculate_gamma 的定点版本，结果 Q24
+ * 参考信号先右移到 24 位以内，信号同样右移保持比值不变
+ */
+void
+calculate_gamma_fix(fix_t gamma[2])
+{
+  int32_t rs = acc_ref_s;
+  int32_t rc = acc_ref_c;
+  int32_t ss = acc_samp_s;
+  int32_t sc = acc_samp_c;
+  int64_t rr;
+
+  while (rs >= 0x800000 || rs < -0x800000 || rc >= 0x800000 || rc < -0x800000) {
+    rs >>= 1; rc >>= 1;
+    ss >>= 1; sc >>= 1;
+  }
+  rr = (int64_t)rs * rs + (int64_t)rc * rc;
+  if (rr == 0) {  // 没有信号
+    gamma[0] = gamma[1] = 0;
+    return;
+  }
+  gamma[0] = fix_div64((int64_t)sc * rc + (int64_t)ss * rs, rr);
+  gamma[1] = fix_div64((int64_t)ss * rc - (int64_t)sc * rs, rr);
+}
+#endif
+
 void
 reset_dsp_accumerator(void)
 {
@@ -0,0 +1,320 @@
+/*-----------------------------------------------------------------------------/
+ * Module       : fastmath.c
+ * Create       : 2026-10-18
+ * Copyright    : hamelec.taobao.com
+ * Brief        : log10f/atan2f/sqrtf 快速近似，用于曲线绘制
+ STM32F103 没有 FPU，libm 的 log10f/atan2f/sqrtf 都是软件浮点实现，
+ 每个扫描点、每条曲线都要调用，这里用查表和多项式代替。
+ 误差（test/host/test_fastmath.c 与 libm 逐点比较）：
+   fast_log10f  绝对误差 < 5.5e-5       -> LOGMAG 显示误差 < 0.001 dB
+   fast_atan2f  绝对误差 < 1.2e-5 rad   -> PHASE  显示误差 < 0.001 度
+   fast_sqrtf   相对误差 < 5.0e-6       -> LINEAR 误差 < 1e-5，SWR<40 时误差 < 0.005
+ 后半部分是 Q24 定点运算（USE_FIXED_POINT），测量、校准和曲线坐标计算使用。
+/-----------------------------------------------------------------------------*/
+#include <stdint.h>
+#include <math.h>
+#include "stm32f1xx.h"
+#include "system.h"
+#include "nanovna.h"
+
+typedef union {
+  float f;
+  uint32_t i;
+} float_bits_t;
+
+/*
+ * log2(1 + i/32), i = 0..32
+ * 尾数 [1,2) 分 32 段线性插值，最大误差 h^2/8/ln2 = 1.76e-4 (log2)
+ */
+#define LOG2_TBL_BITS   5
+#define LOG2_FRAC_BITS  (23 - LOG2_TBL_BITS)
+
+static const float log2_tbl[(1<<LOG2_TBL_BITS) + 1] = {
+  0.000000000f, 0.044394119f, 0.087462841f, 0.129283017f,
+  0.169925001f, 0.209453366f, 0.247927513f, 0.285402219f,
+  0.321928095f, 0.357552005f, 0.392317423f, 0.426264755f,
+  0.459431619f, 0.491853096f, 0.523561956f, 0.554588852f,
+  0.584962501f, 0.614709844f, 0.643856190f, 0.672425342f,
+  0.700439718f, 0.727920455f, 0.754887502f, 0.781359714f,
+  0.807354922f, 0.832890014f, 0.857980995f, 0.882643049f,
+  0.906890596f, 0.930737338f, 0.954196310f, 0.977279923f,
+  1.000000000f,
+};
+
+#define LOG10_2  0.301029996f
+
+/*
+=======================================
+    log10(x), x > 0
+    x <= 0 或非规格化数返回 -INFINITY
+=======================================
+*/
+float fast_log10f(float x)
+{
+  float_bits_t u;
+  int e;
+  uint32_t m;
+  float frac, l;
+
+  u.f = x;
+  if ((int32_t)u.i <= 0)  // 0、负数
+    return -INFINITY;
+  e = (int)(u.i >> 23) - 127;
+  if (e == -127)  // 非规格化数，测量值不会这么小
+    return -INFINITY;
+
+  m = u.i & 0x007fffff;
+  frac = (float)(m & ((1UL<<LOG2_FRAC_BITS)-1)) * (1.0f / (1UL<<LOG2_FRAC_BITS));
+  m >>= LOG2_FRAC_BITS;
+  l = log2_tbl[m] + (log2_tbl[m+1] - log2_tbl[m]) * frac;
+  return ((float)e + l) * LOG10_2;
+}
+
+/*
+=======================================
+    atan2(y, x)，返回 [-pi, pi]
+    先折叠到第一象限 0..pi/4，再用 9 阶奇多项式
+    (Abramowitz & Stegun 4.4.49) 计算 atan(z), |z| <= 1
+=======================================
+*/
+#define ATAN_C1   0.9998660f
+#define ATAN_C3  -0.3302995f
+#define ATAN_C5   0.1801410f
+#define ATAN_C7  -0.0851330f
+#define ATAN_C9   0.0208351f
+
+float fast_atan2f(float y, float x)
+{
+  float ax = x < 0 ? -x : x;
+  float ay = y < 0 ? -y : y;
+  float z, s, a;
+
+  if (ax == 0 && ay == 0)
+    return 0;
+
+  if (ay <= ax)
+    z = ay / ax;
+  else
+    z = ax / ay;
+  s = z * z;
+  a = z * (ATAN_C1 + s * (ATAN_C3 + s * (ATAN_C5 + s * (ATAN_C7 + s * ATAN_C9))));
+
+  if (ay > ax)
+    a = (float)(M_PI / 2) - a;
+  if (x < 0)
+    a = (float)M_PI - a;
+  if (y < 0)
+    a = -a;
+  return a;
+}
+
+/*
+=======================================
+    sqrt(x)，x <= 0 返回 0
+    x * rsqrt(x)，rsqrt 初值用指数减半的位运算，
+    两次牛顿迭代，相对误差 1.75e-3 -> 4.6e-6
+=======================================
+*/
+float fast_sqrtf(float x)
+{
+  float_bits_t u;
+  float h = 0.5f * x;
+  float r;
+
+  if (x <= 0)
+    return 0;
+
+  u.f = x;
+  u.i = 0x5f3759dfUL - (u.i >> 1);
+  r = u.f;
+  r = r * (1.5f - h * r * r);
+  r = r * (1.5f - h * r * r);
+  return x * r;
+}
+
+#if USE_FIXED_POINT
+/*
+=======================================
+    float -> Q24，直接拆浮点数的指数和尾数，
+    不调用软件浮点库。|f| >= 128 时饱和
+=======================================
+*/
+fix_t float_to_fix(float f)
+{
+  float_bits_t u;
+  int sh;
+  int32_t q;
+
+  u.f = f;
+  sh = (int)((u.i >> 23) & 0xff) - 127 + 1;  // f * 2^24 = m * 2^(e+1)
+  if (sh < -23)  // 包括 0 和非规格化数
+    return 0;
+  if (sh >= 8)
+    q = FIX_MAX;
+  else if (sh >= 0)
+    q = (int32_t)((u.i & 0x007fffff) | 0x00800000) << sh;
+  else
+    q = (int32_t)((u.i & 0x007fffff) | 0x00800000) >> -sh;
+  return (u.i & 0x80000000) ? -q : q;
+}
+
+float fix_to_float(fix_t q)
+{
+  return (float)q * (1.0f / FIX_ONE);
+}
+
+/*
+=======================================
+    num / den，结果 Q24，超出范围时饱和
+    num、den 可以是任意相同 Q 格式的 64 位数，den > 0
+=======================================
+*/
+fix_t fix_div64(int64_t num, int64_t den)
+{
+  int sh = 0;
+
+  if (den <= 0)
+    return num < 0 ? -FIX_MAX : FIX_MAX;
+  while (den >= (1LL << 55)) {
+    num >>= 1;
+    den >>= 1;
+  }
+  if (num >= (den << 7)) return FIX_MAX;
+  if (num <= -(den << 7)) return -FIX_MAX;
+  // |num| < den * 2^7，den 右移到 31 位以内，乘 2^FIX_Q 才不会溢出
+  while (den >= (1LL << 31)) {
+    den >>= 1;
+    sh++;
+  }
+  return (fix_t)(num * (1LL << (FIX_Q - sh)) / den);
+}
+
+/*
+ * log2(1 + i/32) * 65536, i = 0..32
+ */
+static const uint32_t log2_tbl_q16[(1<<LOG2_TBL_BITS) + 1] = {
+      0,  2909,  5732,  8473, 11136, 13727, 16248, 18704,
+  21098, 23433, 25711, 27936, 30109, 32234, 34312, 36346,
+  38336, 40286, 42196, 44068, 45904, 47705, 49472, 51207,
+  52911, 54584, 56229, 57845, 59434, 60997, 62534, 64047,
+  65536,
+};
+
+static int bit_length64(uint64_t x)
+{
+  uint32_t hi = (uint32_t)(x >> 32);
+  if (hi)
+    return 64 - __CLZ(hi);
+  return 32 - __CLZ((uint32_t)x);
+}
+
+/*
+=======================================
+    log2(x / 2^frac)，结果 Q16
+    x = 0 返回 FIX_LOG_ZERO
+    与 fast_log10f 同一张表，误差 < 2e-4
+=======================================
+*/
+int32_t fix_log2(uint64_t x, int frac)
+{
+  int n;
+  uint32_t m, f;
+
+  if (x == 0)
+    return FIX_LOG_ZERO;
+  n = bit_length64(x) - 1;
+  // 取最高位 1 之后的 23 位
+  if (n >= 23)
+    m = (uint32_t)(x >> (n - 23)) & 0x007fffff;
+  else
+    m = ((uint32_t)x << (23 - n)) & 0x007fffff;
+  f = m & ((1UL<<LOG2_FRAC_BITS)-1);
+  m >>= LOG2_FRAC_BITS;
+  return ((n - frac) << 16) + (int32_t)log2_tbl_q16[m]
+       + (int32_t)(((log2_tbl_q16[m+1] - log2_tbl_q16[m]) * f) >> LOG2_FRAC_BITS);
+}
+
+/*
+=======================================
+    sqrt(x)，64 位整数开方，结果为 floor(sqrt(x))，没有误差
+    逐位开方，从 x 最高的偶数位开始；x < 2^32 时全程用 32 位运算
+=======================================
+*/
+uint32_t fix_sqrt64(uint64_t x)
+{
+  uint64_t r, b;
+
+  if (x == 0)
+    return 0;
+  if ((x >> 32) == 0) {
+    uint32_t v = (uint32_t)x, r32 = 0, b32 = 1UL << ((31 - __CLZ(v)) & ~1);
+    while (b32) {
+      if (v >= r32 + b32) {
+        v -= r32 + b32;
+        r32 = (r32 >> 1) + b32;
+      } else {
+        r32 >>= 1;
+      }
+      b32 >>= 2;
+    }
+    return r32;
+  }
+  r = 0;
+  b = (uint64_t)1 << ((bit_length64(x) - 1) & ~1);
+  while (b) {
+    if (x >= r + b) {
+      x -= r + b;
+      r = (r >> 1) + b;
+    } else {
+      r >>= 1;
+    }
+    b >>= 2;
+  }
+  return (uint32_t)r;
+}
+
+/*
+=======================================
+    atan2(y, x)，单位为 1/4 圈（pi/2），结果 Q16，范围 [-2, 2]
+    即 phase() 的定点版本。z 用 32 位硬件除法求，
+    多项式与 fast_atan2f 相同，系数乘 2/pi 后取 Q15
+=======================================
+*/
+#define ATAN_Q15_C1   20858
+#define ATAN_Q15_C3  -6890
+#define ATAN_Q15_C5   3758
+#define ATAN_Q15_C7  -1776
+#define ATAN_Q15_C9   435
+
+int32_t fix_atan2(fix_t y, fix_t x)
+{
+  uint32_t ax = x < 0 ? -(uint32_t)x : (uint32_t)x;
+  uint32_t ay = y < 0 ? -(uint32_t)y : (uint32_t)y;
+  uint32_t mx = ax > ay ? ax : ay;
+  uint32_t mn = ax > ay ? ay : ax;
+  int32_t z, s, a;
+
+  if (mx == 0)
+    return 0;
+  while (mx >= 0x10000) {  // z = mn/mx 用 Q15，防止 mn<<15 溢出
+    mx >>= 1;
+    mn >>= 1;
+  }
+  z = (int32_t)((mn << 15) / mx);
+  s = (z * z) >> 15;
+  a = ATAN_Q15_C9;
+  a = ATAN_Q15_C7 + ((s * a) >> 15);
+  a = ATAN_Q15_C5 + ((s * a) >> 15);
+  a = ATAN_Q15_C3 + ((s * a) >> 15);
+  a = ATAN_Q15_C1 + ((s * a) >> 15);
+  a = (z * a) >> 14;  // Q16
+
+  if (ay > ax)
+    a = (1L << 16) - a;
+  if (x < 0)
+    a = (2L << 16) - a;
+  if (y < 0)
+    a = -a;
+  return a;
+}
+#endif
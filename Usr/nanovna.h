@@ -40,6 +40,8 @@ extern int8_t welcom_8bit[];
 #define LCD_HEIGHT   240
 #endif
 
+#define USE_FIXED_POINT  1  // 测量、校准、曲线坐标用定点运算
+
 #define LANG_EN      0
 #define LANG_CN      1
 
@@ -49,6 +51,42 @@ extern int8_t welcom_8bit[];
 
 #define M_PI        3.14159265358979323846
 
+/*
+ * fastmath.c
+ */
+float fast_log10f(float x);
+float fast_atan2f(float y, float x);
+float fast_sqrtf(float x);
+
+#if USE_FIXED_POINT
+// Q24 定点数，范围 ±128，分辨率 6e-8
+#define FIX_Q          24
+#define FIX_ONE        (1L<<FIX_Q)
+#define FIX_MAX        0x7fffffffL
+#define FIX_LOG_ZERO   (-0x7fffffffL-1)
+typedef int32_t fix_t;
+
+static inline fix_t fix_mul(fix_t a, fix_t b)
+{
+  return (fix_t)(((int64_t)a * b) >> FIX_Q);
+}
+
+fix_t float_to_fix(float f);
+float fix_to_float(fix_t q);
+fix_t fix_div64(int64_t num, int64_t den);
+int32_t fix_log2(uint64_t x, int frac);
+uint32_t fix_sqrt64(uint64_t x);
+int32_t fix_atan2(fix_t y, fix_t x);
+#endif
+
+/*
+ * numfmt.c
+ */
+int fmt_str(char *buf, int len, const char *s);
+int fmt_uint(char *buf, int len, uint32_t v, int width);
+int fmt_fixed(char *buf, int len, float v, int prec);
+
+
 /*
  * main.c
  */
@@ -130,6 +168,9 @@ extern int16_t ref_buf[];
 void dsp_process(int16_t *src, size_t len);
 void reset_dsp_accumerator(void);
 void calculate_gamma(float *gamma);
+#if USE_FIXED_POINT
+void calculate_gamma_fix(fix_t gamma[2]);
+#endif
 
 int si5351_set_frequency_with_offset(int freq, int offset, uint8_t drive_strength);
 int si5351_set_frequency_with_offset_expand(int freq, int offset, uint8_t drive_strength);
@@ -262,6 +303,7 @@ void set_trace_scale(int t, float scale);
 void set_trace_refpos(int t, float refpos);
 float get_trace_scale(int t);
 float get_trace_refpos(int t);
+void set_groupdelay_aperture(int n);
 void draw_battery_status(void);
 
 void set_electrical_delay(float picoseconds);
@@ -288,8 +330,30 @@ void request_to_draw_cells_behind_numeric_input(void);
 void redraw_marker(int marker, int update_info);
 void trace_get_info(int t, char *buf, int len);
 void plot_into_index(float measured[2][SWEEP_POINTS][2]);
+extern float groupdelay[2][SWEEP_POINTS];  // ns
+extern int8_t groupdelay_aperture;  // 只在运行时设置，不随 save 保存
+
+enum { MATH_OFF, MATH_DIV, MATH_SUB };
+extern uint8_t trace_math[2];
+void trace_memory_store(void);
+void trace_memory_clear(void);
+int trace_memory_get(int ch, int i, float v[2]);
+void set_trace_math(int ch, int math);
 void force_set_markmap(void);
 void draw_all_cells(void);
+int plot_frame_due(int sweeping);
+void plot_frame(void);
+
+typedef struct {
+  uint32_t frame;      // draw_all_cells 次数
+  uint16_t cells;      // 本帧绘制的 CELL 块数，相邻条带合并后计一块
+  uint32_t windows;    // 本帧 set_block 次数
+  uint32_t pixels;     // 本帧写入 LCD 的像素数
+  uint32_t time_us;    // 本帧绘制时间
+} render_stats_t;
+extern render_stats_t render_stats;
+extern render_stats_t render_test_stats;
+extern volatile uint8_t render_test_frames;
 
 void draw_cal_status(void);
 
@@ -299,6 +363,52 @@ void marker_position(int m, int t, int *x, int *y);
 int search_nearest_index(int x, int y, int t);
 
 extern int8_t redraw_requested;
+extern uint32_t sweep_count;
+
+/*
+ * 二进制数据帧，见 bindata 命令
+ * 16 字节帧头，小端，后面跟 size 字节数据
+ */
+#define BIN_MAGIC      0xB15A
+#define BIN_FMT_U32    1  // uint32，每点一个
+#define BIN_FMT_F32X2  2  // float 实部、虚部
+#define BIN_FMT_U32DD  3  // 压缩：第一个点 uint32，之后是二阶差分的 zigzag varint，无损
+#define BIN_FMT_I16X2  4  // 压缩：每 BIN_BLOCK 点一个 int8 指数 e，
+                          //       后面每点 int16 实部、虚部，值 = q * 2^e
+#define BIN_BLOCK      16
+
+typedef struct {
+  uint16_t magic;
+  uint8_t  format;
+  uint8_t  array;   // 'f' 频率，0-8 同 data 命令
+  uint32_t seq;     // sweep_count
+  uint16_t points;  // sweep_points
+  uint16_t size;    // 数据字节数
+  uint32_t crc;     // 数据的 CRC-32
+} bin_header_t;
+
+/*
+ * 逐点推送记录，见 stream 命令，32 字节，小端
+ */
+#define STREAM_MAGIC    0x5A17
+#define STREAM_FIRST    0x01  // 扫描的第一个点
+#define STREAM_LAST     0x02  // 扫描的最后一个点
+#define STREAM_DROPPED  0x04  // 前面有记录因为 USB 来不及发送被丢弃
+#define STREAM_CAL      0x08  // 已经应用校准
+
+typedef struct {
+  uint16_t magic;
+  uint8_t  flags;
+  uint8_t  reserved;
+  uint16_t index;   // 点序号
+  uint16_t seq;     // 扫描序号低 16 位，最后一个点发出后 sweep_count 等于它
+  uint32_t freq;
+  float    s11[2];
+  float    s21[2];
+  uint32_t crc;     // 前 28 字节的 CRC-32
+} stream_rec_t;
+
+uint32_t crc32(uint32_t crc, const void *data, int len);
 
 extern int16_t vbat;
 
@@ -323,6 +433,11 @@ extern uint16_t lcd_buffer[4096];
 void nt35510_init(void);
 void nt35510_test(int mode);
 void nt35510_bulk_x2(int x, int y, int w, int h);
+void nt35510_bulk_x2_dma(const uint16_t *buf, int x, int y, int w, int h);
+void nt35510_dma_init(void);
+void nt35510_dma_wait(void);
+extern uint32_t lcd_windows;
+extern uint32_t lcd_pixels;
 void nt35510_fill_x2(int x, int y, int w, int h, int color);
 void nt35510_drawchar_5x7_x2(uint8_t ch, int x, int y, uint16_t fg, uint16_t bg);
 void nt35510_drawstring_5x7_x2(const char *str, int x, int y, uint16_t fg, uint16_t bg);
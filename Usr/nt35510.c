@@ -17,8 +17,21 @@
 #define BANK1_LCD_C    ((uint32_t)0x60000000)    // Disp Reg  ADDR
 #define BANK1_LCD_D    ((uint32_t)0x60020000)    // Disp Data ADDR
 
+// 总线读写。32 位写由 FSMC 拆成两次半字写，低半字在前。
+// 主机测试 (test/host/panel.h) 换成屏幕模型，等 DMA 时让出 CPU 给模拟 DMA 的线程
+#ifndef LCD_WR16
+#define LCD_WR16(a, v)  (*(__IO uint16_t *)(a) = (v))
+#define LCD_WR32(a, v)  (*(__IO uint32_t *)(a) = (v))
+#define LCD_RD16(a)     (*(__IO uint16_t *)(a))
+#define LCD_DMA_IDLE()
+#endif
+
 uint16_t lcd_buffer[4096];
 
+// 刷新统计：窗口数和写入的像素数
+uint32_t lcd_windows;
+uint32_t lcd_pixels;
+
 /*
 =======================================
     延时函数
@@ -53,7 +66,7 @@ static void lcd_rst(void)
 */
 void WriteComm(uint16_t cmd)
 {
-  *(__IO uint16_t *)(BANK1_LCD_C) = cmd;
+  LCD_WR16(BANK1_LCD_C, cmd);
 }
 
 /*
@@ -63,7 +76,7 @@ void WriteComm(uint16_t cmd)
 */
 void WriteData(uint16_t dat)
 {
-  *(__IO uint16_t *)(BANK1_LCD_D) = dat;
+  LCD_WR16(BANK1_LCD_D, dat);
 }
 
 /*
@@ -73,6 +86,11 @@ void WriteData(uint16_t dat)
 */
 void set_block(uint16_t xs, uint16_t xe, uint16_t ys, uint16_t ye) 
 {
+  nt35510_dma_wait();  // 上一个 CELL 还在 DMA 送屏
+
+  lcd_windows++;
+  lcd_pixels += (uint32_t)(xe - xs + 1) * (ye - ys + 1);
+
   WriteComm(0x2a00);
   WriteData(xs>>8);
   WriteComm(0x2a01);
@@ -101,6 +119,8 @@ void set_block(uint16_t xs, uint16_t xe, uint16_t ys, uint16_t ye)
 */
 uint16_t get_point( uint16_t x, uint16_t y)
 {
+  nt35510_dma_wait();
+
   WriteComm(0x2a00);
   WriteData(x>>8);
   WriteComm(0x2a01);
@@ -113,29 +133,160 @@ uint16_t get_point( uint16_t x, uint16_t y)
 
   WriteComm(0x2e00); // RAMRD
 
-  x = *(__IO uint16_t *)(BANK1_LCD_D);
+  x = LCD_RD16(BANK1_LCD_D);
 
-  x = *(__IO uint16_t *)(BANK1_LCD_D);
+  x = LCD_RD16(BANK1_LCD_D);
 
-  y = *(__IO uint16_t *)(BANK1_LCD_D);
+  y = LCD_RD16(BANK1_LCD_D);
 
   // return (x&0xf800)|((x&0x00fc)<<3)|(y>>11); // 返回正确点
   return 0; // 故意返回错误点，令其出现拖影
 }
 
-void nt35510_fill(int x, int y, int w, int h, int color)
+/*
+=======================================
+    DMA 刷新
+    DMA1 通道7 用存储器到存储器模式，目标地址固定为 BANK1_LCD_D。
+    32 位写 16 位 FSMC 会拆成两次半字写，像素展开成 p|p<<16
+    正好横向写两遍，AHB 传输次数减半。
+    放大 2 倍的区块：一行展开后在行缓存里放两遍，纵向也写两遍，
+    一次 DMA 送出屏幕上的两行。两个行缓存交替使用，
+    中断里启动下一行，同时展开再下一行。
+    buf 在刷新完成前不能改动，draw_cell 用两块缓存轮流绘制。
+    填充：源地址不递增，一个字重复写，不占用 CPU
+=======================================
+*/
+#define LCD_DMA_CH      DMA1_Channel7
+#define LCD_DMA_MAXW    32
+#define LCD_DMA_MAXN    0xffff  // CNDTR 16 位
+// 存储器 -> "外设"(FSMC)，32 位，低优先级，传输完成中断
+#define LCD_DMA_CCR     (DMA_CCR_MEM2MEM | DMA_CCR_DIR | DMA_CCR_PSIZE_1 \
+                         | DMA_CCR_MSIZE_1 | DMA_CCR_TCIE)
+
+static uint32_t lcd_line[2][LCD_DMA_MAXW * 2];
+static const uint16_t *lcd_dma_src;
+static int lcd_dma_w;
+static int lcd_dma_rows;        // 还没有启动的行数
+static uint8_t lcd_dma_line;    // 正在传输的行缓存
+static uint32_t lcd_fill_word;  // 填充颜色 p|p<<16
+static uint32_t lcd_fill_left;  // 填充还没有启动的字数
+static volatile uint8_t lcd_dma_busy;
+
+static void bulk_x2(const uint16_t *buf, int x, int y, int w, int h);
+
+static void lcd_line_expand(uint32_t *line, const uint16_t *src, int w)
 {
-  int i;
+  int j;
+  for (j = 0; j < w; j++) {
+    uint32_t v = src[j];
+    v |= v << 16;
+    line[j] = v;
+    line[w + j] = v;
+  }
+}
 
-  set_block(x, x+w-1, y, y+h-1);
+static void lcd_dma_start(const uint32_t *src, int n, uint32_t minc)
+{
+  LCD_DMA_CH->CCR = LCD_DMA_CCR | minc;
+  LCD_DMA_CH->CMAR = (uint32_t)src;
+  LCD_DMA_CH->CNDTR = n;
+  LCD_DMA_CH->CCR = LCD_DMA_CCR | minc | DMA_CCR_EN;
+}
+
+static void lcd_fill_next(void)
+{
+  uint32_t n = lcd_fill_left > LCD_DMA_MAXN ? LCD_DMA_MAXN : lcd_fill_left;
+  lcd_fill_left -= n;
+  lcd_dma_start(&lcd_fill_word, n, 0);
+}
+
+void nt35510_dma_init(void)
+{
+  __HAL_RCC_DMA1_CLK_ENABLE();
+
+  LCD_DMA_CH->CCR = 0;
+  LCD_DMA_CH->CPAR = BANK1_LCD_D;
+  DMA1->IFCR = DMA_IFCR_CGIF7;
+}
+
+void nt35510_dma_wait(void)
+{
+  while (lcd_dma_busy)
+    LCD_DMA_IDLE();
+}
+
+/*
+ * 在 RAMWR 之后写 n 个像素的同一颜色，数量少时直接写
+ */
+static void lcd_fill_pixels(uint32_t n, uint16_t color)
+{
+  if (n & 1)
+    LCD_WR16(BANK1_LCD_D, color);
+  n >>= 1;
+  if (n < 16) {
+    while (n-- > 0)
+      LCD_WR32(BANK1_LCD_D, color | (uint32_t)color << 16);
+    return;
+  }
+  lcd_fill_word = color | (uint32_t)color << 16;
+  lcd_fill_left = n;
+  lcd_dma_rows = 0;
+  lcd_dma_busy = 1;
+  lcd_fill_next();
+}
+
+void nt35510_bulk_x2_dma(const uint16_t *buf, int x, int y, int w, int h)
+{
+  if (w > LCD_DMA_MAXW) {  // 行缓存放不下，用 CPU 写
+    bulk_x2(buf, x, y, w, h);
+    return;
+  }
 
+  set_block(x*2, x*2+w*2-1, y*2, y*2+h*2-1);  // 扩展为2倍
   WriteComm(0x2c00);    // RAMWR
 
-  for (i=0; i<w*h; i++)
-  {
-    *(__IO uint16_t *)(BANK1_LCD_D) = color;
-    // osDelay(1);
+  lcd_dma_w = w;
+  lcd_dma_rows = h - 1;
+  lcd_dma_line = 0;
+  lcd_line_expand(lcd_line[0], buf, w);
+  lcd_dma_src = buf + w;
+  if (lcd_dma_rows > 0)
+    lcd_line_expand(lcd_line[1], lcd_dma_src, w);
+  lcd_dma_busy = 1;
+  lcd_dma_start(lcd_line[0], w * 2, DMA_CCR_MINC);
+}
+
+/*
+ * DMA1 通道7 中断，在 stm32f1xx_it.c 中调用
+ */
+void nt35510_dma_irq(void)
+{
+  DMA1->IFCR = DMA_IFCR_CGIF7;
+
+  if (lcd_fill_left > 0) {
+    lcd_fill_next();
+    return;
   }
+  if (lcd_dma_rows <= 0) {
+    LCD_DMA_CH->CCR = LCD_DMA_CCR;
+    lcd_dma_busy = 0;
+    return;
+  }
+  lcd_dma_line ^= 1;
+  lcd_dma_start(lcd_line[lcd_dma_line], lcd_dma_w * 2, DMA_CCR_MINC);
+  lcd_dma_rows--;
+  lcd_dma_src += lcd_dma_w;
+  if (lcd_dma_rows > 0)  // DMA 传输期间展开下一行
+    lcd_line_expand(lcd_line[lcd_dma_line ^ 1], lcd_dma_src, lcd_dma_w);
+}
+
+void nt35510_fill(int x, int y, int w, int h, int color)
+{
+  set_block(x, x+w-1, y, y+h-1);
+
+  WriteComm(0x2c00);    // RAMWR
+
+  lcd_fill_pixels((uint32_t)w * h, color);
 }
 
 /*
@@ -546,6 +697,8 @@ void nt35510_init(void)
   WriteComm(0x2900);                    // Display on
   lcd_delay(50);
 
+  nt35510_dma_init();
+
   nt35510_fill(0, 0, 800, 480, BLACK);
 
   // Add Logo
@@ -559,15 +712,10 @@ void nt35510_init(void)
 */
 void nt35510_pixel_x2(int x, int y, int color)
 {
-  int i;
-
   set_block(x*2, x*2+1, y*2, y*2+1);  // 扩展为2倍
   WriteComm(0x2c00);    // RAMWR
 
-  for (i=0; i<4; i++)
-  {
-    *(__IO uint16_t *)(BANK1_LCD_D) = color;
-  }
+  lcd_fill_pixels(4, color);
 }
 
 /*
@@ -580,15 +728,10 @@ void nt35510_pixel_x2(int x, int y, int color)
 */
 void nt35510_fill_x2(int x, int y, int w, int h, int color)
 {
-  int i;
-
   set_block(x*2, x*2+w*2-1, y*2, y*2+h*2-1);  // 扩展为2倍
   WriteComm(0x2c00);    // RAMWR
 
-  for (i=0; i<w*2*h*2; i++)
-  {
-    *(__IO uint16_t *)(BANK1_LCD_D) = color;
-  }
+  lcd_fill_pixels((uint32_t)w * h * 4, color);
 }
 
 /*
@@ -610,20 +753,31 @@ void nt35510_bulk_x2(int x, int y, int w, int h)
     ssp_senddata16(*buf++);
 }
 #else
-void nt35510_bulk_x2(int x, int y, int w, int h)
+static void bulk_x2(const uint16_t *buf, int x, int y, int w, int h)
 {
   int i,j;
-  uint16_t *buf = lcd_buffer;
 
   set_block(x*2, x*2+w*2-1, y*2, y*2+h*2-1);  // 扩展为2倍
   WriteComm(0x2c00);    // RAMWR
 
+  if (w <= LCD_DMA_MAXW) {
+    // 每行只展开一次，32 位写，FSMC 拆成两次半字写
+    // set_block 已等待 DMA 结束，行缓存可以借用
+    for (i=0; i<h; i++, buf += w)
+    {
+      lcd_line_expand(lcd_line[0], buf, w);
+      for (j=0; j<w*2; j++)
+        LCD_WR32(BANK1_LCD_D, lcd_line[0][j]);
+    }
+    return;
+  }
+
   for (i=0; i<h; i++)
   {
     for (j=0; j<w; j++)
     {
-      *(__IO uint16_t *)(BANK1_LCD_D) = *buf;
-      *(__IO uint16_t *)(BANK1_LCD_D) = *buf;
+      LCD_WR16(BANK1_LCD_D, *buf);
+      LCD_WR16(BANK1_LCD_D, *buf);
       buf++;
     }
 
@@ -631,36 +785,145 @@ void nt35510_bulk_x2(int x, int y, int w, int h)
 
     for (j=0; j<w; j++)
     {
-      *(__IO uint16_t *)(BANK1_LCD_D) = *buf;
-      *(__IO uint16_t *)(BANK1_LCD_D) = *buf;
+      LCD_WR16(BANK1_LCD_D, *buf);
+      LCD_WR16(BANK1_LCD_D, *buf);
       buf++;
     }
   }
 }
+
+void nt35510_bulk_x2(int x, int y, int w, int h)
+{
+  bulk_x2(lcd_buffer, x, y, w, h);
+}
 #endif
 
-void nt35510_drawchar_5x7_x2(uint8_t ch, int x, int y, uint16_t fg, uint16_t bg)
+/*
+=======================================
+    文字绘制
+    一串字符只设一次窗口：逐行扫描，每行依次写出所有字符的这一行，
+    不经过 lcd_buffer。字模每 4 bit 查表得到 4 个像素，
+    查找表按当前前景色/背景色生成，颜色不变时重复使用。
+    放大 2 倍时每个像素写成 p|p<<16，每行扫描两遍
+=======================================
+*/
+typedef uint32_t (*glyph_row_t)(const void *font, uint8_t ch, int row);  // 返回左对齐的字模行
+
+static uint16_t text_fg, text_bg;
+static uint8_t text_lut_valid;
+static uint32_t text_lut_x1[16][2];  // 4 个像素，两个像素一个字
+static uint32_t text_lut_x2[16][4];  // 4 个像素，每个横向写两遍
+
+static void text_lut(uint16_t fg, uint16_t bg)
 {
-  uint16_t *buf = lcd_buffer;
-  uint16_t bits;
-  int c, r;
-  for(c = 0; c < 7; c++) {
-    bits = x5x7_bits[(ch * 7) + c];
-    for (r = 0; r < 5; r++) {
-      *buf++ = (0x8000 & bits) ? fg : bg;
-      bits <<= 1;
+  int i, k;
+
+  if (text_lut_valid && fg == text_fg && bg == text_bg)
+    return;
+  for (i = 0; i < 16; i++) {
+    uint32_t p[4];
+    for (k = 0; k < 4; k++) {
+      p[k] = (i & (8 >> k)) ? fg : bg;
+      text_lut_x2[i][k] = p[k] | p[k] << 16;
     }
+    text_lut_x1[i][0] = p[0] | p[1] << 16;  // 低半字先写
+    text_lut_x1[i][1] = p[2] | p[3] << 16;
   }
-  nt35510_bulk_x2(x, y, 5, 7);
+  text_fg = fg;
+  text_bg = bg;
+  text_lut_valid = 1;
 }
 
-void nt35510_drawstring_5x7_x2(const char *str, int x, int y, uint16_t fg, uint16_t bg)
+static void text_row_x1(uint32_t bits, int n)
+{
+  for (; n >= 4; n -= 4, bits <<= 4) {
+    const uint32_t *p = text_lut_x1[bits >> 28];
+    LCD_WR32(BANK1_LCD_D, p[0]);
+    LCD_WR32(BANK1_LCD_D, p[1]);
+  }
+  for (; n > 0; n--, bits <<= 1)
+    LCD_WR16(BANK1_LCD_D, (bits & 0x80000000UL) ? text_fg : text_bg);
+}
+
+static void text_row_x2(uint32_t bits, int n)
 {
-  while (*str) {
-    nt35510_drawchar_5x7_x2(*str, x, y, fg, bg);
-    x += 5;
-    str++;
+  for (; n >= 4; n -= 4, bits <<= 4) {
+    const uint32_t *p = text_lut_x2[bits >> 28];
+    LCD_WR32(BANK1_LCD_D, p[0]);
+    LCD_WR32(BANK1_LCD_D, p[1]);
+    LCD_WR32(BANK1_LCD_D, p[2]);
+    LCD_WR32(BANK1_LCD_D, p[3]);
   }
+  for (; n > 0; n--, bits <<= 1)
+    LCD_WR32(BANK1_LCD_D, text_lut_x2[(bits & 0x80000000UL) ? 8 : 0][0]);
+}
+
+/*
+ * x, y 为屏幕坐标，w, h 为字符大小，scale 为 1 或 2
+ * 超出屏幕右边的字符不画
+ */
+static void text_run(const void *font, glyph_row_t glyph, const char *str, int n,
+                     int x, int y, int w, int h, int scale, uint16_t fg, uint16_t bg)
+{
+  int c, i, k;
+  int fit = (800 - x) / (w * scale);
+
+  if (n > fit)
+    n = fit;
+  if (n <= 0)
+    return;
+
+  text_lut(fg, bg);
+  set_block(x, x + n*w*scale - 1, y, y + h*scale - 1);
+  WriteComm(0x2c00);    // RAMWR
+
+  for (c = 0; c < h; c++) {
+    for (k = 0; k < scale; k++) {
+      for (i = 0; i < n; i++) {
+        uint32_t bits = glyph(font, (uint8_t)str[i], c);
+        if (scale == 2)
+          text_row_x2(bits, w);
+        else
+          text_row_x1(bits, w);
+      }
+    }
+  }
+}
+
+static uint32_t glyph_mwc(const void *font, uint8_t ch, int row)
+{
+  const MWCFONT *f = font;
+  return (uint32_t)f->bits[(ch * f->height) + row] << 16;
+}
+
+static uint32_t glyph_5x7(const void *font, uint8_t ch, int row)
+{
+  (void)font;
+  return (uint32_t)x5x7_bits[(ch * 7) + row] << 16;
+}
+
+static uint32_t glyph_10x14(const void *font, uint8_t ch, int row)
+{
+  (void)font;
+  return (uint32_t)_10x20_bits[(ch * 20) + row + 2] << 16;  // 经过调整
+}
+
+extern const uint8_t hanzi_24x24_bits[];
+static uint32_t glyph_hz24(const void *font, uint8_t ch, int row)
+{
+  const uint8_t *b = &hanzi_24x24_bits[ch*72 + row*3];
+  (void)font;
+  return (uint32_t)b[0] << 24 | (uint32_t)b[1] << 16 | (uint32_t)b[2] << 8;
+}
+
+void nt35510_drawchar_5x7_x2(uint8_t ch, int x, int y, uint16_t fg, uint16_t bg)
+{
+  text_run(NULL, glyph_5x7, (const char *)&ch, 1, x*2, y*2, 5, 7, 2, fg, bg);
+}
+
+void nt35510_drawstring_5x7_x2(const char *str, int x, int y, uint16_t fg, uint16_t bg)
+{
+  text_run(NULL, glyph_5x7, str, strlen(str), x*2, y*2, 5, 7, 2, fg, bg);
 }
 
 #define SWAP(x,y) do { int z=x; x = y; y = z; } while(0)
@@ -791,7 +1054,7 @@ void nt35510_bulk(int x, int y, int w, int h)
   {
     for (j=0; j<w; j++)
     {
-      *(__IO uint16_t *)(BANK1_LCD_D) = *buf;
+      LCD_WR16(BANK1_LCD_D, *buf);
       buf++;
     }
   }
@@ -804,17 +1067,7 @@ void nt35510_bulk(int x, int y, int w, int h)
 */
 void nt35510_drawchar(MWCFONT *font, uint8_t ch, int x, int y, uint16_t fg, uint16_t bg)
 {
-  uint16_t *buf = lcd_buffer;
-  uint16_t bits;
-  int c, r;
-  for(c = 0; c < font->height; c++) {
-    bits = font->bits[(ch * font->height) + c];
-    for (r = 0; r < font->maxwidth; r++) {
-      *buf++ = (0x8000 & bits) ? fg : bg;
-      bits <<= 1;
-    }
-  }
-  nt35510_bulk(x, y, font->maxwidth, font->height);
+  text_run(font, glyph_mwc, (const char *)&ch, 1, x, y, font->maxwidth, font->height, 1, fg, bg);
 }
 
 /*
@@ -824,11 +1077,7 @@ void nt35510_drawchar(MWCFONT *font, uint8_t ch, int x, int y, uint16_t fg, uint
 */
 void nt35510_drawstring(MWCFONT *font, const char *str, int x, int y, uint16_t fg, uint16_t bg)
 {
-  while (*str) {
-    nt35510_drawchar(font, *str, x, y, fg, bg);
-    x += font->maxwidth;
-    str++;
-  }
+  text_run(font, glyph_mwc, str, strlen(str), x, y, font->maxwidth, font->height, 1, fg, bg);
 }
 
 /*
@@ -836,27 +1085,9 @@ void nt35510_drawstring(MWCFONT *font, const char *str, int x, int y, uint16_t f
     显示汉字 24x24
 =======================================
 */
-extern const uint8_t hanzi_24x24_bits[];
 void nt35510_drawhz24x24(const char *str, int x, int y, uint16_t fg, uint16_t bg)
 {
-  x = x*2;
-  y = y*2;
-  uint16_t *buf;
-  uint8_t bits;
-  int c, r;
-  while (*str) {
-    buf = lcd_buffer;
-    for(c = 0; c < 24*3; c++) {
-      bits = hanzi_24x24_bits[(*str)*72 + c];
-      for (r = 0; r < 8; r++) {
-        *buf++ = (0x80 & bits) ? fg : bg;
-        bits <<= 1;
-      }
-    }
-    nt35510_bulk(x, y, 24, 24);
-    x += 24;
-    str++;
-  }
+  text_run(NULL, glyph_hz24, str, strlen(str), x*2, y*2, 24, 24, 1, fg, bg);
 }
 
 /*
@@ -866,17 +1097,7 @@ void nt35510_drawhz24x24(const char *str, int x, int y, uint16_t fg, uint16_t bg
 */
 void nt35510_drawchar_x2(MWCFONT *font, uint8_t ch, int x, int y, uint16_t fg, uint16_t bg)
 {
-  uint16_t *buf = lcd_buffer;
-  uint16_t bits;
-  int c, r;
-  for(c = 0; c < font->height; c++) {
-    bits = font->bits[(ch * font->height) + c];
-    for (r = 0; r < font->maxwidth; r++) {
-      *buf++ = (0x8000 & bits) ? fg : bg;
-      bits <<= 1;
-    }
-  }
-  nt35510_bulk_x2(x, y, font->maxwidth, font->height);
+  text_run(font, glyph_mwc, (const char *)&ch, 1, x*2, y*2, font->maxwidth, font->height, 2, fg, bg);
 }
 
 /*
@@ -886,35 +1107,15 @@ void nt35510_drawchar_x2(MWCFONT *font, uint8_t ch, int x, int y, uint16_t fg, u
 */
 void nt35510_drawstring_x2(MWCFONT *font, const char *str, int x, int y, uint16_t fg, uint16_t bg)
 {
-  while (*str) {
-    nt35510_drawchar_x2(font, *str, x, y, fg, bg);
-    x += font->maxwidth;
-    str++;
-  }
+  text_run(font, glyph_mwc, str, strlen(str), x*2, y*2, font->maxwidth, font->height, 2, fg, bg);
 }
 
 void nt35510_drawchar_5x7(uint8_t ch, int x, int y, uint16_t fg, uint16_t bg)
 {
-  uint16_t *buf = lcd_buffer;
-  uint16_t bits;
-  int c, r;
-  for(c = 0; c < 14; c++) {  // 经过调整
-    bits = _10x20_bits[(ch * 20) + c + 2];  // 经过调整
-    for (r = 0; r < 10; r++) {
-      *buf++ = (0x8000 & bits) ? fg : bg;
-      bits <<= 1;
-    }
-  }
-  nt35510_bulk(x, y, 10, 14);
+  text_run(NULL, glyph_10x14, (const char *)&ch, 1, x, y, 10, 14, 1, fg, bg);
 }
 
 void nt35510_drawstring_5x7(const char *str, int x, int y, uint16_t fg, uint16_t bg)
 {
-  x = x*2;
-  y = y*2;
-  while (*str) {
-    nt35510_drawchar_5x7(*str, x, y, fg, bg);
-    x += 10;
-    str++;
-  }
+  text_run(NULL, glyph_10x14, str, strlen(str), x*2, y*2, 10, 14, 1, fg, bg);
 }
@@ -27,5 +27,6 @@
 // #define   DGRAY                0x7BEF                // 深灰色：128, 128, 128 //
 
 void nt35510_fill(int x, int y, int w, int h, int color);
+void nt35510_dma_irq(void);
 
 #endif
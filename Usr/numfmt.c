@@ -0,0 +1,168 @@
+/*-----------------------------------------------------------------------------/
+ * Module       : numfmt.c
+ * Create       : 2026-10-18
+ * Copyright    : hamelec.taobao.com
+ * Brief        : 数字格式化，代替显示和命令行里的 snprintf("%f")
+ newlib 的浮点 printf 代码大、速度慢（软件浮点 + 大数运算）。
+ 这里直接拆开 float 的指数和尾数，用 64 位整数算出定点数，
+ 舍入方式与 printf 相同（按二进制精确值四舍六入五成双）。
+ |v| < 2^43 (约 8.8e12) 时结果与 printf("%.*f") 逐字相同，更大的数
+ 相对误差 < 1e-16。见 test/host/test_numfmt.c，对全部 float 区间抽样比较。
+/-----------------------------------------------------------------------------*/
+#include <stdint.h>
+#include <string.h>
+#include "nanovna.h"
+
+#define FMT_FIXED_MAX_EXP  19   // m * 10^6 * 2^19 < 2^63
+
+static const uint32_t pow10_tbl[] = {
+  1, 10, 100, 1000, 10000, 100000, 1000000
+};
+
+/*
+ * 无符号整数转十进制，width 为最少位数（前面补 0）
+ * 返回长度，不写结束符
+ */
+static int put_uint(char *p, uint32_t v, int width)
+{
+  char tmp[10];
+  int n = 0, i;
+
+  do {
+    tmp[n++] = '0' + v % 10;
+    v /= 10;
+  } while (v);
+  while (n < width)
+    tmp[n++] = '0';
+  for (i = 0; i < n; i++)
+    p[i] = tmp[n - 1 - i];
+  return n;
+}
+
+static int put_uint64(char *p, uint64_t v, int width)
+{
+  int n;
+
+  if (v >= 1000000000UL) {  // 每 9 位做一次 64 位除法
+    n = put_uint64(p, v / 1000000000UL, width > 9 ? width - 9 : 0);
+    return n + put_uint(p + n, (uint32_t)(v % 1000000000UL), 9);
+  }
+  return put_uint(p, (uint32_t)v, width);
+}
+
+/* 截断到 len，行为与 snprintf 相同，返回写入的长度 */
+static int fmt_copy(char *buf, int len, const char *s, int n)
+{
+  if (len <= 0)
+    return 0;
+  if (n > len - 1)
+    n = len - 1;
+  memcpy(buf, s, n);
+  buf[n] = '\0';
+  return n;
+}
+
+/*
+=======================================
+    复制字符串，用于在数字后面接单位
+    返回写入的长度
+=======================================
+*/
+int fmt_str(char *buf, int len, const char *s)
+{
+  return fmt_copy(buf, len, s, strlen(s));
+}
+
+/*
+=======================================
+    无符号整数，width 为最少位数，前面补 0
+    相当于 snprintf(buf, len, "%0*u", width, v)
+=======================================
+*/
+int fmt_uint(char *buf, int len, uint32_t v, int width)
+{
+  char tmp[12];
+  return fmt_copy(buf, len, tmp, put_uint(tmp, v, width));
+}
+
+/*
+=======================================
+    定点格式，prec 位小数 (0~6)
+    相当于 snprintf(buf, len, "%.*f", prec, v)
+=======================================
+*/
+int fmt_fixed(char *buf, int len, float v, int prec)
+{
+  union { float f; uint32_t i; } u;
+  char tmp[48];  // 最大 3.4e38，39 位整数
+  char *p = tmp;
+  uint64_t q;
+  uint32_t m;
+  int e, k = 0, n;
+
+  u.f = v;
+  if (u.i & 0x80000000UL)
+    *p++ = '-';
+  e = (u.i >> 23) & 0xff;
+  m = u.i & 0x007fffff;
+  if (e == 0xff) {
+    memcpy(p, m ? "nan" : "inf", 3);
+    return fmt_copy(buf, len, tmp, (p - tmp) + 3);
+  }
+  if (prec < 0)
+    prec = 0;
+  if (prec > 6)
+    prec = 6;
+
+  if (e)
+    m |= 0x00800000;  // 规格化数
+  else
+    e = 1;            // 非规格化数
+  e -= 127 + 23;      // |v| = m * 2^e
+
+  if (e > FMT_FIXED_MAX_EXP) {  // 整数，除 10 保持在 64 位以内，末尾补 0
+    q = m;
+    while (e > 0) {
+      if (q < (1ULL << 60)) {
+        q <<= 1;
+        e--;
+      } else {
+        q = (q + 5) / 10;
+        k++;
+      }
+    }
+    p += put_uint64(p, q, 1);
+    while (k-- > 0)
+      *p++ = '0';
+    if (prec) {
+      *p++ = '.';
+      while (prec-- > 0)
+        *p++ = '0';
+    }
+    return fmt_copy(buf, len, tmp, p - tmp);
+  }
+
+  q = (uint64_t)m * pow10_tbl[prec];
+  if (e >= 0) {
+    q <<= e;
+  } else if (-e >= 48) {  // q < 2^44，不到半个单位
+    q = 0;
+  } else {
+    int sh = -e;
+    uint64_t rem = q & ((1ULL << sh) - 1);
+    uint64_t half = 1ULL << (sh - 1);
+    q >>= sh;
+    if (rem > half || (rem == half && (q & 1)))  // 四舍六入五成双
+      q++;
+  }
+
+  // 整数部分至少 1 位，再插入小数点
+  n = put_uint64(p, q, prec + 1);
+  if (prec) {
+    memmove(p + n - prec + 1, p + n - prec, prec);
+    p[n - prec] = '.';
+    n++;
+  }
+  p += n;
+  return fmt_copy(buf, len, tmp, p - tmp);
+}
@@ -7,13 +7,20 @@
 
 #define SWAP(x,y) do { int z=x; x = y; y = z; } while(0)
 
-void cell_draw_marker_info(int m, int n, int w, int h);
+void cell_draw_marker_info(int x0, int y0, int w, int h);
 void draw_frequencies(void);
 void frequency_string(char *buf, size_t len, int32_t freq);
 void markmap_all_markers(void);
 
-/* indicate dirty cells */
-uint16_t markmap[2][8];
+static uint8_t marker_info_valid;  // mark 点信息字符串缓存是否有效，force_set_markmap 时失效
+
+/*
+ * indicate dirty cells
+ * 每个 CELL 列一个 32 位字，bit k 表示第 k 条 8 像素高的条带 (y = 8k ~ 8k+7)
+ */
+#define MARK_COLS        16
+#define MARK_STRIP       8
+uint32_t markmap[2][MARK_COLS];
 uint16_t current_mappage = 0;
 
 int32_t fgrid = 50000000;
@@ -32,6 +39,14 @@ int area_height = HEIGHT;
 #define CELLWIDTH        32
 #define CELLHEIGHT       32
 
+/*
+ * 两块 CELL 缓存放在 lcd_buffer 的后半部分，draw_cell 轮流使用，
+ * 一块由 DMA 送往 LCD 时绘制另一块。lcd_buffer 前半部分留给文字和电池图标
+ */
+#define CELL_BUFFER(k)   (&lcd_buffer[2048 + (k) * CELLWIDTH * CELLHEIGHT])
+static uint8_t cell_buffer_sel;
+static uint16_t *cell_buffer = CELL_BUFFER(0);
+
 /*
  * CELL_X0[27:31] cell position 0-31
  * CELL_Y0[22:26] cell position 0-31
@@ -394,6 +409,77 @@ rectangular_grid_y(int y)
   return 0;
 }
 
+/*
+=======================================
+    Smith/导纳/极坐标网格位图缓存，每像素 1 bit
+    网格上下对称，只存中心及以下 P_RADIUS+1 行，
+    每行覆盖 P_CENTER_X-P_RADIUS ~ P_CENTER_X+P_RADIUS 共 233 点，
+    约 3.7KB。网格种类或 grid_color 改变时才重新生成，
+    draw_cell 查表代替逐点的 circle_inout 运算
+=======================================
+*/
+#define GRID_MASK_W      (P_RADIUS*2+1)
+#define GRID_MASK_WORDS  ((GRID_MASK_W+31)/32)
+#define GRID_MASK_X0     (P_CENTER_X-P_RADIUS)
+
+static uint32_t grid_mask[P_RADIUS+1][GRID_MASK_WORDS];
+static uint16_t grid_mask_mode;
+static uint16_t grid_mask_color;
+
+static void
+grid_mask_update(uint16_t mode)
+{
+  int x, y, c;
+
+  if (mode == grid_mask_mode && config.grid_color == grid_mask_color)
+    return;
+
+  memset(grid_mask, 0, sizeof grid_mask);
+  for (y = 0; y <= P_RADIUS; y++) {
+    for (x = 0; x < GRID_MASK_W; x++) {
+      if (mode == GRID_SMITH)
+        c = smith_grid(x + GRID_MASK_X0, y + P_CENTER_Y);
+      else if (mode == GRID_ADMIT)
+        c = smith_grid3(x + GRID_MASK_X0, y + P_CENTER_Y);
+      else
+        c = polar_grid(x + GRID_MASK_X0, y + P_CENTER_Y);
+      if (c)
+        grid_mask[y][x >> 5] |= 0x80000000UL >> (x & 31);
+    }
+  }
+  grid_mask_mode = mode;
+  grid_mask_color = config.grid_color;
+}
+
+/*
+ * 把网格画到 CELL 缓存中，(x0, y0) 是 CELL 左上角在网格坐标中的位置
+ */
+static void
+cell_draw_grid_mask(uint16_t *buf, int x0, int y0, int w, int h)
+{
+  uint16_t c = config.grid_color;
+  int xs = GRID_MASK_X0 - x0;
+  int xe = xs + GRID_MASK_W;
+  int x, y;
+
+  if (xs < 0) xs = 0;
+  if (xe > w) xe = w;
+  for (y = 0; y < h; y++, buf += w) {
+    const uint32_t *row;
+    int r = y + y0 - P_CENTER_Y;
+    if (r < 0)
+      r = -r;
+    if (r > P_RADIUS)
+      continue;
+    row = grid_mask[r];
+    for (x = xs; x < xe; x++) {
+      int mx = x + x0 - GRID_MASK_X0;
+      if (row[mx >> 5] & (0x80000000UL >> (mx & 31)))
+        buf[x] |= c;
+    }
+  }
+}
+
 #if 0
 int
 set_strut_grid(int x)
@@ -438,7 +524,7 @@ float logmag(float *v)
   if (v[0] == 0 && v[1] == 0) {
     return -INFINITY;
   }
-  return log10f(v[0]*v[0] + v[1]*v[1]);
+  return fast_log10f(v[0]*v[0] + v[1]*v[1]);
 }
 
 /*
@@ -446,7 +532,7 @@ float logmag(float *v)
  */ 
 float phase(float *v)
 {
-  return 2 * atan2f(v[1], v[0]) / M_PI;
+  return fast_atan2f(v[1], v[0]) * (float)(2 / M_PI);
 }
 
 /*
@@ -454,7 +540,7 @@ float phase(float *v)
  */ 
 float linear(float *v)
 {
-  return - sqrtf(v[0]*v[0] + v[1]*v[1]) * 8;
+  return - fast_sqrtf(v[0]*v[0] + v[1]*v[1]) * 8;
 }
 
 /*
@@ -462,12 +548,166 @@ float linear(float *v)
  */ 
 float swr(float *v)
 {
-  float x = sqrtf(v[0]*v[0] + v[1]*v[1]);
+  float x = fast_sqrtf(v[0]*v[0] + v[1]*v[1]);
   if (x > 1)
     return INFINITY;
   return (1 + x)/(1 - x);
 }
 
+/*
+=======================================
+    曲线存储（memory）和运算
+    两个通道各存一份 measured 快照，按块浮点存成 int16：
+    每个通道一个公共指数，值 = data * 2^exp，
+    相对最大值的分辨率约 -90dB，比 float 省一半内存。
+    运算按通道设置，在 trace_into_index() 之前逐点计算。
+    存储时记下点数和扫频范围，与当前扫频不一致时不能逐点对应，
+    trace_memory_get 拒绝读出，运算不起作用
+=======================================
+*/
+typedef struct {
+  int16_t data[2][SWEEP_POINTS][2];
+  float scale[2];      // 2^exp，读出时乘
+  uint32_t start;      // 存储时的扫频范围
+  uint32_t stop;
+  int16_t points;
+  uint8_t valid;
+} trace_memory_t;
+
+static trace_memory_t trace_memory;
+uint8_t trace_math[2] = { MATH_OFF, MATH_OFF };
+
+void trace_memory_store(void)
+{
+  int ch, i, k, e;
+  float max, scale;
+
+  for (ch = 0; ch < 2; ch++) {
+    max = 0;
+    for (i = 0; i < sweep_points; i++)
+      for (k = 0; k < 2; k++)
+        if (fabsf(measured[ch][i][k]) > max)
+          max = fabsf(measured[ch][i][k]);
+    frexpf(max, &e);  // max < 2^e
+    e -= 15;
+    scale = ldexpf(1, -e);
+    for (i = 0; i < sweep_points; i++) {
+      for (k = 0; k < 2; k++) {
+        int32_t v = (int32_t)(measured[ch][i][k] * scale + (measured[ch][i][k] < 0 ? -0.5f : 0.5f));
+        if (v > 32767) v = 32767;
+        if (v < -32767) v = -32767;
+        trace_memory.data[ch][i][k] = v;
+      }
+    }
+    trace_memory.scale[ch] = ldexpf(1, e);
+  }
+  trace_memory.start = frequencies[0];
+  trace_memory.stop = frequencies[sweep_points-1];
+  trace_memory.points = sweep_points;
+  trace_memory.valid = TRUE;
+  force_set_markmap();
+}
+
+void trace_memory_clear(void)
+{
+  trace_memory.valid = FALSE;
+  trace_math[0] = trace_math[1] = MATH_OFF;
+  force_set_markmap();
+}
+
+/* 存储的数据与当前扫频逐点对应 */
+static int trace_memory_match(void)
+{
+  return trace_memory.valid && trace_memory.points == sweep_points
+      && trace_memory.start == frequencies[0]
+      && trace_memory.stop == frequencies[sweep_points-1];
+}
+
+int trace_memory_get(int ch, int i, float v[2])
+{
+  if (!trace_memory_match())
+    return FALSE;
+  v[0] = trace_memory.data[ch][i][0] * trace_memory.scale[ch];
+  v[1] = trace_memory.data[ch][i][1] * trace_memory.scale[ch];
+  return TRUE;
+}
+
+void set_trace_math(int ch, int math)
+{
+  if (!trace_memory_match())
+    math = MATH_OFF;
+  if (trace_math[ch] != math) {
+    trace_math[ch] = math;
+    force_set_markmap();
+  }
+}
+
+/*
+ * 返回通道 ch 第 i 点实际显示的值
+ * 没有运算时直接返回 coeff，否则结果放在 buf
+ */
+float *trace_math_coeff(int ch, int i, float coeff[2], float buf[2])
+{
+  float m[2], d;
+
+  if (trace_math[ch] == MATH_OFF || !trace_memory_get(ch, i, m))
+    return coeff;
+  if (trace_math[ch] == MATH_SUB) {  // data - mem
+    buf[0] = coeff[0] - m[0];
+    buf[1] = coeff[1] - m[1];
+  } else {  // data / mem
+    d = m[0]*m[0] + m[1]*m[1];
+    if (d == 0) {
+      buf[0] = buf[1] = 0;
+    } else {
+      d = 1 / d;
+      buf[0] = (coeff[0]*m[0] + coeff[1]*m[1]) * d;
+      buf[1] = (coeff[1]*m[0] - coeff[0]*m[1]) * d;
+    }
+  }
+  return buf;
+}
+
+/*
+=======================================
+    群时延 tau = -dphi / (2*pi*df)，单位 ns
+    相邻两点的相位差直接取 g[i] * conj(g[i-1]) 的辐角，
+    每点只调用一次 atan2，累加起来就是解卷绕后的相位
+    （要求相邻两点相位差小于 180 度）。
+    孔径为 ±groupdelay_aperture 个点，首尾相减，一次线性扫描
+=======================================
+*/
+float groupdelay[2][SWEEP_POINTS];
+int8_t groupdelay_aperture = 1;  // 不放进 properties_t，以前保存的设置仍然有效
+
+void group_delay_calc(int ch, float data[SWEEP_POINTS][2], float delay[SWEEP_POINTS])
+{
+  static float turns[SWEEP_POINTS];  // 解卷绕后的相位，单位 圈
+  int a = groupdelay_aperture;
+  int i, lo, hi;
+  float buf[2][2];
+  float *p0, *p1;
+
+  turns[0] = 0;
+  p0 = trace_math_coeff(ch, 0, data[0], buf[0]);
+  for (i = 1; i < sweep_points; i++) {
+    p1 = trace_math_coeff(ch, i, data[i], buf[i&1]);
+    float re = p1[0] * p0[0] + p1[1] * p0[1];
+    float im = p1[1] * p0[0] - p1[0] * p0[1];
+    turns[i] = turns[i-1] + fast_atan2f(im, re) * (float)(1 / (2 * M_PI));
+    p0 = p1;
+  }
+  for (i = 0; i < sweep_points; i++) {
+    lo = i - a < 0 ? 0 : i - a;
+    hi = i + a >= sweep_points ? sweep_points - 1 : i + a;
+    if (frequencies[hi] == frequencies[lo]) {  // CW 模式
+      delay[i] = 0;
+      continue;
+    }
+    delay[i] = -(turns[hi] - turns[lo]) * 1e9f / (float)(frequencies[hi] - frequencies[lo]);
+  }
+}
+
 #define RADIUS ((HEIGHT-1)/2)
 void
 cartesian_scale(float re, float im, int *xp, int *yp, float scale)
@@ -503,6 +743,9 @@ uint32_t trace_into_index(int x, int t, int i, float coeff[2])
   case TRC_PHASE:
     v = refpos - phase(coeff) * scale;
     break;
+  case TRC_DELAY:
+    v = refpos - groupdelay[trace[t].channel][i] * scale;
+    break;
   case TRC_LINEAR:
     v = refpos + linear(coeff) * scale;
     break;
@@ -522,6 +765,92 @@ uint32_t trace_into_index(int x, int t, int i, float coeff[2])
   return INDEX(x +CELLOFFSETX, y, i);
 }
 
+#if USE_FIXED_POINT
+/*
+ * trace_into_index 的定点版本
+ * 每条曲线的 refpos/scale 在 plot_into_index 里只换算一次，
+ * 逐点计算全部用整数，v 统一写成 refpos + val * (1/scale)
+ */
+typedef struct {
+  int32_t yref;  // (8 - refpos) * GRIDY, Q16
+  int32_t k;     // GRIDY / scale, Q16
+  int32_t kxy;   // RADIUS / scale, Q16
+} trace_coord_t;
+
+static int32_t float_to_q16_sat(float f)
+{
+  if (f > 32767) return 0x7fffffff;
+  if (f < -32767) return -0x7fffffff;
+  return (int32_t)(f * 65536);
+}
+
+static void trace_coord_init(trace_coord_t *tc, int t)
+{
+  float scale = 1 / trace[t].scale;
+  tc->yref = float_to_q16_sat((8 - trace[t].refpos) * GRIDY);
+  tc->k = float_to_q16_sat(GRIDY * scale);
+  tc->kxy = float_to_q16_sat(RADIUS * scale);
+}
+
+static int cartesian_scale_fix(fix_t v, int32_t k)
+{
+  int neg = v < 0;
+  int64_t x = ((int64_t)(neg ? -v : v) * k) >> (FIX_Q + 16);  // 与 (int) 强制转换一样向 0 取整
+  if (x > RADIUS) x = RADIUS;
+  return neg ? -(int)x : (int)x;
+}
+
+static uint32_t trace_into_index_fix(int x, const trace_coord_t *tc, int t, int i, float coeff[2])
+{
+  fix_t re = float_to_fix(coeff[0]);
+  fix_t im = float_to_fix(coeff[1]);
+  uint64_t mag2 = (uint64_t)((int64_t)re * re) + (uint64_t)((int64_t)im * im);  // Q48
+  int32_t val;
+  int64_t y;
+
+  switch (trace[t].type) {
+  case TRC_LOGMAG:
+    val = fix_log2(mag2, 2*FIX_Q);
+    if (val == FIX_LOG_ZERO)  // -INF，画在最底部
+      return INDEX(x +CELLOFFSETX, 8*GRIDY, i);
+    val = -(int32_t)(((int64_t)val * 19728) >> 16);  // * log10(2)
+    break;
+  case TRC_PHASE:
+    val = -fix_atan2(im, re);
+    break;
+  case TRC_DELAY:
+    val = -float_to_q16_sat(groupdelay[trace[t].channel][i]);
+    break;
+  case TRC_LINEAR:
+    val = -(int32_t)(fix_sqrt64(mag2) >> (FIX_Q - 3 - 16));  // |gamma| * 8
+    break;
+  case TRC_SWR:
+  {
+    uint32_t g = fix_sqrt64(mag2);  // Q24
+    if (g >= FIX_ONE)  // INFINITY，画在最顶部
+      return INDEX(x +CELLOFFSETX, 0, i);
+    // swr 太大时限制一下，已经远超出屏幕
+    int64_t swr = ((int64_t)(FIX_ONE + g) << 16) / (FIX_ONE - g);
+    if (swr > 0x7fffffff) swr = 0x7fffffff;
+    val = (1L << 16) - (int32_t)swr;
+    break;
+  }
+  case TRC_SMITH:
+  //case TRC_ADMIT:
+  case TRC_POLAR:
+    return INDEX(WIDTH/2 + cartesian_scale_fix(re, tc->kxy) +CELLOFFSETX,
+                 HEIGHT/2 - cartesian_scale_fix(im, tc->kxy), i);
+  default:
+    val = 0;
+    break;
+  }
+  y = tc->yref + (((int64_t)val * tc->k) >> 16);
+  if (y < 0) y = 0;
+  if (y > (8*GRIDY << 16)) y = 8*GRIDY << 16;
+  return INDEX(x +CELLOFFSETX, (int)(y >> 16), i);
+}
+#endif
+
 int
 string_value_with_prefix(char *buf, int len, float val, char unit)
 {
@@ -561,11 +890,11 @@ string_value_with_prefix(char *buf, int len, float val, char unit)
   }
 
   if (val < 10) {
-    n = chsnprintf(buf, len, "%.2f", val);
+    n = fmt_fixed(buf, len, val, 2);
   } else if (val < 100) {
-    n = chsnprintf(buf, len, "%.1f", val);
+    n = fmt_fixed(buf, len, val, 1);
   } else {
-    n = chsnprintf(buf, len, "%d", (int)val);
+    n = fmt_uint(buf, len, (uint32_t)val, 1);
   }
 
   if (prefix)
@@ -602,38 +931,51 @@ gamma2imp(char *buf, int len, const float coeff[2], uint32_t frequency)
 }
 
 void
-trace_get_value_string(int t, char *buf, int len, float coeff[2], uint32_t frequency)
+trace_get_value_string(int t, char *buf, int len, int i)
 {
+  float tmp[2];
+  float *coeff = trace_math_coeff(trace[t].channel, i, measured[trace[t].channel][i], tmp);
+  uint32_t frequency = frequencies[i];
   float v;
+  int n;
   switch (trace[t].type) {
   case TRC_LOGMAG:
     v = logmag(coeff);
-    if (v == -INFINITY)
+    if (v == -INFINITY) {
       chsnprintf(buf, len, "-INF dB");
-    else
-      chsnprintf(buf, len, "%.2fdB", v * 10);
+    } else {
+      n = fmt_fixed(buf, len, v * 10, 2);
+      fmt_str(buf+n, len-n, "dB");
+    }
     break;
   case TRC_PHASE:
     v = phase(coeff);
-    chsnprintf(buf, len, "%.2f" S_DEGREE, v * 90);
+    n = fmt_fixed(buf, len, v * 90, 2);
+    fmt_str(buf+n, len-n, S_DEGREE);
+    break;
+  case TRC_DELAY:
+    string_value_with_prefix(buf, len, groupdelay[trace[t].channel][i] * 1e-9f, 's');
     break;
   case TRC_LINEAR:
     v = linear(coeff);
-    chsnprintf(buf, len, "%.2f", v);
+    fmt_fixed(buf, len, v, 2);
     break;
   case TRC_SWR:
     v = swr(coeff);
     if (v == INFINITY)
       chsnprintf(buf, len, "INF");
     else
-      chsnprintf(buf, len, "%.2f", v);
+      fmt_fixed(buf, len, v, 2);
     break;
   case TRC_SMITH:
     gamma2imp(buf, len, coeff, frequency);
     break;
   //case TRC_ADMIT:
   case TRC_POLAR:
-    chsnprintf(buf, len, "%.2f %.2fj", coeff[0], coeff[1]);
+    n = fmt_fixed(buf, len, coeff[0], 2);
+    n += fmt_str(buf+n, len-n, " ");
+    n += fmt_fixed(buf+n, len-n, coeff[1], 2);
+    fmt_str(buf+n, len-n, "j");
     break;
   default:
     chsnprintf(buf, len, "");
@@ -641,6 +983,15 @@ trace_get_value_string(int t, char *buf, int len, float coeff[2], uint32_t frequ
   }
 }
 
+// "名称 刻度单位"，刻度一位小数
+static void
+trace_info_scale(char *buf, int len, const char *name, float scale, const char *unit)
+{
+  int n = chsnprintf(buf, len, "%s ", name);
+  n += fmt_fixed(buf+n, len-n, scale, 1);
+  fmt_str(buf+n, len-n, unit);
+}
+
 void
 trace_get_info(int t, char *buf, int len)
 {
@@ -660,37 +1011,37 @@ trace_get_info(int t, char *buf, int len)
     break;
   case TRC_DELAY:
     if (config.lang == LANG_CN)
-      chsnprintf(buf, len, "%s %.1f/", "\x87\x88\x89\x8A\x8B\x8C", trace[t].scale);
+      trace_info_scale(buf, len, "\x87\x88\x89\x8A\x8B\x8C", trace[t].scale, "ns/");
     else
-      chsnprintf(buf, len, "%s %.1f/", type, trace[t].scale);
+      trace_info_scale(buf, len, type, trace[t].scale, "ns/");
     break;
   case TRC_SMITH:
   //case TRC_ADMIT:
     if (config.lang == LANG_CN)
-      chsnprintf(buf, len, "%s %.1fFS", "\x8D\x8E\x8F\x90\x91\x92", trace[t].scale);
+      trace_info_scale(buf, len, "\x8D\x8E\x8F\x90\x91\x92", trace[t].scale, "FS");
     else
-      chsnprintf(buf, len, "%s %.1fFS", type, trace[t].scale);
+      trace_info_scale(buf, len, type, trace[t].scale, "FS");
     break;
   case TRC_POLAR:
     if (config.lang == LANG_CN)
-      chsnprintf(buf, len, "%s %.1fFS", "\x93\x94\x95\x96\x97\x98", trace[t].scale);
+      trace_info_scale(buf, len, "\x93\x94\x95\x96\x97\x98", trace[t].scale, "FS");
     else
-      chsnprintf(buf, len, "%s %.1fFS", type, trace[t].scale);
+      trace_info_scale(buf, len, type, trace[t].scale, "FS");
     break;
   case TRC_LINEAR:
     if (config.lang == LANG_CN)
-      chsnprintf(buf, len, "%s %.1f/", "\x7F\x80\x81\x82\x83\x84", trace[t].scale);
+      trace_info_scale(buf, len, "\x7F\x80\x81\x82\x83\x84", trace[t].scale, "/");
     else
-      chsnprintf(buf, len, "%s %.1f/", type, trace[t].scale);
+      trace_info_scale(buf, len, type, trace[t].scale, "/");
     break;
   case TRC_SWR:
     if (config.lang == LANG_CN)
-      chsnprintf(buf, len, "%s %.1f/", "\x99\x9A\x9B\x9C\x9D\x9E", trace[t].scale);
+      trace_info_scale(buf, len, "\x99\x9A\x9B\x9C\x9D\x9E", trace[t].scale, "/");
     else
-      chsnprintf(buf, len, "%s %.1f/", type, trace[t].scale);
+      trace_info_scale(buf, len, type, trace[t].scale, "/");
     break;
   default:
-    chsnprintf(buf, len, "%s %.1f/", type, trace[t].scale);
+    trace_info_scale(buf, len, type, trace[t].scale, "/");
     break;
   }
 }
@@ -703,21 +1054,63 @@ trace_get_info(int t, char *buf, int len)
 static inline void
 mark_map(int x, int y)
 {
-  if (y >= 0 && y < 8 && x >= 0 && x < 16)  // 对应 8*32=256 16*32=512
-    markmap[current_mappage][y] |= 1<<x;
+  if (y >= 0 && y < 8 && x >= 0 && x < MARK_COLS)  // 对应 8*32=256 16*32=512
+    markmap[current_mappage][x] |= 0xfUL << (y * (CELLHEIGHT/MARK_STRIP));
 }
 
-static inline int
-is_mapmarked(int x, int y)
+/*
+ * 标记一个矩形区域，坐标与 trace_index 相同，x 方向以 CELL 为单位，
+ * y 方向以 8 像素条带为单位
+ */
+static void
+mark_rect(int x, int y, int w, int h)
 {
-  uint16_t bit = 1<<x;
-  return (markmap[0][y] & bit) || (markmap[1][y] & bit);
+  uint32_t bits;
+  int m, m1, s0, s1;
+
+  if (x < 0) { w += x; x = 0; }
+  if (y < 0) { h += y; y = 0; }
+  if (w <= 0 || h <= 0)
+    return;
+  m = x / CELLWIDTH;
+  m1 = (x + w - 1) / CELLWIDTH;
+  s0 = y / MARK_STRIP;
+  s1 = (y + h - 1) / MARK_STRIP;
+  if (s0 > 31)
+    return;
+  if (s1 > 31)
+    s1 = 31;
+  bits = (0xffffffffUL >> (31 - (s1 - s0))) << s0;
+  for (; m <= m1 && m < MARK_COLS; m++)
+    markmap[current_mappage][m] |= bits;
 }
 
-static inline void
-markmap_upperarea(void)
+#if USE_ILI_LCD
+#define INFO_LINE_HEIGHT  7
+#else
+#define INFO_LINE_HEIGHT  13
+#endif
+
+/*
+ * 曲线和标记信息所占的行，见 cell_draw_marker_info。
+ * 每次扫描只有曲线信息变化，with_marker 时再加上标记频率和差值两行。
+ * 曲线数减少时上次画过的行也要重画
+ */
+static void
+markmap_upperarea(int with_marker)
 {
-  markmap[current_mappage][0] |= 0xffff;
+  static int last_j;
+  int t, j = 0, n, lines;
+
+  for (t = 0; t < TRACES_MAX; t++)
+    if (trace[t].enabled)
+      j++;
+  n = j > last_j ? j : last_j;
+  last_j = j;
+  lines = (n + 1) / 2;
+  if (with_marker)
+    lines = n / 2 + 2;  // 频率在第 j/2 行，差值在下一行
+  mark_rect(0, 0, MARK_COLS * CELLWIDTH, 1 + lines * INFO_LINE_HEIGHT);
 }
 
 static void
@@ -736,54 +1129,133 @@ void
 force_set_markmap(void)
 {
   memset(markmap[current_mappage], 0xff, sizeof markmap[current_mappage]);
+  marker_info_valid = FALSE;  // 曲线设置或数据可能改了，不只是新的扫描
+}
+
+/*
+ * 曲线变化检测
+ * plot_into_index 把新坐标和上次的比较，只标记变化的点两侧的线段，
+ * 线段旧的位置也同时标记，保证被擦掉。没有变化的曲线不再重画
+ */
+#define INDEX_WORDS         ((SWEEP_POINTS+31)/32)
+#define INDEX_CHANGED(t, i) (index_changed[t][(i) >> 5] & (1UL << ((i) & 31)))
+
+static uint32_t index_changed[TRACES_MAX][INDEX_WORDS];
+static uint8_t indexed_traces;    // bit t: trace_index[t] 是屏幕上画着的曲线
+static uint16_t indexed_points;
+
+static void
+mark_segment(uint32_t a, uint32_t b)
+{
+  int x0 = CELL_X(a), y0 = CELL_Y(a);
+  int x1 = CELL_X(b), y1 = CELL_Y(b);
+  mark_rect(x0 < x1 ? x0 : x1, y0 < y1 ? y0 : y1,
+            (x0 < x1 ? x1 - x0 : x0 - x1) + 1,
+            (y0 < y1 ? y1 - y0 : y0 - y1) + 1);
 }
 
 void
 mark_cells_from_index(void)
 {
-  int t;
-  /* mark cells between each neighber points */
+  int t, i;
+  /* mark strips covered by each changed segment between neighbour points */
   for (t = 0; t < TRACES_MAX; t++) {
     if (!trace[t].enabled)
       continue;
-    int x0 = CELL_X(trace_index[t][0]);
-    int y0 = CELL_Y(trace_index[t][0]);
-    int m0 = x0 >> 5;
-    int n0 = y0 >> 5;
-    int i;
-    mark_map(m0, n0);
+    if (index_changed[t][0] & 1)
+      mark_rect(CELL_X(trace_index[t][0]), CELL_Y(trace_index[t][0]), 1, 1);
     for (i = 1; i < sweep_points; i++) {
-      int x1 = CELL_X(trace_index[t][i]);
-      int y1 = CELL_Y(trace_index[t][i]);
-      int m1 = x1 >> 5;
-      int n1 = y1 >> 5;
-      while (m0 != m1 || n0 != n1) {
-        if (m0 == m1) {
-          if (n0 < n1) n0++; else n0--;
-        } else if (n0 == n1) {
-          if (m0 < m1) m0++; else m0--;
-        } else {
-          int x = (m0 < m1) ? (m0 + 1)<<5 : m0<<5;
-          int y = (n0 < n1) ? (n0 + 1)<<5 : n0<<5;
-          int sgn = (n0 < n1) ? 1 : -1;
-          if (sgn*(y-y0)*(x1-x0) < sgn*(x-x0)*(y1-y0)) {
-            if (m0 < m1) m0++;
-            else m0--;
-          } else {
-            if (n0 < n1) n0++;
-            else n0--;
-          }
-        }
-        mark_map(m0, n0);
-      }
-      x0 = x1;
-      y0 = y1;
-      m0 = m1;
-      n0 = n1;
+      if (!INDEX_CHANGED(t, i - 1) && !INDEX_CHANGED(t, i))
+        continue;
+      mark_segment(trace_index[t][i - 1], trace_index[t][i]);
     }
   }
 }
 
+/*
+=======================================
+    Smith/极坐标曲线的 CELL -> 线段索引
+    这两种曲线不能按 x 二分查找，这里把每条线段 (i-1, i)
+    按外接矩形登记到它覆盖的 CELL，draw_cell 只画登记过的线段。
+    各曲线共用 seg_pool，放不下时该曲线退回逐段绘制
+=======================================
+*/
+#define CELL_COLS       ((AREA_WIDTH_NORMAL+CELLWIDTH-1)/CELLWIDTH)
+#define CELL_ROWS       ((HEIGHT+CELLHEIGHT-1)/CELLHEIGHT)
+#define SEG_POOL_SIZE   (SWEEP_POINTS*5)
+
+static uint16_t seg_start[TRACES_MAX][CELL_COLS*CELL_ROWS+1];
+static uint8_t seg_pool[SEG_POOL_SIZE];  // 线段终点序号 i
+// seg_pool 按 uint8_t 存序号，扫描点数不能超过 256
+typedef char seg_pool_index_fits[SWEEP_POINTS <= 256 ? 1 : -1];
+static uint8_t seg_indexed;              // bit t: 曲线 t 已建立索引
+
+/*
+ * 线段 (i-1, i) 覆盖的 CELL 范围，超出绘图区返回 0
+ */
+static int
+segment_cells(uint32_t *index, int i, int *m0, int *m1, int *n0, int *n1)
+{
+  int xa = CELL_X(index[i-1]) >> 5;
+  int xb = CELL_X(index[i]) >> 5;
+  int ya = CELL_Y(index[i-1]) >> 5;
+  int yb = CELL_Y(index[i]) >> 5;
+
+  *m0 = xa < xb ? xa : xb;
+  *m1 = xa < xb ? xb : xa;
+  *n0 = ya < yb ? ya : yb;
+  *n1 = ya < yb ? yb : ya;
+  if (*m1 >= CELL_COLS) *m1 = CELL_COLS - 1;
+  if (*n1 >= CELL_ROWS) *n1 = CELL_ROWS - 1;
+  return *m0 <= *m1 && *n0 <= *n1;
+}
+
+static void
+build_segment_index(void)
+{
+  int t, i, m, n, k;
+  int m0, m1, n0, n1;
+  uint16_t used = 0;
+
+  seg_indexed = 0;
+  for (t = 0; t < TRACES_MAX; t++) {
+    uint16_t *start = seg_start[t];
+    if (!trace[t].enabled)
+      continue;
+    if (trace[t].type != TRC_SMITH && trace[t].type != TRC_POLAR)
+      continue;
+
+    // 先统计每个 CELL 的线段数，存在 start[k+1]，再累加成起始位置
+    memset(start, 0, sizeof seg_start[t]);
+    for (i = 1; i < sweep_points; i++) {
+      if (!segment_cells(trace_index[t], i, &m0, &m1, &n0, &n1))
+        continue;
+      for (n = n0; n <= n1; n++)
+        for (m = m0; m <= m1; m++)
+          start[n * CELL_COLS + m + 1]++;
+    }
+    start[0] = used;
+    for (k = 0; k < CELL_COLS*CELL_ROWS; k++)
+      start[k+1] += start[k];
+    if (start[CELL_COLS*CELL_ROWS] > SEG_POOL_SIZE)
+      continue;
+
+    // 填表时 start[k] 作为写指针，填完后等于原来的 start[k+1]
+    for (i = 1; i < sweep_points; i++) {
+      if (!segment_cells(trace_index[t], i, &m0, &m1, &n0, &n1))
+        continue;
+      for (n = n0; n <= n1; n++)
+        for (m = m0; m <= m1; m++)
+          seg_pool[start[n * CELL_COLS + m]++] = i;
+    }
+    for (k = CELL_COLS*CELL_ROWS; k > 0; k--)
+      start[k] = start[k-1];
+    start[0] = used;
+    used = start[CELL_COLS*CELL_ROWS];
+    seg_indexed |= 1 << t;
+  }
+}
+
 /*
 =======================================
     标记要画的点
@@ -792,21 +1264,76 @@ mark_cells_from_index(void)
 void plot_into_index(float measured[2][SWEEP_POINTS][2])
 {
   int i, t;
+  float buf[2];
+  int delay_ch = 0;
+  for (t = 0; t < TRACES_MAX; t++)
+    if (trace[t].enabled && trace[t].type == TRC_DELAY)
+      delay_ch |= 1 << trace[t].channel;
+  for (i = 0; i < 2; i++)
+    if (delay_ch & (1 << i))
+      group_delay_calc(i, measured[i], groupdelay[i]);
+#if USE_FIXED_POINT
+  trace_coord_t tc[TRACES_MAX];
+  for (t = 0; t < TRACES_MAX; t++)
+    if (trace[t].enabled)
+      trace_coord_init(&tc[t], t);
+#endif
+  uint32_t prev_old[TRACES_MAX];
+  uint8_t fresh = 0;  // 上次没有画过的曲线，所有点都算变化
+
+  if (indexed_points != sweep_points) {  // 点数变了，x 坐标全变
+    force_set_markmap();
+    indexed_traces = 0;
+    indexed_points = sweep_points;
+  }
+  for (t = 0; t < TRACES_MAX; t++) {
+    if (trace[t].enabled) {
+      if (!(indexed_traces & (1 << t)))
+        fresh |= 1 << t;
+    } else if (indexed_traces & (1 << t)) {  // 关闭的曲线要擦掉
+      for (i = 1; i < sweep_points; i++)
+        mark_segment(trace_index[t][i - 1], trace_index[t][i]);
+    }
+  }
+  memset(index_changed, 0, sizeof index_changed);
+
   for (i = 0; i < sweep_points; i++) {
     int x = i * (WIDTH-1) / (sweep_points-1);  // WIDTH 为曲线区域宽度
     for (t = 0; t < TRACES_MAX; t++) {
       if (!trace[t].enabled)
         continue;
       int n = trace[t].channel;
-      trace_index[t][i] = trace_into_index(x, t, i, measured[n][i]);
+      float *coeff = trace_math_coeff(n, i, measured[n][i], buf);
+      uint32_t old = trace_index[t][i];
+#if USE_FIXED_POINT
+      uint32_t v = trace_into_index_fix(x, &tc[t], t, i, coeff);
+#else
+      uint32_t v = trace_into_index(x, t, i, coeff);
+#endif
+      if (fresh & (1 << t)) {
+        index_changed[t][i >> 5] |= 1UL << (i & 31);
+      } else if (v != old) {
+        index_changed[t][i >> 5] |= 1UL << (i & 31);
+        if (i > 0)
+          mark_segment(prev_old[t], old);
+        if (i < sweep_points - 1)
+          mark_segment(old, trace_index[t][i + 1]);
+      }
+      prev_old[t] = old;
+      trace_index[t][i] = v;
     }
   }
+  indexed_traces = 0;
+  for (t = 0; t < TRACES_MAX; t++)
+    if (trace[t].enabled)
+      indexed_traces |= 1 << t;
 #if 0
   for (t = 0; t < TRACES_MAX; t++)
     if (trace[t].enabled && trace[t].polar)
       quicksort(trace_index[t], 0, sweep_points);
 #endif
 
+  build_segment_index();
   mark_cells_from_index();  // 标记 CELL
   markmap_all_markers();
 }
@@ -842,13 +1369,13 @@ cell_drawline(int w, int h, int x0, int y0, int x1, int y1, int c)
       if (dy > 0) {
         while (dy-- > 0) {
           if (y0 >= 0 && y0 < h && x0 >= 0 && x0 < w)
-            lcd_buffer[y0*w+x0] |= c;
+            cell_buffer[y0*w+x0] |= c;
           y0++;
         }
       } else {
         while (dy++ < 0) {
           if (y0 >= 0 && y0 < h && x0 >= 0 && x0 < w)
-            lcd_buffer[y0*w+x0] |= c;
+            cell_buffer[y0*w+x0] |= c;
           y0--;
         }
       }
@@ -856,7 +1383,7 @@ cell_drawline(int w, int h, int x0, int y0, int x1, int y1, int c)
     } else {
       while (dx-- > 0) {
         if (y0 >= 0 && y0 < h && x0 >= 0 && x0 < w)
-          lcd_buffer[y0*w+x0] |= c;
+          cell_buffer[y0*w+x0] |= c;
         x0++;
       }
       y0 += dy;
@@ -948,19 +1475,17 @@ draw_refpos(int w, int h, int x, int y, int c)
       int y0 = y - j;
       int y1 = y + j;
       if (y0 >= 0 && y0 < h && x0 >= 0 && x0 < w)
-        lcd_buffer[y0*w+x0] = c;
+        cell_buffer[y0*w+x0] = c;
       if (j != 0 && y1 >= 0 && y1 < h && x0 >= 0 && x0 < w)
-        lcd_buffer[y1*w+x0] = c;
+        cell_buffer[y1*w+x0] = c;
     }
   }
 }
 
 
 void
-cell_draw_refpos(int m, int n, int w, int h)
+cell_draw_refpos(int x0, int y0, int w, int h)
 {
-  int x0 = m * CELLWIDTH;
-  int y0 = n * CELLHEIGHT;
   int t;
   for (t = 0; t < TRACES_MAX; t++) {
     if (!trace[t].enabled)
@@ -990,7 +1515,7 @@ draw_marker(int w, int h, int x, int y, int c, int ch)
           cc = 0;
       }
       if (y0 >= 0 && y0 < h && x0 >= 0 && x0 < w)
-        lcd_buffer[y0*w+x0] = cc;
+        cell_buffer[y0*w+x0] = cc;
     }
   }
 }
@@ -1027,10 +1552,8 @@ search_nearest_index(int x, int y, int t)
 }
 
 void
-cell_draw_markers(int m, int n, int w, int h)
+cell_draw_markers(int x0, int y0, int w, int h)
 {
-  int x0 = m * CELLWIDTH;
-  int y0 = n * CELLHEIGHT;
   int t, i;
   for (i = 0; i < 4; i++) {
     if (!markers[i].enabled)
@@ -1059,20 +1582,7 @@ markmap_marker(int marker)
     uint32_t index = trace_index[t][markers[marker].index];
     int x = CELL_X(index);
     int y = CELL_Y(index);
-    int m = x>>5;
-    int n = y>>5;
-    mark_map(m, n);
-    if ((x&31) < 6)
-      mark_map(m-1, n);
-    if ((x&31) > 32-6)
-      mark_map(m+1, n);
-    if ((y&31) < 12) {
-      mark_map(m, n-1);
-      if ((x&31) < 6)
-        mark_map(m-1, n-1);
-      if ((x&31) > 32-6)
-        mark_map(m+1, n-1);
-    }
+    mark_rect(x - 5, y - 10, 11, 11);  // 与 draw_marker 的范围相同
   }
 }
 
@@ -1085,21 +1595,33 @@ markmap_all_markers(void)
       continue;
     markmap_marker(i);
   }
-  markmap_upperarea();
+  markmap_upperarea(FALSE);
 }
 
+/*
+=======================================
+    绘制统计，见 render 命令
+    render_test_frames 不为 0 时不限制每帧的像素数，全屏重绘在一帧内完成，
+    每帧减一，减到 0 的那一帧的统计存入 render_test_stats。
+    画面本身在主机上与保存的图比较，见 test/host/test_render.c
+=======================================
+*/
+render_stats_t render_stats;
+render_stats_t render_test_stats;
+volatile uint8_t render_test_frames;
+
 /*
 =======================================
     把图像信息放到 CELL 中
+    m  CELL 列
+    y0 起始行，h 行数，h <= CELLHEIGHT，可以跨两行 CELL
 =======================================
 */
-void draw_cell(int m, int n)
+void draw_cell(int m, int y0, int h)
 {
   int x0 = m * CELLWIDTH;
-  int y0 = n * CELLHEIGHT;
   int x0off = x0 - CELLOFFSETX;
   int w = CELLWIDTH;
-  int h = CELLHEIGHT;
   int x, y;
   int i0, i1;
   int i;
@@ -1133,31 +1655,25 @@ void draw_cell(int m, int n)
     for (x = 0; x < w; x++) {
       uint16_t c = rectangular_grid_x(x+x0off);
       for (y = 0; y < h; y++)
-        lcd_buffer[y * w + x] = c;
+        cell_buffer[y * w + x] = c;
     }
     for (y = 0; y < h; y++) {
       uint16_t c = rectangular_grid_y(y+y0);
       for (x = 0; x < w; x++)
         if (x+x0off >= 0 && x+x0off <= WIDTH)
-          lcd_buffer[y * w + x] |= c;
+          cell_buffer[y * w + x] |= c;
     }
   } else {
-    memset(lcd_buffer, 0, sizeof lcd_buffer);
+    memset(cell_buffer, 0, w * h * sizeof cell_buffer[0]);
   }
   if (grid_mode & (GRID_SMITH|GRID_ADMIT|GRID_POLAR)) {
-    for (y = 0; y < h; y++) {
-      for (x = 0; x < w; x++) {
-        uint16_t c = 0;
-        if (grid_mode & GRID_SMITH)
-          c = smith_grid(x+x0off, y+y0);
-        else if (grid_mode & GRID_ADMIT)
-          c = smith_grid3(x+x0off, y+y0);
-        //c = smith_grid2(x+x0, y+y0, 0.5);
-        else if (grid_mode & GRID_POLAR)
-          c = polar_grid(x+x0off, y+y0);
-        lcd_buffer[y * w + x] |= c;
-      }
-    }
+    if (grid_mode & GRID_SMITH)
+      grid_mask_update(GRID_SMITH);
+    else if (grid_mode & GRID_ADMIT)
+      grid_mask_update(GRID_ADMIT);
+    else
+      grid_mask_update(GRID_POLAR);
+    cell_draw_grid_mask(cell_buffer, x0off, y0, w, h);
   }
   PULSE;
 
@@ -1194,11 +1710,24 @@ void draw_cell(int m, int n)
     if (trace[t].type != TRC_SMITH && trace[t].type != TRC_POLAR)
       continue;
 
+    if (seg_indexed & (1 << t)) {
+      // 只画经过本 CELL 的线段，跨两行 CELL 时重复的线段重画一次无妨
+      int n, j;
+      for (n = y0 / CELLHEIGHT; n <= (y0 + h - 1) / CELLHEIGHT; n++) {
+        int k = n * CELL_COLS + m;
+        for (j = seg_start[t][k]; j < seg_start[t][k+1]; j++) {
+          i = seg_pool[j];
+          int x1 = CELL_X(trace_index[t][i-1]);
+          int x2 = CELL_X(trace_index[t][i]);
+          int y1 = CELL_Y(trace_index[t][i-1]);
+          int y2 = CELL_Y(trace_index[t][i]);
+          cell_drawline(w, h, x1 - x0, y1 - y0, x2 - x0, y2 - y0, c);
+        }
+      }
+      continue;
+    }
+
     for (i = 1; i < sweep_points; i++) {
-      //uint32_t index = trace_index[t][i];
-      //uint32_t pindex = trace_index[t][i-1];
-      //if (!CELL_P(index, x0, y0) && !CELL_P(pindex, x0, y0))
-      //  continue;
       int x1 = CELL_X(trace_index[t][i-1]);
       int x2 = CELL_X(trace_index[t][i]);
       int y1 = CELL_Y(trace_index[t][i-1]);
@@ -1210,34 +1739,128 @@ void draw_cell(int m, int n)
 
   PULSE;
   //draw marker symbols on each trace
-  cell_draw_markers(m, n, w, h);
+  cell_draw_markers(x0, y0, w, h);
   // draw trace and marker info on the top
-  cell_draw_marker_info(m, n, w, h);
+  cell_draw_marker_info(x0, y0, w, h);
   PULSE;
 
   if (m == 0) // refpos 总在 m=0 的 Cell
-    cell_draw_refpos(m, n, w, h);
+    cell_draw_refpos(x0, y0, w, h);
 
-  nt35510_bulk_x2(OFFSETX + x0off, OFFSETY + y0, w, h);
+  nt35510_bulk_x2_dma(cell_buffer, OFFSETX + x0off, OFFSETY + y0, w, h);
+  cell_buffer_sel ^= 1;
+  cell_buffer = CELL_BUFFER(cell_buffer_sel);
 }
 
-void
-draw_all_cells(void)
+/*
+ * budget 为本帧最多送屏的像素数 (面板像素)，0 表示不限。
+ * 超出时剩下的条带留到下一帧，下一帧从没画完的那一列开始
+ */
+static void
+draw_cells(uint32_t budget)
 {
-  int m, n;
-  for (m = 0; m < (area_width+CELLWIDTH-1) / CELLWIDTH; m++)  // 0-9 -> 0-10
-    for (n = 0; n < (area_height+CELLHEIGHT-1) / CELLHEIGHT; n++) {  // 0-8
-      if (is_mapmarked(m, n)) // 只绘制标记的CELL
-        draw_cell(m, n);
-      //ui_process();
-      //if (operation_requested)
-      //  return;
+  static int start_col;
+  uint32_t pending[MARK_COLS];
+  int cols = (area_width+CELLWIDTH-1) / CELLWIDTH;  // 0-9 -> 0-10
+  int c, m, n;
+  int cells = 0;
+  int stop = FALSE;
+  uint32_t windows = lcd_windows;
+  uint32_t pixels = lcd_pixels;
+  uint32_t t0;
+
+  if (!(DWT->CTRL & DWT_CTRL_CYCCNTENA_Msk)) {  // 用 DWT 周期计数器计时
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+  }
+  t0 = DWT->CYCCNT;
+
+  memset(pending, 0, sizeof pending);
+  if (start_col >= cols)
+    start_col = 0;
+  for (c = 0; c < cols; c++) {
+    m = (start_col + c) % cols;
+    // 只绘制标记的条带，两页标记合并，保证旧位置也被擦除
+    uint32_t dirty = markmap[0][m] | markmap[1][m];
+    int s = 0;
+    if (stop) {
+      pending[m] = dirty;
+      continue;
+    }
+    while (s < 32 && s * MARK_STRIP < area_height) {
+      if (budget && lcd_pixels - pixels >= budget) {
+        pending[m] = dirty & (0xffffffffUL << s);
+        start_col = m;
+        stop = TRUE;
+        break;
+      }
+      if (!(dirty & (1UL << s))) {
+        s++;
+        continue;
+      }
+      // 相邻的条带合并成一个窗口，最高一个 CELL
+      for (n = 1; n < CELLHEIGHT / MARK_STRIP && s + n < 32; n++)
+        if (!(dirty & (1UL << (s + n))))
+          break;
+      draw_cell(m, s * MARK_STRIP, n * MARK_STRIP);
+      cells++;
+      s += n;
     }
+  }
 
   // keep current map for update
   swap_markmap();
   // clear map for next plotting
   clear_markmap();
+  // 没画完的留到下一帧
+  for (m = 0; m < MARK_COLS; m++)
+    markmap[current_mappage][m] |= pending[m];
+
+  // 最后一个 CELL 可能还在 DMA 送屏，不计入时间
+  render_stats.frame++;
+  render_stats.cells = cells;
+  render_stats.windows = lcd_windows - windows;
+  render_stats.pixels = lcd_pixels - pixels;
+  render_stats.time_us = (DWT->CYCCNT - t0) / (SystemCoreClock / 1000000);
+  if (render_test_frames && --render_test_frames == 0)
+    render_test_stats = render_stats;
+}
+
+void
+draw_all_cells(void)
+{
+  draw_cells(0);
+}
+
+/*
+=======================================
+    帧率控制
+    扫描完成后距上一帧不到 FRAME_INTERVAL 就不重画，
+    快速扫描时不用每次都画；慢速扫描在扫描中途
+    每 FRAME_LIVE_INTERVAL 画一帧，没扫到的点显示上次的结果。
+    每帧最多送 FRAME_PIXEL_BUDGET 个像素
+=======================================
+*/
+#define FRAME_INTERVAL       50    // ms，最高 20 帧/秒
+#define FRAME_LIVE_INTERVAL  250   // ms
+#define FRAME_PIXEL_BUDGET   (800*480/2)
+
+static uint32_t frame_tick;
+
+int
+plot_frame_due(int sweeping)
+{
+  uint32_t interval = sweeping ? FRAME_LIVE_INTERVAL : FRAME_INTERVAL;
+  return chVTGetSystemTime() - frame_tick >= interval;
+}
+
+void
+plot_frame(void)
+{
+  frame_tick = chVTGetSystemTime();
+  plot_into_index(measured);
+  draw_cells(render_test_frames ? 0 : FRAME_PIXEL_BUDGET);
 }
 
 void
@@ -1247,12 +1870,8 @@ redraw_marker(int marker, int update_info)
   markmap_marker(marker);
 
   // mark cells on marker info
-  if (update_info) {
-      markmap[current_mappage][0] = 0xffff;
-      #if (USE_ILI_LCD == 0)
-      markmap[current_mappage][1] = 0xffff;
-      #endif
-  }
+  if (update_info)
+    markmap_upperarea(TRUE);
 
   draw_all_cells();
 }
@@ -1314,7 +1933,7 @@ void cell_drawchar_5x7(int w, int h, uint8_t ch, int x, int y, uint16_t fg, int
       bits = ~bits;
     for (r = 0; r < 5; r++) {
       if ((x+r) >= 0 && (x+r) < w && (0x8000 & bits)) 
-        lcd_buffer[(y+c)*w + (x+r)] = fg;
+        cell_buffer[(y+c)*w + (x+r)] = fg;
       bits <<= 1;
     }
   }
@@ -1361,7 +1980,7 @@ void cell_drawchar_06x13(int w, int h, uint8_t ch, int x, int y, uint16_t fg, in
       bits = ~bits;
     for (r = 0; r < 6; r++) {
       if ((x+r) >= 0 && (x+r) < w && (0x8000 & bits)) 
-        lcd_buffer[(y+c)*w + (x+r)] = fg;
+        cell_buffer[(y+c)*w + (x+r)] = fg;
       bits <<= 1;
     }
   }
@@ -1387,22 +2006,79 @@ cell_drawstring_invert_06x13(int w, int h, char *str, int x, int y, uint16_t fg,
   }
 }
 
+/*
+=======================================
+    mark 点信息字符串缓存
+    上面两行的每个 CELL 都要画一遍 mark 点信息。
+    字符串只在有新的扫描、换了 mark 点或 mark 点移动时重新格式化，
+    曲线设置等其他改动经 force_set_markmap 失效
+=======================================
+*/
+typedef struct {
+  char info[TRACES_MAX][24];   // trace_get_info
+  char value[TRACES_MAX][24];  // trace_get_value_string
+  char freq[24];               // mark 点频率
+  char delta[24];              // 与上一个 mark 点的频率差，空串表示不显示
+  uint32_t sweep;              // 以下为缓存的键：sweep_count
+  int8_t marker;               // active_marker
+  int8_t prev;                 // previous_marker
+  int16_t index;               // 两个 mark 点的序号
+  int16_t prev_index;
+} marker_info_t;
+
+static marker_info_t marker_info;
+
+static void marker_info_update(void)
+{
+  int t;
+  int idx = markers[active_marker].index;
+
+  for (t = 0; t < TRACES_MAX; t++) {
+    if (!trace[t].enabled)
+      continue;
+    trace_get_info(t, marker_info.info[t], sizeof marker_info.info[t]);
+    trace_get_value_string(t, marker_info.value[t], sizeof marker_info.value[t], idx);
+  }
+  frequency_string(marker_info.freq, sizeof marker_info.freq, frequencies[idx]);
+  marker_info.delta[0] = '\0';
+  if (active_marker != previous_marker && markers[previous_marker].enabled) {
+    int idx0 = markers[previous_marker].index;
+    frequency_string(marker_info.delta, sizeof marker_info.delta, frequencies[idx] - frequencies[idx0]);
+  }
+  marker_info.sweep = sweep_count;
+  marker_info.marker = active_marker;
+  marker_info.prev = previous_marker;
+  marker_info.index = idx;
+  marker_info.prev_index = markers[previous_marker].index;
+  marker_info_valid = TRUE;
+}
+
+static int marker_info_current(void)
+{
+  return marker_info_valid && marker_info.sweep == sweep_count &&
+         marker_info.marker == active_marker && marker_info.prev == previous_marker &&
+         marker_info.index == markers[active_marker].index &&
+         marker_info.prev_index == markers[previous_marker].index;
+}
+
 /*
 =======================================
     显示 mark 点的信息
 =======================================
 */
-void cell_draw_marker_info(int m, int n, int w, int h)
+void cell_draw_marker_info(int x0, int y0, int w, int h)
 {
-    char buf[24];
+    char buf[8];
     int t;
 
-    if (n < 0 || n > 1)
+    if (y0 >= 2 * CELLHEIGHT)
         return;
     if (active_marker < 0)
         return;
 
-    int idx = markers[active_marker].index;
+    if (!marker_info_current())
+        marker_info_update();
+
     int j = 0;
     for (t = 0; t < TRACES_MAX; t++) {
         if (!trace[t].enabled)
@@ -1413,31 +2089,27 @@ void cell_draw_marker_info(int m, int n, int w, int h)
         #else
         int ypos = 1 + (j/2)*13;
         #endif
-        xpos -= m * CELLWIDTH -CELLOFFSETX;
-        ypos -= n * CELLHEIGHT;
+        xpos -= x0 - CELLOFFSETX;
+        ypos -= y0;
         if (trace[t].channel == 0) {
             chsnprintf(buf, sizeof buf, "S11");
         } else {
             chsnprintf(buf, sizeof buf, "S21");
         }
-        if (n == 0)
+        if (y0 < CELLHEIGHT)  // 曲线信息都在第一行 CELL 内
         {
             #if USE_ILI_LCD
             cell_drawstring_invert_5x7(w, h, buf, xpos, ypos, config.trace_color[t], t == uistat.current_trace);
             xpos += 20;
-            trace_get_info(t, buf, sizeof buf);
-            cell_drawstring_5x7(w, h, buf, xpos, ypos, config.trace_color[t]);
+            cell_drawstring_5x7(w, h, marker_info.info[t], xpos, ypos, config.trace_color[t]);
             xpos += 64;
-            trace_get_value_string(t, buf, sizeof buf, measured[trace[t].channel][idx], frequencies[idx]);
-            cell_drawstring_5x7(w, h, buf, xpos, ypos, config.trace_color[t]);
+            cell_drawstring_5x7(w, h, marker_info.value[t], xpos, ypos, config.trace_color[t]);
             #else
             cell_drawstring_invert_06x13(w, h, buf, xpos, ypos, config.trace_color[t], t == uistat.current_trace);
             xpos += 22;
-            trace_get_info(t, buf, sizeof buf);
-            cell_drawstring_06x13(w, h, buf, xpos, ypos, config.trace_color[t]);
+            cell_drawstring_06x13(w, h, marker_info.info[t], xpos, ypos, config.trace_color[t]);
             xpos += 77;
-            trace_get_value_string(t, buf, sizeof buf, measured[trace[t].channel][idx], frequencies[idx]);
-            cell_drawstring_06x13(w, h, buf, xpos, ypos, config.trace_color[t]);
+            cell_drawstring_06x13(w, h, marker_info.value[t], xpos, ypos, config.trace_color[t]);
             #endif
         }
         j++;
@@ -1447,54 +2119,48 @@ void cell_draw_marker_info(int m, int n, int w, int h)
     #if USE_ILI_LCD
     int xpos = 192;
     int ypos = 1 + (j/2)*7;
-    xpos -= m * CELLWIDTH -CELLOFFSETX;
-    ypos -= n * CELLHEIGHT;
+    xpos -= x0 - CELLOFFSETX;
+    ypos -= y0;
     chsnprintf(buf, sizeof buf, "%d:", active_marker + 1);
     cell_drawstring_5x7(w, h, buf, xpos, ypos, 0xffff);
     xpos += 16;
-    frequency_string(buf, sizeof buf, frequencies[idx]);
-    cell_drawstring_5x7(w, h, buf, xpos, ypos, 0xffff);
+    cell_drawstring_5x7(w, h, marker_info.freq, xpos, ypos, 0xffff);
 
     // draw marker delta
-    if (active_marker != previous_marker && markers[previous_marker].enabled) {
-        int idx0 = markers[previous_marker].index;
+    if (marker_info.delta[0]) {
         xpos = 192;
-        xpos -= m * CELLWIDTH -CELLOFFSETX;
+        xpos -= x0 - CELLOFFSETX;
         ypos += 7;
         chsnprintf(buf, sizeof buf, "\001%d:", previous_marker+1);
         cell_drawstring_5x7(w, h, buf, xpos, ypos, 0xffff);
         xpos += 16;
-        frequency_string(buf, sizeof buf, frequencies[idx] - frequencies[idx0]);
-        cell_drawstring_5x7(w, h, buf, xpos, ypos, 0xffff);
+        cell_drawstring_5x7(w, h, marker_info.delta, xpos, ypos, 0xffff);
     }
     #else
     int xpos = 192+30;
     int ypos = 1 + (j/2)*13;
-    xpos -= m * CELLWIDTH -CELLOFFSETX;
-    ypos -= n * CELLHEIGHT;
+    xpos -= x0 - CELLOFFSETX;
+    ypos -= y0;
     chsnprintf(buf, sizeof buf, "%d:", active_marker + 1);
     cell_drawstring_06x13(w, h, buf, xpos, ypos, 0xffff);
     xpos += 19;
-    frequency_string(buf, sizeof buf, frequencies[idx]);
-    cell_drawstring_06x13(w, h, buf, xpos, ypos, 0xffff);
+    cell_drawstring_06x13(w, h, marker_info.freq, xpos, ypos, 0xffff);
 
     // draw marker delta
-    if (active_marker != previous_marker && markers[previous_marker].enabled) {
-        int idx0 = markers[previous_marker].index;
+    if (marker_info.delta[0]) {
         xpos = 192+30;
-        xpos -= m * CELLWIDTH -CELLOFFSETX;
+        xpos -= x0 - CELLOFFSETX;
         ypos += 13;
         chsnprintf(buf, sizeof buf, "\001%d:", previous_marker+1);
         cell_drawstring_06x13(w, h, buf, xpos, ypos, 0xffff);
         xpos += 19;
-        frequency_string(buf, sizeof buf, frequencies[idx] - frequencies[idx0]);
-        cell_drawstring_06x13(w, h, buf, xpos, ypos, 0xffff);
+        cell_drawstring_06x13(w, h, marker_info.delta, xpos, ypos, 0xffff);
     }
     /*
     int xpos = 192+30;
     int ypos = 1 + (j/2)*13;
-    xpos -= m * CELLWIDTH -CELLOFFSETX;
-    ypos -= n * CELLHEIGHT;
+    xpos -= x0 - CELLOFFSETX;
+    ypos -= y0;
     chsnprintf(buf, sizeof buf, "%d:", active_marker + 1);
     cell_drawstring_5x7(w, h, buf, xpos, ypos, 0xffff);
     xpos += 16;
@@ -1505,7 +2171,7 @@ void cell_draw_marker_info(int m, int n, int w, int h)
     if (active_marker != previous_marker && markers[previous_marker].enabled) {
         int idx0 = markers[previous_marker].index;
         xpos = 192+30;
-        xpos -= m * CELLWIDTH -CELLOFFSETX;
+        xpos -= x0 - CELLOFFSETX;
         ypos += 7;
         chsnprintf(buf, sizeof buf, "\001%d:", previous_marker+1);
         cell_drawstring_5x7(w, h, buf, xpos, ypos, 0xffff);
@@ -1519,22 +2185,28 @@ void cell_draw_marker_info(int m, int n, int w, int h)
 void
 frequency_string(char *buf, size_t len, int32_t freq)
 {
+  int n;
+
   if (freq < 0) {
     freq = -freq;
     *buf++ = '-';
     len -= 1;
   }
   if (freq < 1000) {
-    chsnprintf(buf, len, "%d Hz", (int)freq);
+    n = fmt_uint(buf, len, freq, 1);
+    fmt_str(buf+n, len-n, " Hz");
   } else if (freq < 1000000) {
-    chsnprintf(buf, len, "%d.%03d kHz",
-             (int)(freq / 1000),
-             (int)(freq % 1000));
+    n = fmt_uint(buf, len, freq / 1000, 1);
+    n += fmt_str(buf+n, len-n, ".");
+    n += fmt_uint(buf+n, len-n, freq % 1000, 3);
+    fmt_str(buf+n, len-n, " kHz");
   } else {
-    chsnprintf(buf, len, "%d.%03d %03d MHz",
-             (int)(freq / 1000000),
-             (int)((freq / 1000) % 1000),
-             (int)(freq % 1000));
+    n = fmt_uint(buf, len, freq / 1000000, 1);
+    n += fmt_str(buf+n, len-n, ".");
+    n += fmt_uint(buf+n, len-n, (freq / 1000) % 1000, 3);
+    n += fmt_str(buf+n, len-n, " ");
+    n += fmt_uint(buf+n, len-n, freq % 1000, 3);
+    fmt_str(buf+n, len-n, " MHz");
   }
 }
 
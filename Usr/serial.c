@@ -90,9 +90,12 @@
 
 /*-----------------------------------------------------------*/
 
-/* The queue used to hold received characters. */
-static QueueHandle_t xRxedChars;
-static QueueHandle_t xCharsForTx;
+/* 收到 USB 包时释放，每个包一次，不再每个字节入队 */
+static SemaphoreHandle_t xRxReady;
+
+/* 正在读取的包，数据还在 USB 接收槽里 */
+static uint8_t *pucRxSpan;
+static int32_t lRxLeft;
 
 /*-----------------------------------------------------------*/
 
@@ -111,15 +114,16 @@ xComPortHandle xSerialPortInitMinimal( unsigned long ulWantedBaud, unsigned port
   // NVIC_InitTypeDef NVIC_InitStructure;
   // GPIO_InitTypeDef GPIO_InitStructure;
 
-  /* Create the queues used to hold Rx/Tx characters. */
-  xRxedChars = xQueueCreate( uxQueueLength, ( unsigned portBASE_TYPE ) sizeof( signed char ) );
-  xCharsForTx = xQueueCreate( uxQueueLength + 1, ( unsigned portBASE_TYPE ) sizeof( signed char ) );
-  
+  ( void ) uxQueueLength;
+
+  /* 接收数据放在 USB 接收槽里，这里只需要一个信号量 */
+  xRxReady = xSemaphoreCreateBinary();
+
   /* If the queue/semaphore was created correctly then setup the serial port
   hardware. */
-  if( ( xRxedChars != serINVALID_QUEUE ) && ( xCharsForTx != serINVALID_QUEUE ) )
+  if( xRxReady != serINVALID_QUEUE )
   {
-    // ...
+    xReturn = ( xComPortHandle ) 1;
   }
   else
   {
@@ -132,15 +136,54 @@ xComPortHandle xSerialPortInitMinimal( unsigned long ulWantedBaud, unsigned port
 }
 /*-----------------------------------------------------------*/
 
-signed portBASE_TYPE xSerialGetChar( xComPortHandle pxPort, signed char *pcRxedChar, TickType_t xBlockTime )
+/*
+ * 取一段连续的接收数据，返回长度，超时返回 0
+ * 数据直接指向 USB 接收槽，处理完用 vSerialConsume 释放
+ */
+unsigned short usSerialGetSpan( xComPortHandle pxPort, const signed char **ppcSpan, TickType_t xBlockTime )
 {
   /* The port handle is not required as this driver only supports one port. */
   ( void ) pxPort;
 
+  while( lRxLeft <= 0 )
+  {
+    lRxLeft = CDC_RxPeek_FS( &pucRxSpan );
+    if( lRxLeft == 0 )
+    {
+      CDC_RxRelease_FS();  /* 零长度包 */
+    }
+    else if( lRxLeft < 0 && xSemaphoreTake( xRxReady, xBlockTime ) != pdTRUE )
+    {
+      return 0;
+    }
+  }
+  *ppcSpan = ( const signed char * ) pucRxSpan;
+  return ( unsigned short ) lRxLeft;
+}
+
+void vSerialConsume( xComPortHandle pxPort, unsigned short usCount )
+{
+  ( void ) pxPort;
+
+  pucRxSpan += usCount;
+  lRxLeft -= usCount;
+  if( lRxLeft <= 0 )
+  {
+    lRxLeft = 0;
+    CDC_RxRelease_FS();
+  }
+}
+
+signed portBASE_TYPE xSerialGetChar( xComPortHandle pxPort, signed char *pcRxedChar, TickType_t xBlockTime )
+{
+  const signed char *pcSpan;
+
   /* Get the next character from the buffer.  Return false if no characters
   are available, or arrive before xBlockTime expires. */
-  if( xQueueReceive( xRxedChars, pcRxedChar, xBlockTime ) )
+  if( usSerialGetSpan( pxPort, &pcSpan, xBlockTime ) > 0 )
   {
+    *pcRxedChar = *pcSpan;
+    vSerialConsume( pxPort, 1 );
     return pdTRUE;
   }
   else
@@ -190,6 +233,28 @@ void vSerialPutString( xComPortHandle pxPort, const signed char * const pcString
 }
 /*-----------------------------------------------------------*/
 
+/*
+ * xHold 为真时输出先攒成整包再发，为假时把攒下的发出去
+ */
+void vSerialHold( xComPortHandle pxPort, BaseType_t xHold )
+{
+  ( void ) pxPort;
+
+  CDC_TxHold_FS( xHold ? 1 : 0 );
+}
+/*-----------------------------------------------------------*/
+
+/*
+ * xLock 为真时发送缓冲区只给命令输出用，其他任务推送的数据不插进来
+ */
+void vSerialLock( xComPortHandle pxPort, BaseType_t xLock )
+{
+  ( void ) pxPort;
+
+  CDC_TxLock_FS( xLock ? 1 : 0 );
+}
+/*-----------------------------------------------------------*/
+
 signed portBASE_TYPE xSerialPutChar( xComPortHandle pxPort, signed char cOutChar, TickType_t xBlockTime )
 {
   signed portBASE_TYPE xReturn = pdPASS;
@@ -254,14 +319,16 @@ void vUARTInterruptHandler( void )
 }
 #endif
 
+/* USB 收到一个包，数据已经在接收槽里，只通知命令任务 */
 void vUARTInterruptHandler(uint8_t* Buf, uint32_t *Len)
 {
   portBASE_TYPE xHigherPriorityTaskWoken = pdFALSE;
-  uint32_t Cnt = 0;
-  while(Cnt < *Len)
+
+  ( void ) Buf;
+  ( void ) Len;
+  if( xRxReady != NULL )
   {
-    xQueueSendFromISR( xRxedChars, Buf+Cnt, &xHigherPriorityTaskWoken );
-    Cnt ++;
+    xSemaphoreGiveFromISR( xRxReady, &xHigherPriorityTaskWoken );
   }
   portEND_SWITCHING_ISR( xHigherPriorityTaskWoken );
 }
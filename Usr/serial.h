@@ -132,6 +132,10 @@ xComPortHandle xSerialPortInitMinimal( unsigned long ulWantedBaud, unsigned port
 xComPortHandle xSerialPortInit( eCOMPort ePort, eBaud eWantedBaud, eParity eWantedParity, eDataBits eWantedDataBits, eStopBits eWantedStopBits, unsigned portBASE_TYPE uxBufferLength );
 void vSerialPutString( xComPortHandle pxPort, const signed char * const pcString, unsigned short usStringLength );
 signed portBASE_TYPE xSerialGetChar( xComPortHandle pxPort, signed char *pcRxedChar, TickType_t xBlockTime );
+unsigned short usSerialGetSpan( xComPortHandle pxPort, const signed char **ppcSpan, TickType_t xBlockTime );
+void vSerialConsume( xComPortHandle pxPort, unsigned short usCount );
+void vSerialHold( xComPortHandle pxPort, BaseType_t xHold );
+void vSerialLock( xComPortHandle pxPort, BaseType_t xLock );
 signed portBASE_TYPE xSerialReset( xComPortHandle pxPort );
 signed portBASE_TYPE xSerialPutChar( xComPortHandle pxPort, signed char cOutChar, TickType_t xBlockTime );
 portBASE_TYPE xSerialWaitForSemaphore( xComPortHandle xPort );
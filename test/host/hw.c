@@ -0,0 +1,601 @@
+/*-----------------------------------------------------------------------------/
+ * Module       : hw.c
+ * Brief        : 主机测试用的硬件和 RTOS 桩
+ appvna.c/plot.c/ui.c/nt35510.c 在 PC 上链接时需要的外部符号：
+ HAL、FreeRTOS、flash、si5351、tlv320aic3204、触摸屏等。
+ 外设寄存器是普通内存，RTOS 对象用 pthread 实现，多线程的模拟器也能用。
+ LCD 的 FSMC 地址 (0x60000000) 映射一段内存，写屏幕不会出错。
+ CDC_Transmit_FS/CDC_TryTransmit_FS 等是弱符号，输出存入 host_cdc_out，
+ 链接 Src/usbd_cdc_if.c 时被真正的实现替换，这时 USB 库换成这里模拟的端点。
+/-----------------------------------------------------------------------------*/
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "system.h"
+#include "nanovna.h"
+#include "FreeRTOS_CLI.h"
+#include "nt35510.h"
+#include "hw.h"
+
+GPIO_TypeDef host_gpio[5];
+DMA_Channel_TypeDef host_dma1_ch[7];
+DMA_TypeDef host_dma1;
+DWT_Type host_dwt;
+CoreDebug_Type host_coredebug;
+uint32_t SystemCoreClock = 72000000;
+
+/* nt35510.c 的 BANK1_LCD_C/BANK1_LCD_D */
+#define HOST_FSMC_BASE  0x60000000UL
+#define HOST_FSMC_SIZE  0x21000UL
+
+__attribute__((constructor)) static void host_fsmc_map(void)
+{
+  void *p = mmap((void *)HOST_FSMC_BASE, HOST_FSMC_SIZE, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+  if (p != (void *)HOST_FSMC_BASE) {
+    fprintf(stderr, "cannot map the LCD bus at 0x%lx\n", HOST_FSMC_BASE);
+    abort();
+  }
+}
+
+I2S_HandleTypeDef hi2s2;
+TIM_HandleTypeDef htim1, htim2;
+ADC_HandleTypeDef hadc1, hadc2;
+osThreadId Task001Handle;
+volatile int g_TP_Irq;
+int16_t lastsaveid;
+
+/*
+=======================================
+    时间
+=======================================
+*/
+uint32_t host_ms(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint32_t)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+/*
+ * DWT 周期计数器：每次经 DWT 访问时按 CLOCK_MONOTONIC 补上经过的
+ * SystemCoreClock 周期，CYCCNTENA 置位时才走；写入 (清零) 照常生效
+ */
+static pthread_mutex_t dwt_lock = PTHREAD_MUTEX_INITIALIZER;
+
+DWT_Type *host_dwt_sync(void)
+{
+  static uint64_t last;
+  struct timespec ts;
+  uint64_t now;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  now = (uint64_t)ts.tv_sec * SystemCoreClock + (uint64_t)ts.tv_nsec * SystemCoreClock / 1000000000;
+  pthread_mutex_lock(&dwt_lock);
+  if ((host_dwt.CTRL & DWT_CTRL_CYCCNTENA_Msk) && last)
+    host_dwt.CYCCNT += (uint32_t)(now - last);
+  last = now;
+  pthread_mutex_unlock(&dwt_lock);
+  return &host_dwt;
+}
+
+uint32_t HAL_GetTick(void) { return host_ms(); }
+TickType_t xTaskGetTickCount(void) { return host_ms(); }
+void HAL_Delay(uint32_t ms) { usleep(ms * 1000); }
+void vTaskDelay(TickType_t ticks) { usleep(ticks * 1000); }
+int osDelay(uint32_t ms) { usleep(ms * 1000); return 0; }
+
+/*
+=======================================
+    RTOS 对象
+    递归互斥量直接用 pthread 的；二值信号量用互斥量加条件变量。
+    vTaskSuspendAll 在单核上等于不被其他任务打断，这里用一把全局锁。
+=======================================
+*/
+typedef struct {
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  int count;
+} host_sem_t;
+
+static pthread_mutex_t sched_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void vTaskSuspendAll(void) { pthread_mutex_lock(&sched_lock); }
+BaseType_t xTaskResumeAll(void) { pthread_mutex_unlock(&sched_lock); return pdFALSE; }
+
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex(void)
+{
+  pthread_mutex_t *m = malloc(sizeof *m);
+  pthread_mutexattr_t a;
+
+  pthread_mutexattr_init(&a);
+  pthread_mutexattr_settype(&a, PTHREAD_MUTEX_RECURSIVE);
+  pthread_mutex_init(m, &a);
+  return m;
+}
+
+int osRecursiveMutexWait(void *m, uint32_t ms)
+{
+  (void)ms;
+  return pthread_mutex_lock(m) == 0 ? 0 : -1;
+}
+
+int osRecursiveMutexRelease(void *m)
+{
+  return pthread_mutex_unlock(m) == 0 ? 0 : -1;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+  host_sem_t *s = calloc(1, sizeof *s);
+  pthread_mutex_init(&s->lock, NULL);
+  pthread_cond_init(&s->cond, NULL);
+  return s;
+}
+
+/* 互斥量：初值为 1 的二值信号量，不做优先级继承 */
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+  host_sem_t *s = xSemaphoreCreateBinary();
+  s->count = 1;
+  return s;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t h, TickType_t ticks)
+{
+  host_sem_t *s = h;
+  struct timespec ts;
+  int r = 0;
+
+  clock_gettime(CLOCK_REALTIME, &ts);
+  ts.tv_sec += ticks / 1000;
+  ts.tv_nsec += (ticks % 1000) * 1000000L;
+  if (ts.tv_nsec >= 1000000000L) {
+    ts.tv_sec++;
+    ts.tv_nsec -= 1000000000L;
+  }
+  pthread_mutex_lock(&s->lock);
+  while (s->count == 0 && r == 0) {
+    if (ticks == portMAX_DELAY)
+      r = pthread_cond_wait(&s->cond, &s->lock);
+    else if (ticks == 0)
+      r = -1;
+    else
+      r = pthread_cond_timedwait(&s->cond, &s->lock, &ts);
+  }
+  if (s->count) {
+    s->count = 0;
+    r = 0;
+  }
+  pthread_mutex_unlock(&s->lock);
+  return r == 0 ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t h)
+{
+  host_sem_t *s = h;
+  pthread_mutex_lock(&s->lock);
+  s->count = 1;
+  pthread_cond_signal(&s->cond);
+  pthread_mutex_unlock(&s->lock);
+  return pdTRUE;
+}
+
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t h, BaseType_t *woken)
+{
+  if (woken)
+    *woken = pdFALSE;
+  return xSemaphoreGive(h);
+}
+
+int osThreadSuspend(osThreadId t) { (void)t; return 0; }
+int osThreadResume(osThreadId t) { (void)t; return 0; }
+void vTaskList(char *buf) { strcpy(buf, "host\r\n"); }
+void *pvPortMalloc(size_t size) { return malloc(size); }
+void vPortFree(void *p) { free(p); }
+int32_t osKernelRunning(void) { return 1; }
+
+/*
+=======================================
+    中断
+    模拟的中断处理 (host_irq_enter/exit 之间) 和关中断共用一把递归锁，
+    两者互斥，和单核上一样。中断处理里 __get_IPSR 返回非 0。
+=======================================
+*/
+static pthread_mutex_t irq_lock;
+static __thread uint32_t irq_active;
+
+__attribute__((constructor)) static void host_irq_init(void)
+{
+  pthread_mutexattr_t a;
+
+  pthread_mutexattr_init(&a);
+  pthread_mutexattr_settype(&a, PTHREAD_MUTEX_RECURSIVE);
+  pthread_mutex_init(&irq_lock, &a);
+}
+
+void host_irq_enter(void)
+{
+  pthread_mutex_lock(&irq_lock);
+  irq_active++;
+}
+
+void host_irq_exit(void)
+{
+  irq_active--;
+  pthread_mutex_unlock(&irq_lock);
+}
+
+uint32_t __get_IPSR(void) { return irq_active ? 36 : 0; }  // USB_LP_CAN1_RX0
+void __disable_irq(void) { pthread_mutex_lock(&irq_lock); }
+void __enable_irq(void) { pthread_mutex_unlock(&irq_lock); }
+
+/*
+=======================================
+    HAL
+=======================================
+*/
+void HAL_GPIO_WritePin(GPIO_TypeDef *port, uint16_t pin, GPIO_PinState state)
+{
+  if (state == GPIO_PIN_SET)
+    port->ODR |= pin;
+  else
+    port->ODR &= ~pin;
+}
+
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef *port, uint16_t pin)
+{
+  return (port->IDR & pin) ? GPIO_PIN_SET : GPIO_PIN_RESET;
+}
+
+void HAL_NVIC_SystemReset(void) { exit(0); }
+void HAL_NVIC_SetPriority(int irq, uint32_t pre, uint32_t sub) { (void)irq; (void)pre; (void)sub; }
+void HAL_NVIC_EnableIRQ(int irq) { (void)irq; }
+void HAL_NVIC_DisableIRQ(int irq) { (void)irq; }
+void HAL_NVIC_ClearPendingIRQ(int irq) { (void)irq; }
+HAL_StatusTypeDef HAL_TIM_PWM_Start(TIM_HandleTypeDef *h, uint32_t ch) { (void)h; (void)ch; return HAL_OK; }
+HAL_StatusTypeDef HAL_TIM_PWM_Stop(TIM_HandleTypeDef *h, uint32_t ch) { (void)h; (void)ch; return HAL_OK; }
+HAL_StatusTypeDef HAL_ADC_Start(ADC_HandleTypeDef *h) { (void)h; return HAL_OK; }
+HAL_StatusTypeDef HAL_ADC_PollForConversion(ADC_HandleTypeDef *h, uint32_t t) { (void)h; (void)t; return HAL_OK; }
+uint32_t HAL_ADC_GetValue(ADC_HandleTypeDef *h) { (void)h; return 2048; }
+
+
+void _Error_Handler(char *file, int line)
+{
+  fprintf(stderr, "Error_Handler %s:%d\n", file, line);
+  abort();
+}
+
+/*
+=======================================
+    板上其他器件
+=======================================
+*/
+static volatile uint32_t host_freq;
+static volatile int host_port;  // 0: S11 (IN3), 1: S21 (IN1)
+
+void I2C_InitGPIO(void) {}
+void si5351_init(void) {}
+int si5351_set_frequency_with_offset_expand(int freq, int offset, uint8_t drive_strength)
+{
+  (void)offset; (void)drive_strength;
+  host_freq = freq;
+  return 0;
+}
+void tlv320aic3204_init_slave(void) {}
+void tlv320aic3204_set_gain(int lgain, int rgain) { (void)lgain; (void)rgain; }
+void tlv320aic3204_select_in1(void) { host_port = 1; }
+void tlv320aic3204_select_in3(void) { host_port = 0; }
+void rtp_init(void) {}
+uint16_t TPReadX(void) { return 0; }
+uint16_t TPReadY(void) { return 0; }
+int str2hex(uint8_t *dst, char *src) { (void)dst; (void)src; return 0; }
+
+/*
+=======================================
+    I2S 接收
+    HAL_I2S_Receive_DMA 启动一个线程，每 host_i2s_period_us 微秒填好
+    半个缓存 (48 个立体声采样)，依次调用半中断和全中断。
+    左声道是参考信号，右声道是参考信号乘以 host_dut 给出的 S 参数，
+    都按 dsp.c 的 sincos_tbl 生成，dsp_process 得到的 gamma 就是这个 S 参数
+=======================================
+*/
+extern const int16_t sincos_tbl[48][2];
+extern int16_t rx_buffer[];
+void HAL_I2S_RxHalfCpltCallback(I2S_HandleTypeDef *hi2s);
+void HAL_I2S_RxCpltCallback(I2S_HandleTypeDef *hi2s);
+
+uint32_t host_i2s_period_us = 100;
+
+/*
+ * 默认的被测件：S11 是 50 欧姆负载上串一段 1 m 的线，
+ * S21 是 3 dB 衰减加同样的线
+ */
+__weak void host_dut(uint32_t freq, int port, float s[2])
+{
+  float ph = -2 * (float)M_PI * freq / 3e8f * (port ? 1 : 2);
+  float mag = port ? 0.707f : 0.3f;
+  s[0] = mag * cosf(ph);
+  s[1] = mag * sinf(ph);
+}
+
+static void host_i2s_fill(int16_t *p)
+{
+  float s[2];
+  int i;
+
+  host_dut(host_freq, host_port, s);
+  for (i = 0; i < 48; i++) {
+    float sn = sincos_tbl[i][0] / 4, cs = sincos_tbl[i][1] / 4;
+    p[i * 2] = (int16_t)sn;
+    p[i * 2 + 1] = (int16_t)(s[0] * sn + s[1] * cs);
+  }
+}
+
+static void *host_i2s_thread(void *arg)
+{
+  (void)arg;
+  for (;;) {
+    usleep(host_i2s_period_us);
+    host_i2s_fill(&rx_buffer[0]);
+    HAL_I2S_RxHalfCpltCallback(&hi2s2);
+    usleep(host_i2s_period_us);
+    host_i2s_fill(&rx_buffer[AUDIO_BUFFER_LEN]);
+    HAL_I2S_RxCpltCallback(&hi2s2);
+  }
+  return NULL;
+}
+
+HAL_StatusTypeDef HAL_I2S_Receive_DMA(I2S_HandleTypeDef *h, uint16_t *buf, uint16_t size)
+{
+  pthread_t th;
+  (void)h; (void)buf; (void)size;
+  pthread_create(&th, NULL, host_i2s_thread, NULL);
+  pthread_detach(th);
+  return HAL_OK;
+}
+
+/*
+=======================================
+    LCD 的 DMA1 通道7
+    不模拟传输，EN 置位后直接当作传输完成，调用 nt35510_dma_irq。
+    像素和总线时序的模型见 test_lcd.c
+=======================================
+*/
+static void *host_lcd_dma_thread(void *arg)
+{
+  DMA_Channel_TypeDef *ch = DMA1_Channel7;
+  (void)arg;
+  for (;;) {
+    if ((ch->CCR & DMA_CCR_EN) && ch->CNDTR) {
+      ch->CNDTR = 0;
+      nt35510_dma_irq();
+    } else {
+      sched_yield();
+    }
+  }
+  return NULL;
+}
+
+void host_lcd_dma_start(void)
+{
+  pthread_t th;
+  pthread_create(&th, NULL, host_lcd_dma_thread, NULL);
+  pthread_detach(th);
+}
+
+/*
+ * flash：没有保存过的配置和校准
+ */
+int config_save(void) { return 0; }
+int config_recall(void) { return -1; }
+int caldata_save(int id) { (void)id; return -1; }
+int caldata_recall(int id) { (void)id; return -1; }
+const properties_t *caldata_ref(int id) { (void)id; return NULL; }
+void clear_all_config_prop_data(void) {}
+
+/*
+=======================================
+    CDC 输出
+    命令和扫描可能在不同线程里输出，追加时加锁。
+    CDC_TryTransmit_FS 和真正的一样：命令执行期间 (CDC_TxLock_FS) 或者
+    放不下时整段丢弃
+=======================================
+*/
+uint8_t host_cdc_out[HOST_CDC_OUT_SIZE];
+int host_cdc_len;
+int host_cdc_hold, host_cdc_lock;
+__weak cdc_stats_t cdc_stats;
+
+static pthread_mutex_t cdc_lock = PTHREAD_MUTEX_INITIALIZER;
+
+__weak uint8_t CDC_Transmit_FS(uint8_t *Buf, uint16_t Len)
+{
+  pthread_mutex_lock(&cdc_lock);
+  if (host_cdc_len + Len > HOST_CDC_OUT_SIZE)
+    Len = HOST_CDC_OUT_SIZE - host_cdc_len;
+  memcpy(host_cdc_out + host_cdc_len, Buf, Len);
+  host_cdc_len += Len;
+  pthread_mutex_unlock(&cdc_lock);
+  return USBD_OK;
+}
+
+__weak uint8_t CDC_TryTransmit_FS(uint8_t *Buf, uint16_t Len)
+{
+  uint8_t result = USBD_BUSY;
+
+  pthread_mutex_lock(&cdc_lock);
+  if (!host_cdc_lock && host_cdc_len + Len <= HOST_CDC_OUT_SIZE) {
+    memcpy(host_cdc_out + host_cdc_len, Buf, Len);
+    host_cdc_len += Len;
+    result = USBD_OK;
+  }
+  pthread_mutex_unlock(&cdc_lock);
+  return result;
+}
+
+__weak void CDC_TxHold_FS(uint8_t hold)
+{
+  host_cdc_hold = hold;
+}
+
+__weak void CDC_TxLock_FS(uint8_t lock)
+{
+  pthread_mutex_lock(&cdc_lock);
+  host_cdc_lock = lock;
+  pthread_mutex_unlock(&cdc_lock);
+}
+
+void cmd_begin(void);
+void cmd_end(void);
+
+/* 和 appcmd.c 的 prvRunCommand 一样，执行期间占住发送，前后记录执行时间 */
+int host_command(const char *line)
+{
+  static char cmd[256];
+  int start;
+
+  strncpy(cmd, line, sizeof cmd - 1);
+  CDC_TxLock_FS(1);
+  start = host_cdc_len;
+  cmd_begin();
+  FreeRTOS_CLIProcessCommand(cmd, FreeRTOS_CLIGetOutputBuffer(), config_MAX_OUTPUT_SIZE);
+  cmd_end();
+  CDC_TxLock_FS(0);
+  return host_cdc_len - start;
+}
+
+/*
+=======================================
+    模拟的 USB 端点
+    代替 USB 库的 CDC 类，链接 Src/usbd_cdc_if.c 时用 (test_cdc、tools/vnasim)。
+    IN：端点线程取走 USBD_CDC_TransmitPacket 开始的传输，按 64 字节分包，
+    每包用时 host_usb_packet_us，整个传输交给 host_usb_in (零长度包时
+    长度为 0)，然后在模拟的中断里调用 CDC_TxComplete_FS。
+    OUT：host_usb_out 在模拟的中断里把一个包交给 CDC_Receive_FS，
+    没有准备接收时返回 0，和 USB 的 NAK 一样由主机一侧重试
+=======================================
+*/
+USBD_HandleTypeDef hUsbDeviceFS;
+USBD_CDC_HandleTypeDef host_usb_cdc;
+int host_usb_packet_us = 50;  // 全速 USB 一帧 (1 ms) 约 19 个 64 字节包
+void (*host_usb_in)(const uint8_t *p, int len);
+void (*host_usb_in_start)(const uint8_t *p, int len);
+void (*host_usb_in_done)(void);
+
+__weak USBD_CDC_ItfTypeDef USBD_Interface_fops_FS;
+__weak void CDC_TxComplete_FS(void) {}
+
+static pthread_mutex_t ep_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ep_cond = PTHREAD_COND_INITIALIZER;
+static volatile int in_paused, out_armed;
+
+uint8_t USBD_CDC_SetTxBuffer(USBD_HandleTypeDef *pdev, uint8_t *pbuff, uint16_t length)
+{
+  (void)pdev;
+  host_usb_cdc.TxBuffer = pbuff;
+  host_usb_cdc.TxLength = length;
+  return USBD_OK;
+}
+
+uint8_t USBD_CDC_TransmitPacket(USBD_HandleTypeDef *pdev)
+{
+  (void)pdev;
+  if (host_usb_cdc.TxState)
+    return USBD_BUSY;
+  if (host_usb_in_start)
+    host_usb_in_start(host_usb_cdc.TxBuffer, host_usb_cdc.TxLength);
+  pthread_mutex_lock(&ep_lock);
+  host_usb_cdc.TxState = 1;
+  pthread_cond_signal(&ep_cond);
+  pthread_mutex_unlock(&ep_lock);
+  return USBD_OK;
+}
+
+uint8_t USBD_CDC_SetRxBuffer(USBD_HandleTypeDef *pdev, uint8_t *pbuff)
+{
+  (void)pdev;
+  host_usb_cdc.RxBuffer = pbuff;
+  return USBD_OK;
+}
+
+uint8_t USBD_CDC_ReceivePacket(USBD_HandleTypeDef *pdev)
+{
+  (void)pdev;
+  out_armed = 1;
+  return USBD_OK;
+}
+
+static void *host_usb_in_thread(void *arg)
+{
+  const uint8_t *p;
+  int len;
+
+  (void)arg;
+  for (;;) {
+    pthread_mutex_lock(&ep_lock);
+    while (!host_usb_cdc.TxState || in_paused)
+      pthread_cond_wait(&ep_cond, &ep_lock);
+    p = host_usb_cdc.TxBuffer;
+    len = host_usb_cdc.TxLength;
+    pthread_mutex_unlock(&ep_lock);
+
+    if (host_usb_packet_us)
+      usleep(host_usb_packet_us * (len ? (len + CDC_DATA_FS_MAX_PACKET_SIZE - 1) /
+                                   CDC_DATA_FS_MAX_PACKET_SIZE : 1));
+    // 长度正好是整包时硬件不自动补零长度包，由 CDC_TxStart 另外发
+    if (host_usb_in)
+      host_usb_in(p, len);
+
+    host_irq_enter();
+    host_usb_cdc.TxState = 0;
+    CDC_TxComplete_FS();
+    if (host_usb_in_done)
+      host_usb_in_done();
+    host_irq_exit();
+  }
+  return NULL;
+}
+
+/* 同 USBD_CDC_Init：连接、准备接收第一个包，启动 IN 端点线程 */
+void host_usb_start(void)
+{
+  pthread_t th;
+
+  hUsbDeviceFS.dev_state = USBD_STATE_CONFIGURED;
+  hUsbDeviceFS.pClassData = &host_usb_cdc;
+  USBD_Interface_fops_FS.Init();
+  out_armed = 1;
+  pthread_create(&th, NULL, host_usb_in_thread, NULL);
+  pthread_detach(th);
+}
+
+/* 暂停时 IN 端点不取走新的传输，和主机不读一样 */
+void host_usb_in_pause(int pause)
+{
+  pthread_mutex_lock(&ep_lock);
+  in_paused = pause;
+  pthread_cond_signal(&ep_cond);
+  pthread_mutex_unlock(&ep_lock);
+}
+
+int host_usb_out(const uint8_t *p, int len)
+{
+  uint32_t n = len;
+  int delivered;
+
+  host_irq_enter();
+  delivered = out_armed;
+  if (delivered) {
+    out_armed = 0;
+    memcpy(host_usb_cdc.RxBuffer, p, len);
+    USBD_Interface_fops_FS.Receive(host_usb_cdc.RxBuffer, &n);
+  }
+  host_irq_exit();
+  return delivered;
+}
@@ -0,0 +1,50 @@
+/*-----------------------------------------------------------------------------/
+ * Module       : hw.h
+ * Brief        : hw.c 里主机专用的接口
+/-----------------------------------------------------------------------------*/
+#ifndef HOST_HW_H
+#define HOST_HW_H
+#include <stdint.h>
+#include "usbd_cdc.h"
+
+/* 弱符号 CDC_Transmit_FS 收到的输出 */
+#define HOST_CDC_OUT_SIZE  (256*1024)
+extern uint8_t host_cdc_out[HOST_CDC_OUT_SIZE];
+extern int host_cdc_len;
+extern int host_cdc_hold;  /* 弱符号 CDC_TxHold_FS 最后一次设置的值 */
+extern int host_cdc_lock;  /* CDC_TxLock_FS，为真时 CDC_TryTransmit_FS 丢弃 */
+
+uint32_t host_ms(void);
+
+/* 模拟中断处理：期间 __disable_irq 的任务等待，__get_IPSR 返回非 0 */
+void host_irq_enter(void);
+void host_irq_exit(void);
+
+/* I2S 线程每半个缓存的间隔，app_init 调用 HAL_I2S_Receive_DMA 之前设置 */
+extern uint32_t host_i2s_period_us;
+
+/* 模拟的被测件，freq 时 port (0: S11, 1: S21) 的 S 参数，测试可以替换 */
+void host_dut(uint32_t freq, int port, float s[2]);
+
+/* 启动 LCD DMA 线程，传输立即完成 */
+void host_lcd_dma_start(void);
+
+/*
+ * 模拟的 USB 端点 (链接 Src/usbd_cdc_if.c 时用)，见 hw.c
+ * host_usb_in_start 在 USBD_CDC_TransmitPacket 里 (中断里或关中断时)，
+ * host_usb_in 在端点线程里，主机收到一次传输；
+ * host_usb_in_done 在模拟的中断里，CDC_TxComplete_FS 之后
+ */
+extern USBD_CDC_HandleTypeDef host_usb_cdc;
+extern int host_usb_packet_us;
+extern void (*host_usb_in_start)(const uint8_t *p, int len);
+extern void (*host_usb_in)(const uint8_t *p, int len);
+extern void (*host_usb_in_done)(void);
+void host_usb_start(void);
+void host_usb_in_pause(int pause);
+/* 把一个 OUT 包交给 CDC_Receive_FS，没有准备接收时返回 0 (NAK) */
+int host_usb_out(const uint8_t *p, int len);
+
+/* 执行一条命令行，输出追加到 host_cdc_out，返回本条命令的输出长度 */
+int host_command(const char *line);
+#endif
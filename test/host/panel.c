@@ -0,0 +1,230 @@
+/*-----------------------------------------------------------------------------/
+ * Module       : panel.c
+ * Brief        : NT35510 面板和 FSMC 总线的模型
+ 解析 0x2a00~0x2b03 窗口和 0x2c00 RAMWR，像素写进 800x480 的面板，
+ 按 FSMC 的时序统计 CPU 和 DMA 各占的总线时间。
+ DMA1 通道7 由一个线程模拟：EN 置位后把 CMAR 的字逐个写到总线，
+ 写完调用 nt35510_dma_irq，相当于传输完成中断。
+ 面板可以存成 PPM，与保存的图逐点比较，不同的点在差异图里标出。
+/-----------------------------------------------------------------------------*/
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include "stm32f1xx_hal.h"
+#include "panel.h"
+
+void nt35510_dma_irq(void);
+
+#define PANEL_LCD_C  0x60000000  // 同 nt35510.c 的 BANK1_LCD_C
+
+uint16_t panel[PANEL_H][PANEL_W];
+uint64_t panel_bus_cpu, panel_bus_dma;
+uint64_t panel_cpu_stores;
+uint64_t panel_windows;
+uint64_t panel_pixels;
+long panel_bus_conflict;
+volatile int panel_dma_slow;
+
+static struct {
+  uint16_t cmd;
+  uint16_t xs, xe, ys, ye;
+  int x, y;
+} lcd;
+
+static pthread_mutex_t bus_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t dma_th;
+static volatile int dma_stop;
+
+/*
+=======================================
+    NT35510
+=======================================
+*/
+static void set_hi(uint16_t *r, uint16_t v) { *r = (*r & 0x00ff) | (v & 0xff) << 8; }
+static void set_lo(uint16_t *r, uint16_t v) { *r = (*r & 0xff00) | (v & 0xff); }
+
+static void panel_write(uint32_t addr, uint16_t v)
+{
+  if (addr == PANEL_LCD_C) {
+    lcd.cmd = v;
+    if (v == 0x2c00) {
+      lcd.x = lcd.xs;
+      lcd.y = lcd.ys;
+      panel_windows++;
+    }
+    return;
+  }
+  switch (lcd.cmd) {
+  case 0x2a00: set_hi(&lcd.xs, v); break;
+  case 0x2a01: set_lo(&lcd.xs, v); break;
+  case 0x2a02: set_hi(&lcd.xe, v); break;
+  case 0x2a03: set_lo(&lcd.xe, v); break;
+  case 0x2b00: set_hi(&lcd.ys, v); break;
+  case 0x2b01: set_lo(&lcd.ys, v); break;
+  case 0x2b02: set_hi(&lcd.ye, v); break;
+  case 0x2b03: set_lo(&lcd.ye, v); break;
+  case 0x2c00:
+    if (lcd.x < PANEL_W && lcd.y < PANEL_H)
+      panel[lcd.y][lcd.x] = v;
+    panel_pixels++;
+    if (++lcd.x > lcd.xe) {
+      lcd.x = lcd.xs;
+      if (++lcd.y > lcd.ye)
+        lcd.y = lcd.ys;
+    }
+    break;
+  }
+}
+
+static void panel_bus16(uint32_t addr, uint16_t v)
+{
+  pthread_mutex_lock(&bus_lock);
+  if ((DMA1_Channel7->CCR & DMA_CCR_EN) && DMA1_Channel7->CNDTR)
+    panel_bus_conflict++;
+  panel_bus_cpu++;
+  panel_write(addr, v);
+  pthread_mutex_unlock(&bus_lock);
+}
+
+void panel_wr16(uint32_t addr, uint16_t v)
+{
+  panel_cpu_stores++;
+  panel_bus16(addr, v);
+}
+
+void panel_wr32(uint32_t addr, uint32_t v)
+{
+  panel_cpu_stores++;
+  panel_bus16(addr, v);
+  panel_bus16(addr, v >> 16);
+}
+
+void panel_bus_reset(void)
+{
+  panel_bus_cpu = panel_bus_dma = panel_cpu_stores = 0;
+  panel_windows = panel_pixels = 0;
+}
+
+double panel_bus_ms(uint64_t halfwords)
+{
+  return halfwords * FSMC_WRITE_HCLK / (HCLK_MHZ * 1000.0);
+}
+
+/*
+=======================================
+    DMA1 通道7
+    存储器到 FSMC，32 位，每个字拆成两次半字写
+=======================================
+*/
+static void *panel_dma_thread(void *arg)
+{
+  DMA_Channel_TypeDef *ch = DMA1_Channel7;
+  (void)arg;
+
+  while (!dma_stop) {
+    uint32_t ccr = ch->CCR;
+    const uint32_t *src;
+
+    if (!(ccr & DMA_CCR_EN) || ch->CNDTR == 0) {
+      sched_yield();
+      continue;
+    }
+    src = (const uint32_t *)(uintptr_t)ch->CMAR;
+    while (ch->CNDTR > 0) {
+      uint32_t w = *src;
+      if (ccr & DMA_CCR_MINC)
+        src++;
+      pthread_mutex_lock(&bus_lock);
+      panel_bus_dma += 2;
+      panel_write(ch->CPAR, w);
+      panel_write(ch->CPAR, w >> 16);
+      pthread_mutex_unlock(&bus_lock);
+      ch->CNDTR--;
+      if (panel_dma_slow && (ch->CNDTR & 7) == 0)
+        sched_yield();
+    }
+    nt35510_dma_irq();
+  }
+  return NULL;
+}
+
+void panel_dma_start(void)
+{
+  dma_stop = 0;
+  pthread_create(&dma_th, NULL, panel_dma_thread, NULL);
+}
+
+void panel_dma_stop(void)
+{
+  dma_stop = 1;
+  pthread_join(dma_th, NULL);
+}
+
+/*
+=======================================
+    PPM
+    RGB565 每个分量高位补到低位，读回时取高位，往返不变
+=======================================
+*/
+int panel_write_ppm(const char *path, const uint16_t (*img)[PANEL_W])
+{
+  static uint8_t row[PANEL_W * 3];
+  FILE *f = fopen(path, "wb");
+  int x, y, ok;
+
+  if (!f)
+    return -1;
+  ok = fprintf(f, "P6\n%d %d\n255\n", PANEL_W, PANEL_H) > 0;
+  for (y = 0; y < PANEL_H && ok; y++) {
+    for (x = 0; x < PANEL_W; x++) {
+      uint16_t c = img[y][x];
+      uint8_t r = c >> 11, g = (c >> 5) & 0x3f, b = c & 0x1f;
+      row[x * 3] = r << 3 | r >> 2;
+      row[x * 3 + 1] = g << 2 | g >> 4;
+      row[x * 3 + 2] = b << 3 | b >> 2;
+    }
+    ok = fwrite(row, sizeof row, 1, f) == 1;
+  }
+  return fclose(f) == 0 && ok ? 0 : -1;
+}
+
+int panel_read_ppm(const char *path, uint16_t (*img)[PANEL_W])
+{
+  static uint8_t row[PANEL_W * 3];
+  FILE *f = fopen(path, "rb");
+  int w, h, max, x, y, ok;
+
+  if (!f)
+    return -1;
+  ok = fscanf(f, "P6 %d %d %d", &w, &h, &max) == 3 && w == PANEL_W && h == PANEL_H &&
+       max == 255 && fgetc(f) == '\n';
+  for (y = 0; y < PANEL_H && ok; y++) {
+    ok = fread(row, sizeof row, 1, f) == 1;
+    for (x = 0; x < PANEL_W && ok; x++)
+      img[y][x] = (row[x * 3] >> 3) << 11 | (row[x * 3 + 1] >> 2) << 5 | row[x * 3 + 2] >> 3;
+  }
+  fclose(f);
+  return ok ? 0 : -1;
+}
+
+/* 差异图：相同的点变暗，不同的点标成品红 */
+long panel_diff(const uint16_t (*a)[PANEL_W], const uint16_t (*b)[PANEL_W], const char *diff_path)
+{
+  static uint16_t d[PANEL_H][PANEL_W];
+  long n = 0;
+  int x, y;
+
+  for (y = 0; y < PANEL_H; y++)
+    for (x = 0; x < PANEL_W; x++) {
+      if (a[y][x] != b[y][x]) {
+        d[y][x] = 0xf81f;
+        n++;
+      } else {
+        d[y][x] = (b[y][x] >> 2) & 0x39e7;  // 每个分量除以 4
+      }
+    }
+  if (n && diff_path)
+    panel_write_ppm(diff_path, (const uint16_t (*)[PANEL_W])d);
+  return n;
+}
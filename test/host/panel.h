@@ -0,0 +1,52 @@
+/*-----------------------------------------------------------------------------/
+ * Module       : panel.h
+ * Brief        : NT35510 面板和 FSMC 总线的模型，见 panel.c
+ nt35510.c 用下面的 LCD_WR16/LCD_WR32 编译 (Makefile 里的 nt35510_panel.o，
+ 或测试在 #include nt35510.c 之前包含本文件)，总线写入进到 panel。
+/-----------------------------------------------------------------------------*/
+#ifndef HOST_PANEL_H
+#define HOST_PANEL_H
+#include <sched.h>
+#include <stdint.h>
+
+#define PANEL_W  800
+#define PANEL_H  480
+
+/* FSMC 模式 B 写：ADDSET + DATAST + 1 个 HCLK (main.c 里 ADDSET=2, DATAST=5) */
+#define FSMC_WRITE_HCLK  8
+#define HCLK_MHZ         72
+
+void panel_wr16(uint32_t addr, uint16_t v);
+void panel_wr32(uint32_t addr, uint32_t v);
+
+#define LCD_WR16(a, v)  panel_wr16((a), (v))
+#define LCD_WR32(a, v)  panel_wr32((a), (v))
+#define LCD_RD16(a)     ((void)(a), 0)
+#define LCD_DMA_IDLE()  sched_yield()
+
+extern uint16_t panel[PANEL_H][PANEL_W];
+
+/* 统计，panel_bus_reset 清零 */
+extern uint64_t panel_bus_cpu, panel_bus_dma;  /* 半字写次数 */
+extern uint64_t panel_cpu_stores;  /* CPU 写总线的指令数，32 位写算一次 */
+extern uint64_t panel_windows;     /* RAMWR 次数 */
+extern uint64_t panel_pixels;      /* 写进面板的像素数 */
+extern long panel_bus_conflict;    /* DMA 传输期间 CPU 写总线，不清零 */
+
+/* 为真时 DMA 每 8 个字让出一次，CPU 在传输期间继续绘制 */
+extern volatile int panel_dma_slow;
+
+void panel_bus_reset(void);
+double panel_bus_ms(uint64_t halfwords);  /* 按 FSMC 时序折算的总线时间 */
+
+/* 启动/停止模拟 DMA1 通道7 的线程，代替 host_lcd_dma_start */
+void panel_dma_start(void);
+void panel_dma_stop(void);
+
+/* RGB565 与二进制 PPM (P6) 互换，成功返回 0 */
+int panel_write_ppm(const char *path, const uint16_t (*img)[PANEL_W]);
+int panel_read_ppm(const char *path, uint16_t (*img)[PANEL_W]);
+
+/* 逐点比较，返回不同的像素数；有不同且 diff_path 不为 NULL 时写出差异图 */
+long panel_diff(const uint16_t (*a)[PANEL_W], const uint16_t (*b)[PANEL_W], const char *diff_path);
+#endif
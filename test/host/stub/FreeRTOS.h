@@ -0,0 +1,31 @@
+/* 主机测试用桩：只提供固件用到的类型、宏和函数声明，实现在 hw.c */
+#ifndef HOST_FREERTOS_H
+#define HOST_FREERTOS_H
+#include <stdint.h>
+#include <stddef.h>
+
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+typedef uint32_t TickType_t;
+typedef void *QueueHandle_t;
+typedef void *SemaphoreHandle_t;
+typedef void *TaskHandle_t;
+
+#define portBASE_TYPE       long
+#define pdTRUE              1
+#define pdFALSE             0
+#define pdPASS              1
+#define pdFAIL              0
+#define portMAX_DELAY       0xffffffffUL
+#define portTICK_PERIOD_MS  1
+#define pdMS_TO_TICKS(x)    (x)
+#define configASSERT(x)
+#define configMAX_TASK_NAME_LEN  16
+#define portYIELD_FROM_ISR(x)        (void)(x)
+#define portEND_SWITCHING_ISR(x)     (void)(x)
+#define taskENTER_CRITICAL()
+#define taskEXIT_CRITICAL()
+
+void *pvPortMalloc(size_t size);
+void vPortFree(void *p);
+#endif
@@ -0,0 +1,4 @@
+#ifndef HOST_ARM_MATH_H
+#define HOST_ARM_MATH_H
+#include <stdint.h>
+#endif
@@ -0,0 +1,15 @@
+#ifndef HOST_CMSIS_OS_H
+#define HOST_CMSIS_OS_H
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+typedef void *osThreadId;
+typedef void *osMutexId;
+#define osWaitForever 0xffffffff
+int osDelay(uint32_t ms);
+int32_t osKernelRunning(void);
+int osRecursiveMutexWait(void *m, uint32_t ms);
+int osRecursiveMutexRelease(void *m);
+int osThreadSuspend(osThreadId t);
+int osThreadResume(osThreadId t);
+#endif
@@ -0,0 +1,4 @@
+#ifndef HOST_FATFS_H
+#define HOST_FATFS_H
+#include "ff.h"
+#endif
@@ -0,0 +1,8 @@
+#ifndef HOST_FF_H
+#define HOST_FF_H
+typedef int FRESULT;
+typedef char TCHAR;
+typedef unsigned int UINT;
+typedef struct { int dummy; } FIL;
+#define FR_OK  0
+#endif
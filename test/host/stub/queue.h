@@ -0,0 +1,4 @@
+#ifndef HOST_QUEUE_H
+#define HOST_QUEUE_H
+#include "FreeRTOS.h"
+#endif
@@ -0,0 +1,4 @@
+#ifndef HOST_STM32F1XX_H
+#define HOST_STM32F1XX_H
+#include "stm32f1xx_hal.h"
+#endif
@@ -0,0 +1,99 @@
+#ifndef HOST_STM32F1XX_HAL_H
+#define HOST_STM32F1XX_HAL_H
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#define __IO    volatile
+#define __weak  __attribute__((weak))
+#define __NOP()
+#define __CLZ(x)  ((uint8_t)((x) ? __builtin_clz(x) : 32))
+
+/* 关中断与模拟的中断处理互斥，见 hw.c */
+void __disable_irq(void);
+void __enable_irq(void);
+uint32_t __get_IPSR(void);
+
+typedef enum { HAL_OK, HAL_ERROR, HAL_BUSY, HAL_TIMEOUT } HAL_StatusTypeDef;
+typedef enum { GPIO_PIN_RESET, GPIO_PIN_SET } GPIO_PinState;
+typedef struct { int dummy; } I2S_HandleTypeDef, TIM_HandleTypeDef, ADC_HandleTypeDef;
+
+/* 外设寄存器：主机上是普通内存，由 hw.c 定义 */
+typedef struct { volatile uint32_t CRL, CRH, IDR, ODR, BSRR, BRR, LCKR; } GPIO_TypeDef;
+typedef struct { volatile uint32_t CCR, CNDTR, CPAR, CMAR; } DMA_Channel_TypeDef;
+typedef struct { volatile uint32_t ISR, IFCR; } DMA_TypeDef;
+typedef struct { volatile uint32_t CTRL, CYCCNT; } DWT_Type;
+typedef struct { volatile uint32_t DEMCR; } CoreDebug_Type;
+
+extern GPIO_TypeDef host_gpio[5];
+extern DMA_Channel_TypeDef host_dma1_ch[7];
+extern DMA_TypeDef host_dma1;
+extern DWT_Type host_dwt;
+DWT_Type *host_dwt_sync(void);  /* CYCCNT 按主机时钟走，见 hw.c */
+extern CoreDebug_Type host_coredebug;
+extern uint32_t SystemCoreClock;
+
+#define GPIOA          (&host_gpio[0])
+#define GPIOB          (&host_gpio[1])
+#define GPIOC          (&host_gpio[2])
+#define GPIOD          (&host_gpio[3])
+#define GPIOE          (&host_gpio[4])
+#define DMA1           (&host_dma1)
+#define DMA1_Channel7  (&host_dma1_ch[6])
+#define DWT            (host_dwt_sync())
+#define CoreDebug      (&host_coredebug)
+
+#define GPIO_PIN_0   0x0001
+#define GPIO_PIN_1   0x0002
+#define GPIO_PIN_2   0x0004
+#define GPIO_PIN_3   0x0008
+#define GPIO_PIN_4   0x0010
+#define GPIO_PIN_5   0x0020
+#define GPIO_PIN_6   0x0040
+#define GPIO_PIN_7   0x0080
+#define GPIO_PIN_8   0x0100
+#define GPIO_PIN_9   0x0200
+#define GPIO_PIN_10  0x0400
+#define GPIO_PIN_11  0x0800
+#define GPIO_PIN_12  0x1000
+#define GPIO_PIN_13  0x2000
+#define GPIO_PIN_14  0x4000
+#define GPIO_PIN_15  0x8000
+
+#define DMA_CCR_EN        0x0001u
+#define DMA_CCR_TCIE      0x0002u
+#define DMA_CCR_DIR       0x0010u
+#define DMA_CCR_PINC      0x0040u
+#define DMA_CCR_MINC      0x0080u
+#define DMA_CCR_PSIZE_1   0x0200u
+#define DMA_CCR_MSIZE_1   0x0800u
+#define DMA_CCR_MEM2MEM   0x4000u
+#define DMA_IFCR_CGIF7    0x01000000u
+
+#define DWT_CTRL_CYCCNTENA_Msk      1u
+#define CoreDebug_DEMCR_TRCENA_Msk  (1u << 24)
+
+#define EXTI9_5_IRQn      23
+#define DMA1_Channel7_IRQn  17
+#define TIM_CHANNEL_3     8
+
+#define __HAL_RCC_DMA1_CLK_ENABLE()
+#define __HAL_GPIO_EXTI_CLEAR_IT(pin)        ((void)(pin))
+#define __HAL_TIM_SET_COMPARE(h, ch, v)      ((void)(v))
+
+void HAL_GPIO_WritePin(GPIO_TypeDef *port, uint16_t pin, GPIO_PinState state);
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef *port, uint16_t pin);
+uint32_t HAL_GetTick(void);
+void HAL_Delay(uint32_t ms);
+void HAL_NVIC_SystemReset(void);
+void HAL_NVIC_SetPriority(int irq, uint32_t pre, uint32_t sub);
+void HAL_NVIC_EnableIRQ(int irq);
+void HAL_NVIC_DisableIRQ(int irq);
+void HAL_NVIC_ClearPendingIRQ(int irq);
+HAL_StatusTypeDef HAL_TIM_PWM_Start(TIM_HandleTypeDef *h, uint32_t ch);
+HAL_StatusTypeDef HAL_TIM_PWM_Stop(TIM_HandleTypeDef *h, uint32_t ch);
+HAL_StatusTypeDef HAL_I2S_Receive_DMA(I2S_HandleTypeDef *h, uint16_t *buf, uint16_t size);
+HAL_StatusTypeDef HAL_ADC_Start(ADC_HandleTypeDef *h);
+HAL_StatusTypeDef HAL_ADC_PollForConversion(ADC_HandleTypeDef *h, uint32_t timeout);
+uint32_t HAL_ADC_GetValue(ADC_HandleTypeDef *h);
+#endif
@@ -0,0 +1,9 @@
+#ifndef HOST_TASK_H
+#define HOST_TASK_H
+#include "FreeRTOS.h"
+TickType_t xTaskGetTickCount(void);
+void vTaskDelay(TickType_t ticks);
+void vTaskSuspendAll(void);
+BaseType_t xTaskResumeAll(void);
+void vTaskList(char *buf);
+#endif
@@ -0,0 +1,48 @@
+#ifndef HOST_USBD_CDC_H
+#define HOST_USBD_CDC_H
+#include <stdint.h>
+#include "stm32f1xx_hal.h"
+
+#define USBD_OK    0
+#define USBD_BUSY  1
+#define USBD_FAIL  2
+#define CDC_DATA_FS_MAX_PACKET_SIZE  64
+
+typedef struct {
+  int8_t (*Init)(void);
+  int8_t (*DeInit)(void);
+  int8_t (*Control)(uint8_t cmd, uint8_t *pbuf, uint16_t length);
+  int8_t (*Receive)(uint8_t *pbuf, uint32_t *Len);
+} USBD_CDC_ItfTypeDef;
+
+/* Src/usbd_cdc_if.c 用到的部分，端点由测试模拟 (test_cdc.c) */
+#define USBD_STATE_CONFIGURED  3
+
+#define CDC_SEND_ENCAPSULATED_COMMAND  0x00
+#define CDC_GET_ENCAPSULATED_RESPONSE  0x01
+#define CDC_SET_COMM_FEATURE           0x02
+#define CDC_GET_COMM_FEATURE           0x03
+#define CDC_CLEAR_COMM_FEATURE         0x04
+#define CDC_SET_LINE_CODING            0x20
+#define CDC_GET_LINE_CODING            0x21
+#define CDC_SET_CONTROL_LINE_STATE     0x22
+#define CDC_SEND_BREAK                 0x23
+
+typedef struct {
+  volatile uint8_t dev_state;
+  void *pClassData;
+} USBD_HandleTypeDef;
+
+typedef struct {
+  uint8_t *TxBuffer;
+  uint8_t *RxBuffer;
+  uint32_t TxLength;
+  volatile uint32_t TxState;
+  volatile uint32_t RxState;
+} USBD_CDC_HandleTypeDef;
+
+uint8_t USBD_CDC_SetTxBuffer(USBD_HandleTypeDef *pdev, uint8_t *pbuff, uint16_t length);
+uint8_t USBD_CDC_SetRxBuffer(USBD_HandleTypeDef *pdev, uint8_t *pbuff);
+uint8_t USBD_CDC_TransmitPacket(USBD_HandleTypeDef *pdev);
+uint8_t USBD_CDC_ReceivePacket(USBD_HandleTypeDef *pdev);
+#endif
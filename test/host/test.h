@@ -0,0 +1,53 @@
+/*-----------------------------------------------------------------------------/
+ * Module       : test.h
+ * Brief        : 主机测试公用的检查和计时
+ 固件源码在 PC 上用 gcc 编译，stub/ 里是 HAL、FreeRTOS 等头文件的桩，
+ 只够让被测文件编译通过。每个测试是一个独立程序，失败时返回非 0。
+/-----------------------------------------------------------------------------*/
+#ifndef HOST_TEST_H
+#define HOST_TEST_H
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+static int test_failures;
+
+#define CHECK(cond, ...) do { \
+  if (!(cond)) { \
+    test_failures++; \
+    printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+    printf(__VA_ARGS__); \
+    printf("\n"); \
+  } \
+} while (0)
+
+static inline double now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// 可重复的伪随机数，各测试结果与机器无关
+static uint32_t rng_state = 2463534242u;
+
+static inline uint32_t rng_u32(void)
+{
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 17;
+  rng_state ^= rng_state << 5;
+  return rng_state;
+}
+
+// [lo, hi) 均匀分布
+static inline double rng_uniform(double lo, double hi)
+{
+  return lo + (hi - lo) * (rng_u32() / 4294967296.0);
+}
+
+static inline int test_result(const char *name)
+{
+  printf("%s: %s\n", name, test_failures ? "FAILED" : "ok");
+  return test_failures != 0;
+}
+#endif
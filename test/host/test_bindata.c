@@ -0,0 +1,151 @@
+/*-----------------------------------------------------------------------------/
+ * Module       : test_bindata.c
+ * Brief        : bindata 命令的帧格式
+ 这里直接包含 appvna.c，命令经 host_command 执行，输出按帧解码检查：
+ - crc32 与标准 CRC-32 (zlib) 一致
+ - 帧头、CRC、数据与 frequencies/measured/cal_data/数据记忆相同，
+   同一条命令的各帧序号相同，发送结束时取消暂缓
+ - 参数里有不认识的数组时只回 usage，不发任何帧
+/-----------------------------------------------------------------------------*/
+#include "../../Usr/appvna.c"
+#include "hw.h"
+#include "test.h"
+
+void cmd_register(void);
+
+#define MAX_FRAMES  16
+
+typedef struct {
+  bin_header_t h;
+  const uint8_t *data;
+} frame_t;
+
+// 逐位计算的 CRC-32，作为参考
+static uint32_t crc32_ref(const uint8_t *p, int len)
+{
+  uint32_t crc = 0xffffffff;
+  int k;
+
+  while (len-- > 0) {
+    crc ^= *p++;
+    for (k = 0; k < 8; k++)
+      crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+  }
+  return ~crc;
+}
+
+/*
+ * 把命令输出拆成帧，返回帧数，格式错误返回 -1
+ */
+static int parse_frames(const uint8_t *p, int len, frame_t *f, int max)
+{
+  int n = 0;
+
+  while (len > 0) {
+    if (n == max || len < (int)sizeof f->h)
+      return -1;
+    memcpy(&f[n].h, p, sizeof f->h);
+    p += sizeof f->h;
+    len -= sizeof f->h;
+    if (f[n].h.magic != BIN_MAGIC || f[n].h.size > len)
+      return -1;
+    f[n].data = p;
+    p += f[n].h.size;
+    len -= f[n].h.size;
+    n++;
+  }
+  return n;
+}
+
+static int command_frames(const char *line, frame_t *f)
+{
+  int start = host_cdc_len;
+  int len = host_command(line);
+  return parse_frames(host_cdc_out + start, len, f, MAX_FRAMES);
+}
+
+static void test_crc(void)
+{
+  static uint8_t buf[4096];
+  int i, n;
+
+  CHECK(crc32(0, "123456789", 9) == 0xCBF43926, "crc32 check value %08x",
+        crc32(0, "123456789", 9));
+  CHECK(crc32(0, "", 0) == 0, "crc32 of nothing");
+  for (n = 0; n < 200; n++) {
+    int len = rng_u32() % sizeof buf, cut = len ? rng_u32() % len : 0;
+    for (i = 0; i < len; i++)
+      buf[i] = rng_u32();
+    CHECK(crc32(0, buf, len) == crc32_ref(buf, len), "crc32 of %d bytes", len);
+    CHECK(crc32(crc32(0, buf, cut), buf + cut, len - cut) == crc32(0, buf, len),
+          "crc32 split at %d of %d", cut, len);
+  }
+}
+
+static void check_frame(const frame_t *f, int array, int format, const void *data, int points)
+{
+  int size = points * (format == BIN_FMT_U32 ? 4 : 8);
+
+  CHECK(f->h.array == array && f->h.format == format, "frame %d: array %d format %d",
+        array, f->h.array, f->h.format);
+  CHECK(f->h.points == points && f->h.size == size, "frame %d: %d points %d bytes",
+        array, f->h.points, f->h.size);
+  CHECK(f->h.crc == crc32_ref(f->data, f->h.size), "frame %d: bad crc", array);
+  CHECK(f->h.size == size && memcmp(f->data, data, size) == 0, "frame %d: data differs", array);
+}
+
+static void test_frames(void)
+{
+  static const char *bad[] = {
+    "bindata", "bindata x", "bindata 0 9", "bindata f 10", "bindata zz 0", "bindata 0 -1",
+  };
+  static float mem[SWEEP_POINTS][2];
+  frame_t f[MAX_FRAMES];
+  unsigned b;
+  int i, k, n, start;
+
+  for (i = 0; i < sweep_points; i++)
+    for (k = 0; k < 2; k++) {
+      measured[0][i][k] = rng_uniform(-1, 1);
+      measured[1][i][k] = rng_uniform(-1, 1);
+      cal_data[CAL_LOAD][i][k] = rng_uniform(-0.1, 0.1);
+    }
+  trace_memory_store();
+  for (i = 0; i < sweep_points; i++)
+    trace_memory_get(0, i, mem[i]);
+  sweep_count = 1234;
+
+  n = command_frames("bindata f 0 1 4 7", f);
+  CHECK(n == 5, "bindata f 0 1 4 7: %d frames", n);
+  if (n == 5) {
+    check_frame(&f[0], 'f', BIN_FMT_U32, frequencies, sweep_points);
+    check_frame(&f[1], 0, BIN_FMT_F32X2, measured[0], sweep_points);
+    check_frame(&f[2], 1, BIN_FMT_F32X2, measured[1], sweep_points);
+    check_frame(&f[3], 4, BIN_FMT_F32X2, cal_data[4 - 2], sweep_points);
+    check_frame(&f[4], 7, BIN_FMT_F32X2, mem, sweep_points);
+    for (i = 0; i < n; i++)
+      CHECK(f[i].h.seq == 1234, "frame %d seq %u", i, f[i].h.seq);
+  }
+  CHECK(host_cdc_hold == 0, "TX hold left on");
+
+  for (b = 0; b < sizeof bad / sizeof bad[0]; b++) {
+    start = host_cdc_len;
+    n = host_command(bad[b]);
+    CHECK(n > 6 && memcmp(host_cdc_out + start, "usage:", 6) == 0 &&
+          memchr(host_cdc_out + start, '\n', n) == host_cdc_out + start + n - 1,
+          "\"%s\" did not answer with one usage line", bad[b]);
+  }
+}
+
+int main(void)
+{
+  mutex = xSemaphoreCreateRecursiveMutex();
+  cmd_register();
+  frequency0 = 1000000;
+  frequency1 = 300000000;
+  update_frequencies();
+
+  test_crc();
+  test_frames();
+  return test_result("bindata");
+}
@@ -0,0 +1,229 @@
+/*-----------------------------------------------------------------------------/
+ * Module       : test_binpack.c
+ * Brief        : bindata 压缩格式的往返
+ 这里直接包含 appvna.c，用 bin_pack_u32/bin_pack_f32x2 压缩，
+ 用主机端的解码 (tools/vna.c) 展开：
+ - BIN_FMT_U32DD 无损：等间隔扫描、任意 uint32 (差分溢出、5 字节 varint)
+ - BIN_FMT_I16X2 每块误差不超过 2^(e-1)，e 是块里的指数，
+   也就不超过块内最大值的 1/32767；NaN 变成 0，inf 饱和，
+   都不影响同块的其他点，很小的值不会溢出
+ - 大小：等间隔扫描每点约 1 字节，S 参数为原来的一半加每块 1 字节
+ - "bindata z f 0 1" 的帧经 vna_frame 检查 CRC 后展开，与测量数组一致
+/-----------------------------------------------------------------------------*/
+#include "../../Usr/appvna.c"
+#include "../../tools/vna.h"
+#include "hw.h"
+#include "test.h"
+
+void cmd_register(void);
+
+#define ROUNDS      20000
+#define MAX_POINTS  VNA_POINTS_MAX
+
+static uint8_t packed[MAX_POINTS * 8 + MAX_POINTS / BIN_BLOCK + 16];
+
+static vna_header_t header(int format, int points, int size)
+{
+  vna_header_t h;
+
+  memset(&h, 0, sizeof h);
+  h.magic = VNA_BIN_MAGIC;
+  h.format = format;
+  h.points = points;
+  h.size = size;
+  return h;
+}
+
+/*
+=======================================
+    BIN_FMT_U32DD
+=======================================
+*/
+static void test_u32(void)
+{
+  static uint32_t v[MAX_POINTS], got[MAX_POINTS];
+  uint32_t linear_bytes = 0, linear_points = 0;
+  int r, i, n, points, linear;
+  vna_header_t h;
+
+  for (r = 0; r < ROUNDS; r++) {
+    points = rng_u32() % (MAX_POINTS + 1);
+    linear = r & 1;
+    if (linear) {  // 同 set_frequencies 的取整
+      uint32_t start = rng_u32() % 900000000, span = rng_u32() % (900000000 - start);
+      for (i = 0; i < points; i++)
+        v[i] = start + (uint32_t)((uint64_t)span * i / (points > 1 ? points - 1 : 1));
+    } else {
+      for (i = 0; i < points; i++)
+        v[i] = rng_u32() >> (rng_u32() % 32);
+    }
+    n = bin_pack_u32(packed, v, points);
+    CHECK(n <= (points ? 4 + (points - 1) * 5 : 0), "u32: %d bytes for %d points", n, points);
+    h = header(VNA_FMT_U32DD, points, n);
+    CHECK(vna_decode_u32(&h, packed, got) == points &&
+          memcmp(got, v, points * sizeof v[0]) == 0, "u32: %d points do not round-trip", points);
+    if (linear && points > 1) {
+      // 第一个差分最多 5 字节，之后二阶差分只有取整误差
+      CHECK(n <= 9 + (points - 2), "u32: linear sweep of %d points in %d bytes", points, n);
+      linear_bytes += n;
+      linear_points += points;
+    }
+  }
+
+  // 截短或多出的数据不能当作完整的帧
+  for (i = 0; i < 101; i++)
+    v[i] = 50000 + i * 9000000u;
+  n = bin_pack_u32(packed, v, 101);
+  h = header(VNA_FMT_U32DD, 101, n - 1);
+  CHECK(vna_decode_u32(&h, packed, got) < 0, "u32: truncated data decoded");
+  h = header(VNA_FMT_U32DD, 100, n);
+  CHECK(vna_decode_u32(&h, packed, got) < 0, "u32: trailing data accepted");
+  printf("  u32: %d arrays round-trip, linear sweeps %.2f bytes/point\n",
+         ROUNDS, (double)linear_bytes / linear_points);
+}
+
+/*
+=======================================
+    BIN_FMT_I16X2
+=======================================
+*/
+// 每块的量级不同，有零、负数、很小的值、NaN 和 inf
+static void random_block(float (*v)[2], int m)
+{
+  int j, scale = (int)(rng_u32() % 200) - 140, kind = rng_u32() % 8;
+
+  for (j = 0; j < m * 2; j++) {
+    float x = ldexpf((float)rng_uniform(-1, 1), scale);
+    if (kind == 0)
+      x = 0;
+    else if (kind == 1 && rng_u32() % 4 == 0)
+      x = 0;
+    else if (kind == 2 && rng_u32() % 8 == 0)
+      x = NAN;
+    else if (kind == 3)
+      x = ldexpf(x, -(int)(rng_u32() % 30));  // 块内量级相差很大
+    else if (kind == 4 && rng_u32() % 16 == 0)
+      x = rng_u32() & 1 ? INFINITY : -INFINITY;
+    v[j / 2][j & 1] = x;
+  }
+}
+
+static void test_f32x2(void)
+{
+  static float v[MAX_POINTS][2], got[MAX_POINTS][2];
+  double worst = 0;
+  int r, i, j, k, m, n, e, points, off, bad;
+  float x, max, err;
+  vna_header_t h;
+
+  for (r = 0; r < ROUNDS; r++) {
+    points = rng_u32() % (MAX_POINTS + 1);
+    for (i = 0; i < points; i += BIN_BLOCK)
+      random_block(v + i, points - i < BIN_BLOCK ? points - i : BIN_BLOCK);
+    n = bin_pack_f32x2(packed, (const float (*)[2])v, points);
+    CHECK(n == points * 4 + (points + BIN_BLOCK - 1) / BIN_BLOCK,
+          "f32x2: %d bytes for %d points", n, points);
+    h = header(VNA_FMT_I16X2, points, n);
+    if (vna_decode_f32x2(&h, packed, got) != points) {
+      CHECK(0, "f32x2: %d points do not decode", points);
+      continue;
+    }
+    for (i = 0, off = 0; i < points; i += BIN_BLOCK) {
+      m = points - i < BIN_BLOCK ? points - i : BIN_BLOCK;
+      e = (int8_t)packed[off];
+      off += 1 + m * 4;
+      max = 0;
+      for (j = 0; j < m * 2; j++)
+        if (isfinite(v[i + j / 2][j & 1]))
+          max = fmaxf(max, fabsf(v[i + j / 2][j & 1]));
+      for (j = 0, bad = 0; j < m * 2; j++) {
+        k = i + j / 2;
+        x = v[k][j & 1];
+        if (x != x) {
+          CHECK(got[k][j & 1] == 0, "f32x2: NaN decoded as %g", got[k][j & 1]);
+          continue;
+        }
+        if (isinf(x)) {  // 饱和成块内能表示的最大值
+          CHECK(got[k][j & 1] == ldexpf(x > 0 ? 32767 : -32767, e),
+                "f32x2: %g decoded as %g", x, got[k][j & 1]);
+          continue;
+        }
+        err = fabsf(got[k][j & 1] - x);
+        if (err > ldexpf(1, e - 1) || (e > -120 && err > max / 32767))
+          bad++;
+        if (e > -120 && err / max > worst)  // -120 时是很小的值，只有绝对误差
+          worst = err / max;
+      }
+      CHECK(bad == 0, "f32x2: block at %d (e %d, max %g): %d values off", i, e, max, bad);
+    }
+  }
+
+  h = header(VNA_FMT_I16X2, 17, 2 + 17 * 4 - 1);
+  CHECK(vna_decode_f32x2(&h, packed, got) < 0, "f32x2: truncated data decoded");
+  printf("  f32x2: %d arrays round-trip, worst error %.3g of the block max (bound %.3g)\n",
+         ROUNDS, worst, 1.0 / 32767);
+}
+
+/*
+=======================================
+    经 bindata 命令
+=======================================
+*/
+static void test_command(void)
+{
+  static uint32_t f[MAX_POINTS];
+  static float s[MAX_POINTS][2];
+  const uint8_t *p, *d;
+  vna_header_t h;
+  int start, len, n, k, i, raw;
+  float err, max;
+
+  for (i = 0; i < sweep_points; i++) {  // 没有扫描，直接填测量数组
+    measured[0][i][0] = (float)rng_uniform(-1, 1);
+    measured[0][i][1] = (float)rng_uniform(-1, 1);
+    measured[1][i][0] = (float)rng_uniform(-1e-3, 1e-3);
+    measured[1][i][1] = (float)rng_uniform(-1e-3, 1e-3);
+  }
+  raw = sweep_points * 4 + 2 * sweep_points * 8;
+
+  start = host_cdc_len;
+  len = host_command("bindata z f 0 1");
+  p = host_cdc_out + start;
+  CHECK(len < raw * 2 / 3, "bindata z: %d bytes, %d unpacked", len, raw);
+  for (k = 0; k < 3; k++) {
+    n = vna_frame(p, len, &h, &d);
+    if (n == 0) {
+      CHECK(0, "bindata z: frame %d bad", k);
+      return;
+    }
+    if (k == 0) {
+      CHECK(h.array == 'f' && vna_decode_u32(&h, d, f) == sweep_points &&
+            memcmp(f, frequencies, sweep_points * 4) == 0, "bindata z: frequencies differ");
+    } else {
+      CHECK(h.array == k - 1 && vna_decode_f32x2(&h, d, s) == sweep_points,
+            "bindata z: array %d does not decode", k - 1);
+      for (i = 0; i < sweep_points; i++) {
+        max = k == 1 ? 1 : 1e-3f;  // 每块最大值的上限
+        err = fmaxf(fabsf(s[i][0] - measured[k - 1][i][0]), fabsf(s[i][1] - measured[k - 1][i][1]));
+        CHECK(err <= max / 32767, "bindata z: array %d point %d error %g", k - 1, i, err);
+      }
+    }
+    p += n;
+    len -= n;
+  }
+  CHECK(len == 0, "bindata z: %d bytes after the frames", len);
+}
+
+int main(void)
+{
+  mutex = xSemaphoreCreateRecursiveMutex();
+  cmd_register();
+  frequency0 = 1000000;
+  frequency1 = 300000000;
+  update_frequencies();
+
+  test_u32();
+  test_f32x2();
+  test_command();
+  return test_result("binpack");
+}
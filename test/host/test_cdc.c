@@ -0,0 +1,388 @@
+/*-----------------------------------------------------------------------------/
+ * Module       : test_cdc.c
+ * Brief        : USB 串口 (Src/usbd_cdc_if.c) 的发送环形缓冲区和接收槽
+ 这里直接包含 usbd_cdc_if.c，USB 库换成 hw.c 模拟的端点。
+ IN 端点：端点线程按 64 字节分包取走传输的数据，每包等一段时间，
+ 然后在模拟的中断里调用 CDC_TxComplete_FS。检查：
+ - 主机收到的字节流与写入的完全相同，包长不超过 64
+ - 缓冲区发空时最后一包不满 64 字节 (必要时补零长度包)，主机能分出传输
+ - 只有已写入的数据的最后一包不满，跨过缓冲区末尾时也一样
+ - 批处理暂缓时只发整包；CDC_TryTransmit_FS 整段写入或整段丢弃，
+   有任务正在写或命令执行中 (CDC_TxLock_FS) 时不插入；中断里放不下时返回 USBD_BUSY
+ - cdc_stats 与端点实际发出的一致
+ 并统计各种写法的包数和吞吐量，与原来每次调用单独传输 (一次至少一包) 比较。
+ OUT 端点：另一个线程用 host_usb_out 把数据分包写进当前的接收槽，在模拟的中断里调用
+ CDC_Receive_FS；没有准备接收时主机等待 (NAK)。命令任务一侧用 serial.c
+ 的 usSerialGetSpan/vSerialConsume 每次取走一段，检查：
+ - 收到的字节流完整、顺序不变，包括零长度包、槽全满暂停接收之后
+ - 每个包只通知一次 (原来每个字节一次入队、一次出队)
+/-----------------------------------------------------------------------------*/
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "../../Src/usbd_cdc_if.c"
+#include "serial.h"
+#include "hw.h"
+#include "test.h"
+
+#define PACKET      CDC_DATA_FS_MAX_PACKET_SIZE
+#define STREAM_MAX  (1024*1024)
+
+/*
+=======================================
+    主机一侧的 IN 端点 (端点的模拟见 hw.c)
+=======================================
+*/
+static uint8_t sent[STREAM_MAX], got[STREAM_MAX];
+static int sent_len, got_len;
+static uint32_t packets, short_packets, transfers, bad_packets, idle_full, early_short;
+static int last_packet;
+
+/* 传输开始时：不满一包的只能是已写入的数据的最后一包，批处理暂缓时不发零头 */
+static void in_start(const uint8_t *p, int len)
+{
+  int queued = (tx_head - tx_tail) & (APP_TX_RING_SIZE - 1);
+
+  (void)p;
+  if (len % PACKET && (len < queued || tx_hold))
+    early_short++;
+}
+
+// 主机收到一个包
+static void host_packet(const uint8_t *p, int n)
+{
+  if (n > PACKET || got_len + n > STREAM_MAX) {
+    bad_packets++;
+    return;
+  }
+  memcpy(got + got_len, p, n);
+  got_len += n;
+  packets++;
+  if (n < PACKET)
+    short_packets++;
+  last_packet = n;
+}
+
+static void in_transfer(const uint8_t *p, int len)
+{
+  int n;
+
+  transfers++;
+  do {
+    n = len > PACKET ? PACKET : len;
+    host_packet(p, n);
+    p += n;
+    len -= n;
+  } while (len > 0);
+}
+
+static void in_done(void)
+{
+  if (!host_usb_cdc.TxState && !tx_hold && tx_head == tx_tail && last_packet == PACKET)
+    idle_full++;  // 发空了，主机却等不到传输结束
+}
+
+/*
+=======================================
+    写入和检查
+=======================================
+*/
+static void drain(void)
+{
+  int t;
+  for (t = 0; t < 5000 && (tx_head != tx_tail || host_usb_cdc.TxState || tx_zlp); t++)
+    usleep(1000);
+  CHECK(tx_head == tx_tail && !host_usb_cdc.TxState, "TX ring did not drain");
+}
+
+static void reset(void)
+{
+  drain();
+  sent_len = got_len = 0;
+  packets = short_packets = transfers = bad_packets = idle_full = early_short = 0;
+  memset(&cdc_stats, 0, sizeof cdc_stats);
+}
+
+static uint8_t send(int len)
+{
+  uint8_t r;
+  int i;
+
+  if (sent_len + len > STREAM_MAX)
+    abort();
+  for (i = 0; i < len; i++)
+    sent[sent_len + i] = rng_u32();
+  r = CDC_Transmit_FS(sent + sent_len, len);
+  if (r == USBD_OK)
+    sent_len += len;
+  return r;
+}
+
+static uint8_t try_send(int len)
+{
+  uint8_t r;
+  int i;
+
+  if (sent_len + len > STREAM_MAX)
+    abort();
+  for (i = 0; i < len; i++)
+    sent[sent_len + i] = rng_u32();
+  r = CDC_TryTransmit_FS(sent + sent_len, len);
+  if (r == USBD_OK)
+    sent_len += len;
+  return r;
+}
+
+static void check_stream(const char *name)
+{
+  drain();
+  CHECK(got_len == sent_len && memcmp(got, sent, sent_len) == 0,
+        "%s: host got %d bytes, %d sent", name, got_len, sent_len);
+  CHECK(bad_packets == 0, "%s: %u oversized packets", name, bad_packets);
+  CHECK(idle_full == 0, "%s: ring went idle %u times after a full packet", name, idle_full);
+  CHECK(last_packet < PACKET, "%s: stream ended with a full packet", name);
+  CHECK(early_short == 0, "%s: %u short packets with more data queued", name, early_short);
+  CHECK(cdc_stats.tx_bytes == (uint32_t)got_len && cdc_stats.tx_packets == packets &&
+        cdc_stats.tx_transfers == transfers, "%s: stats %u bytes %u packets %u transfers, "
+        "endpoint %d/%u/%u", name, cdc_stats.tx_bytes, cdc_stats.tx_packets,
+        cdc_stats.tx_transfers, got_len, packets, transfers);
+}
+
+/*
+ * 一种写法：calls 次，每次 lo~hi 字节
+ * 原来的 CDC_Transmit_FS 每次调用单独传输，至少一包，还要等上一次发完
+ */
+static void scenario(const char *name, int calls, int lo, int hi, int hold)
+{
+  uint32_t legacy = 0;
+  double t0, t1, t2;
+  int i, len;
+
+  reset();
+  t0 = now_ns();
+  if (hold)
+    CDC_TxHold_FS(1);
+  for (i = 0; i < calls; i++) {
+    len = lo + rng_u32() % (hi - lo + 1);
+    legacy += (len + PACKET - 1) / PACKET;
+    send(len);
+  }
+  if (hold)
+    CDC_TxHold_FS(0);
+  t1 = now_ns();
+  drain();
+  t2 = now_ns();
+  check_stream(name);
+  printf("  %-10s %6d calls %7d bytes: %5u packets (%u short) in %4u transfers, "
+         "one transfer per call %5u; %4.0f KB/s, %5.1f us/call\n",
+         name, calls, sent_len, packets, short_packets, transfers, legacy,
+         sent_len / ((t2 - t0) / 1e9) / 1024, (t1 - t0) / calls / 1e3);
+  if (lo == 1 && hi == 1)
+    CHECK(packets < (uint32_t)calls / 4, "%s: %u packets for %d bytes", name, packets, calls);
+  if (hold)
+    CHECK(short_packets <= 1, "%s: %u short packets while held", name, short_packets);
+}
+
+/*
+=======================================
+    跨过缓冲区末尾
+=======================================
+*/
+/* tx_tail 停在缓冲区末尾前 10 字节：第一次传输接上开头的 54 字节凑成整包 */
+static void test_wrap(int hold)
+{
+  const char *name = hold ? "held wrap" : "wrap";
+
+  reset();
+  __disable_irq();
+  tx_head = tx_tail = APP_TX_RING_SIZE - 10;
+  __enable_irq();
+  if (hold)
+    CDC_TxHold_FS(1);
+  send(200);
+  if (hold)
+    CDC_TxHold_FS(0);
+  check_stream(name);
+  CHECK(packets == 4 && short_packets == 1, "%s: 200 bytes in %u packets, %u short",
+        name, packets, short_packets);
+}
+
+/*
+=======================================
+    CDC_TryTransmit_FS、中断里写入、没有连接
+=======================================
+*/
+static void test_try(void)
+{
+  int accepted = 0;
+  uint16_t head;
+
+  reset();
+  host_usb_in_pause(1);
+  while (try_send(100) == USBD_OK)
+    accepted += 100;
+  CHECK(accepted > APP_TX_RING_SIZE - 1 - 100 && accepted < APP_TX_RING_SIZE,
+        "try: %d bytes accepted by a stalled endpoint", accepted);
+  CHECK(try_send(1) == USBD_OK || accepted == APP_TX_RING_SIZE - 1, "try: room left unused");
+  host_usb_in_pause(0);
+  drain();
+
+  // 其他任务分段写入的中途不插入
+  tx_writer = 1;
+  CHECK(try_send(10) == USBD_BUSY, "try: wrote into another writer's message");
+  tx_writer = 0;
+  CHECK(try_send(10) == USBD_OK, "try: refused with an idle ring");
+
+  // 命令执行期间也不插入，命令自己的输出照常
+  CDC_TxLock_FS(1);
+  CHECK(try_send(10) == USBD_BUSY, "try: wrote into a command's output");
+  host_irq_enter();
+  CHECK(send(10) == USBD_BUSY, "ISR: wrote into a command's output");
+  host_irq_exit();
+  CHECK(send(10) == USBD_OK, "command output refused");
+  CDC_TxLock_FS(0);
+
+  // 中断里不等待，放不下整段时什么也不写
+  host_usb_in_pause(1);
+  while (try_send(PACKET) == USBD_OK)
+    ;
+  head = tx_head;
+  host_irq_enter();
+  CHECK(send(PACKET) == USBD_BUSY && tx_head == head, "ISR: partial write into a full ring");
+  host_irq_exit();
+  host_usb_in_pause(0);
+  drain();
+  host_irq_enter();
+  CHECK(send(PACKET) == USBD_OK, "ISR: refused with an idle ring");
+  host_irq_exit();
+  check_stream("try");
+
+  // 没有连接时丢掉
+  hUsbDeviceFS.dev_state = 0;
+  CHECK(send(10) == USBD_FAIL && try_send(10) == USBD_FAIL, "sent while not configured");
+  hUsbDeviceFS.dev_state = USBD_STATE_CONFIGURED;
+  CHECK(tx_head == tx_tail, "data queued while not configured");
+}
+
+/*
+=======================================
+    主机一侧的 OUT 端点
+=======================================
+*/
+static uint8_t out_data[STREAM_MAX];
+static volatile int out_len, out_pos;
+static int out_lo, out_hi;  // 包长范围
+static volatile uint32_t out_packets, out_naks;
+
+static void *out_endpoint(void *arg)
+{
+  int n;
+
+  (void)arg;
+  for (;;) {
+    if (out_pos == out_len) {
+      usleep(100);
+      continue;
+    }
+    n = out_lo + rng_u32() % (out_hi - out_lo + 1);
+    if (n > out_len - out_pos)
+      n = out_len - out_pos;
+    if (host_usb_out(out_data + out_pos, n)) {
+      out_pos += n;
+      out_packets++;
+      usleep(host_usb_packet_us);
+    } else {
+      out_naks++;
+      usleep(20);
+    }
+  }
+  return NULL;
+}
+
+/*
+ * 主机发 bytes 字节，包长 lo~hi；命令任务每次取一段里的一部分，
+ * 取到后等 consume_us，bytewise 时用 xSerialGetChar 逐字节取
+ */
+static void rx_scenario(const char *name, int bytes, int lo, int hi, int consume_us, int bytewise)
+{
+  static uint8_t rx[STREAM_MAX];
+  xComPortHandle port = xSerialPortInitMinimal(0, 0);
+  const signed char *span;
+  double t0, t1;
+  int i, n, rx_len = 0, timeouts = 0;
+
+  memset(&cdc_stats, 0, sizeof cdc_stats);
+  out_packets = out_naks = 0;
+  for (i = 0; i < bytes; i++)
+    out_data[i] = rng_u32();
+  t0 = now_ns();
+  out_lo = lo;
+  out_hi = hi;
+  out_pos = 0;
+  out_len = bytes;
+  while (rx_len < bytes && timeouts < 20) {
+    if (bytewise) {
+      signed char c;
+      if (xSerialGetChar(port, &c, 100))
+        rx[rx_len++] = c;
+      else
+        timeouts++;
+      continue;
+    }
+    n = usSerialGetSpan(port, &span, 100);
+    if (n == 0) {
+      timeouts++;
+      continue;
+    }
+    n = 1 + rng_u32() % n;  // 像命令解析一样在行尾停下
+    memcpy(rx + rx_len, span, n);
+    rx_len += n;
+    vSerialConsume(port, n);
+    if (consume_us)
+      usleep(consume_us);
+  }
+  t1 = now_ns();
+  CHECK(rx_len == bytes && memcmp(rx, out_data, bytes) == 0,
+        "%s: got %d of %d bytes", name, rx_len, bytes);
+  CHECK(cdc_stats.rx_packets == out_packets && cdc_stats.rx_bytes == (uint32_t)bytes,
+        "%s: stats %u packets %u bytes, sent %u packets", name, cdc_stats.rx_packets,
+        cdc_stats.rx_bytes, out_packets);
+  CHECK(CDC_RxPeek_FS((uint8_t **)&span) < 0, "%s: data left in the slots", name);
+  printf("  %-10s %7d bytes in %5u packets, %5u NAKs; %4.0f KB/s; "
+         "notifications %u, per-byte queue %d\n", name, bytes, out_packets, out_naks,
+         bytes / ((t1 - t0) / 1e9) / 1024, cdc_stats.rx_packets, 2 * bytes);
+  if (consume_us >= 200)
+    CHECK(out_naks > 0, "%s: slots never filled up", name);
+}
+
+int main(void)
+{
+  pthread_t th;
+
+  host_usb_in_start = in_start;
+  host_usb_in = in_transfer;
+  host_usb_in_done = in_done;
+  host_usb_start();
+  pthread_create(&th, NULL, out_endpoint, NULL);
+
+  scenario("echo", 20000, 1, 1, 0);
+  scenario("lines", 4000, 1, 80, 0);
+  scenario("packets", 2000, 64, 64, 0);
+  scenario("bulk", 200, 1, 3000, 0);
+  scenario("held echo", 20000, 1, 1, 1);
+  scenario("held line", 4000, 1, 80, 1);
+  host_usb_packet_us = 0;  // 端点不等待，检查并发
+  scenario("no delay", 8000, 1, 200, 0);
+  host_usb_packet_us = 50;
+  test_wrap(0);
+  test_wrap(1);
+  test_try();
+
+  rx_scenario("typed", 2000, 1, 4, 0, 1);
+  rx_scenario("script", 200000, 64, 64, 0, 0);
+  rx_scenario("mixed", 200000, 0, 64, 0, 0);
+  rx_scenario("slow task", 50000, 64, 64, 200, 0);
+  host_usb_packet_us = 0;
+  rx_scenario("no delay", 500000, 0, 64, 0, 0);
+  return test_result("cdc");
+}
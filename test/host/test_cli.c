@@ -0,0 +1,192 @@
+/*-----------------------------------------------------------------------------/
+ * Module       : test_cli.c
+ * Brief        : 命令表 (FreeRTOS-Plus-CLI/FreeRTOS_CLI.c) 的注册、查找和参数切分
+ 这里直接包含 FreeRTOS_CLI.c，命令用 appvna.c 的 cmd_register 注册。
+ - 注册后表按命令名严格递增，configCLI_MAX_COMMANDS 至少还有 16 个空位
+ - 二分查找：每个命令都能找到，前缀、加长、表外的名字找不到
+ - 重名的命令不注册，原来的不变；表满时返回 pdFAIL，不停机
+ - FreeRTOS_CLIProcessCommand：行首、参数之间和行尾的多个空格，
+   参数正好 configCLI_MAX_ARGS 个时照常执行，多一个时 prvGetNumberOfParameters
+   返回 -1，不执行，输出 "Incorrect command parameter(s)"；参数个数固定的命令
+   个数不对时同样；空行和不认识的命令输出 "Command not recognised"
+/-----------------------------------------------------------------------------*/
+#include "../../FreeRTOS-Plus-CLI/FreeRTOS_CLI.c"
+#include "hw.h"
+#include "test.h"
+
+void cmd_register(void);
+
+#define HEADROOM  16
+
+static int calls, last_argc;
+static const char *last_argv[configCLI_MAX_ARGS];
+
+static void cmd_probe(char *chp, int argc, const char *argv[])
+{
+  int i;
+
+  (void)chp;
+  calls++;
+  last_argc = argc;
+  for (i = 0; i < argc; i++)
+    last_argv[i] = argv[i];
+}
+
+static const CLI_Command_Definition_t x_cmd_probe = {
+"probe", "usage: probe [args]\r\n", cmd_probe, -1};
+static const CLI_Command_Definition_t x_cmd_probe2 = {
+"probe2", "usage: probe2 {a} {b}\r\n", cmd_probe, 2};
+static const CLI_Command_Definition_t x_cmd_probe_dup = {
+"probe", "duplicate\r\n", cmd_probe, 0};
+
+/* 执行一行，返回输出 */
+static const char *run(const char *line)
+{
+  static char buf[256];
+  int start = host_cdc_len;
+
+  strncpy(buf, line, sizeof buf - 1);
+  FreeRTOS_CLIProcessCommand(buf, FreeRTOS_CLIGetOutputBuffer(), config_MAX_OUTPUT_SIZE);
+  host_cdc_out[host_cdc_len] = 0;
+  return (const char *)host_cdc_out + start;
+}
+
+/*
+=======================================
+    注册和查找
+=======================================
+*/
+static void test_table(void)
+{
+  static const char *missing[] = { "", "a", "fre", "freqq", "helpx", "zzz", "Help", "~" };
+  char name[32];
+  UBaseType_t i, n;
+  size_t k;
+
+  cmd_register();
+  n = uxRegisteredCommands;
+  printf("  %u commands registered, table of %d\n", (unsigned)n, configCLI_MAX_COMMANDS);
+  CHECK(n + HEADROOM <= configCLI_MAX_COMMANDS, "%u commands leave %u free slots of %d",
+        (unsigned)n, (unsigned)(configCLI_MAX_COMMANDS - n), configCLI_MAX_COMMANDS);
+  for (i = 1; i < n; i++)
+    CHECK(strcmp(pxRegisteredCommands[i - 1]->pcCommand, pxRegisteredCommands[i]->pcCommand) < 0,
+          "table not sorted at %u: %s, %s", (unsigned)i, pxRegisteredCommands[i - 1]->pcCommand,
+          pxRegisteredCommands[i]->pcCommand);
+
+  for (i = 0; i < n; i++) {
+    const char *s = pxRegisteredCommands[i]->pcCommand;
+    CHECK(prvFindCommand(s) == pxRegisteredCommands[i], "\"%s\" not found", s);
+    snprintf(name, sizeof name, "%s_", s);  // 加长
+    CHECK(prvFindCommand(name) == NULL, "\"%s\" found", name);
+    if (strlen(s) > 1) {  // 前缀，除非它本身也是一个命令
+      snprintf(name, sizeof name, "%.*s", (int)strlen(s) - 1, s);
+      CHECK(prvFindCommand(name) == NULL || strcmp(prvFindCommand(name)->pcCommand, name) == 0,
+            "prefix \"%s\" matched", name);
+    }
+  }
+  for (k = 0; k < sizeof missing / sizeof missing[0]; k++)
+    CHECK(prvFindCommand(missing[k]) == NULL, "\"%s\" found", missing[k]);
+
+  // 重名的不注册
+  CHECK(FreeRTOS_CLIRegisterCommand(&x_cmd_probe) == pdPASS, "probe not registered");
+  CHECK(FreeRTOS_CLIRegisterCommand(&x_cmd_probe2) == pdPASS, "probe2 not registered");
+  n = uxRegisteredCommands;
+  CHECK(FreeRTOS_CLIRegisterCommand(&x_cmd_probe_dup) == pdFAIL && uxRegisteredCommands == n &&
+        prvFindCommand("probe") == &x_cmd_probe, "duplicate \"probe\" replaced the first one");
+  CHECK(FreeRTOS_CLIRegisterCommand(&x_cmd_help) == pdFAIL, "\"help\" registered twice");
+}
+
+/*
+=======================================
+    参数切分
+=======================================
+*/
+static void test_args(void)
+{
+  const char *args[configCLI_MAX_ARGS];
+  char line[256], copy[256];
+  const char *out;
+  int i, n;
+
+  calls = 0;
+  run("probe a b");
+  CHECK(calls == 1 && last_argc == 2 && strcmp(last_argv[0], "a") == 0 &&
+        strcmp(last_argv[1], "b") == 0, "probe a b: %d calls, argc %d", calls, last_argc);
+
+  calls = 0;
+  run("   probe   one  two   three   ");
+  CHECK(calls == 1 && last_argc == 3 && strcmp(last_argv[0], "one") == 0 &&
+        strcmp(last_argv[1], "two") == 0 && strcmp(last_argv[2], "three") == 0,
+        "spaces: %d calls, argc %d", calls, last_argc);
+
+  calls = 0;
+  run("probe");
+  run("probe ");
+  CHECK(calls == 2 && last_argc == 0, "no arguments: %d calls, argc %d", calls, last_argc);
+
+  // 参数正好 configCLI_MAX_ARGS 个
+  n = snprintf(line, sizeof line, "probe");
+  for (i = 0; i < configCLI_MAX_ARGS; i++)
+    n += snprintf(line + n, sizeof line - n, " %d", i);
+  calls = 0;
+  run(line);
+  CHECK(calls == 1 && last_argc == configCLI_MAX_ARGS &&
+        strcmp(last_argv[configCLI_MAX_ARGS - 1], "9") == 0, "%d arguments: %d calls, argc %d",
+        configCLI_MAX_ARGS, calls, last_argc);
+
+  // 多一个：prvGetNumberOfParameters 返回 -1，不执行
+  snprintf(line + n, sizeof line - n, " x");
+  strcpy(copy, line);
+  CHECK(prvGetNumberOfParameters(copy, args) == -1, "too many arguments not reported");
+  calls = 0;
+  out = run(line);
+  CHECK(calls == 0 && strstr(out, "Incorrect command parameter(s)"),
+        "%d arguments: %d calls, \"%s\"", configCLI_MAX_ARGS + 1, calls, out);
+
+  // 参数个数固定的命令
+  calls = 0;
+  out = run("probe2 1");
+  CHECK(calls == 0 && strstr(out, "Incorrect command parameter(s)"), "probe2 1: \"%s\"", out);
+  run(" probe2  1  2 ");
+  CHECK(calls == 1 && last_argc == 2, "probe2 1 2: %d calls", calls);
+
+  // 空行、不认识的命令、命令名的前缀
+  calls = 0;
+  CHECK(strstr(run(""), "Command not recognised") != NULL, "empty line accepted");
+  CHECK(strstr(run("    "), "Command not recognised") != NULL, "blank line accepted");
+  CHECK(strstr(run("prob a"), "Command not recognised") != NULL, "prefix accepted");
+  CHECK(strstr(run("probe3"), "Command not recognised") != NULL, "probe3 accepted");
+  CHECK(calls == 0, "%d calls for unknown commands", calls);
+}
+
+/*
+=======================================
+    表满
+=======================================
+*/
+static void test_full(void)
+{
+  static char names[configCLI_MAX_COMMANDS][8];
+  static CLI_Command_Definition_t cmds[configCLI_MAX_COMMANDS];
+  static CLI_Command_Definition_t extra = { "zz_last", "\r\n", cmd_probe, -1 };
+  int i, added = 0;
+
+  for (i = 0; uxRegisteredCommands < configCLI_MAX_COMMANDS; i++) {
+    snprintf(names[i], sizeof names[i], "z%02d", i);
+    memcpy(&cmds[i], &(CLI_Command_Definition_t){ names[i], "\r\n", cmd_probe, -1 }, sizeof cmds[i]);
+    added += FreeRTOS_CLIRegisterCommand(&cmds[i]) == pdPASS;
+  }
+  CHECK(FreeRTOS_CLIRegisterCommand(&extra) == pdFAIL &&
+        uxRegisteredCommands == configCLI_MAX_COMMANDS, "registered into a full table");
+  CHECK(prvFindCommand("zz_last") == NULL && prvFindCommand(names[0]) == &cmds[0] &&
+        prvFindCommand("probe") == &x_cmd_probe, "lookup broken in a full table");
+  printf("  %d more commands fit, then registration fails\n", added);
+}
+
+int main(void)
+{
+  test_table();
+  test_args();
+  test_full();
+  return test_result("cli");
+}
@@ -0,0 +1,235 @@
+/*-----------------------------------------------------------------------------/
+ * Module       : test_dirty.c
+ * Brief        : 按 8 像素条带的刷新标记 (mark_rect、markmap_upperarea)
+ 这里直接包含 plot.c，nt35510.c 用 panel.c 的面板模型。
+ 每一步之前记下屏幕上的曲线坐标，按像素算出应该标记的条带，
+ 与 markmap 的当前页逐位比较：
+ - 标记点移动 (同 redraw_marker)：新位置的标记框和标记信息的几行，
+   旧位置在上一帧的那页里
+ - 读数变化：几个点的测量值改变，变化点两侧新旧线段、标记框、曲线信息
+ - 关闭一条直角坐标的曲线：整条曲线擦掉，曲线信息按上次的行数 (markmap_upperarea
+   的 last_j) 重画，下一帧按新的行数
+ 每一帧送屏的像素数与原来按整个 CELL 标记、标记信息整行重画的像素数比较，
+ 最后的画面与整屏重画一致。
+/-----------------------------------------------------------------------------*/
+#include "../../Usr/plot.c"
+#include "hw.h"
+#include "panel.h"
+#include "test.h"
+
+void update_frequencies(void);
+
+static uint32_t expect[MARK_COLS];
+
+/* 按像素标记，与 mark_rect 的算法无关 */
+static void ref_rect(int x, int y, int w, int h)
+{
+  int px, py;
+  for (py = y < 0 ? 0 : y; py < y + h && py / MARK_STRIP < 32; py++)
+    for (px = x < 0 ? 0 : x; px < x + w && px / CELLWIDTH < MARK_COLS; px++)
+      expect[px / CELLWIDTH] |= 1UL << (py / MARK_STRIP);
+}
+
+static void ref_segment(uint32_t a, uint32_t b)
+{
+  int x0 = CELL_X(a), y0 = CELL_Y(a), x1 = CELL_X(b), y1 = CELL_Y(b);
+  ref_rect(x0 < x1 ? x0 : x1, y0 < y1 ? y0 : y1, abs(x1 - x0) + 1, abs(y1 - y0) + 1);
+}
+
+static void ref_markers(void)
+{
+  int m, t;
+  for (m = 0; m < 4; m++)
+    for (t = 0; m < 4 && markers[m].enabled && t < TRACES_MAX; t++)
+      if (trace[t].enabled) {
+        uint32_t v = trace_index[t][markers[m].index];
+        ref_rect(CELL_X(v) - 5, CELL_Y(v) - 10, 11, 11);
+      }
+}
+
+static void ref_upper(int lines)
+{
+  ref_rect(0, 0, MARK_COLS * CELLWIDTH, 1 + lines * INFO_LINE_HEIGHT);
+}
+
+static int traces_on(void)
+{
+  int t, n = 0;
+  for (t = 0; t < TRACES_MAX; t++)
+    n += trace[t].enabled;
+  return n;
+}
+
+/* markmap 当前页与 expect 逐位比较 */
+static void check_marks(const char *step)
+{
+  int m, diff = 0;
+  for (m = 0; m < MARK_COLS; m++)
+    if (markmap[current_mappage][m] != expect[m] && diff++ < 3)
+      printf("  %s: column %d marked %08x, expected %08x\n", step,
+             m, markmap[current_mappage][m], expect[m]);
+  CHECK(diff == 0, "%s: %d columns marked differently", step, diff);
+}
+
+/*
+ * 画出两页标记的条带，返回送屏的像素数；*whole 是原来的标记方法
+ * (有条带的 CELL 整块重画，标记信息所在的第一行 CELL 整行重画) 的像素数
+ */
+static uint64_t frame(const char *step, uint64_t *whole)
+{
+  int m, n, w, h;
+
+  *whole = 0;
+  for (m = 0; m < MARK_COLS; m++) {
+    uint32_t dirty = markmap[0][m] | markmap[1][m];
+    w = (m + 1) * CELLWIDTH > area_width ? area_width - m * CELLWIDTH : CELLWIDTH;
+    for (n = 0; w > 0 && n * CELLHEIGHT < area_height; n++) {
+      h = (n + 1) * CELLHEIGHT > area_height ? area_height - n * CELLHEIGHT : CELLHEIGHT;
+      if (n == 0 || (dirty >> (n * CELLHEIGHT / MARK_STRIP) & 0xf))
+        *whole += w * h * 4;
+    }
+  }
+  nt35510_dma_wait();
+  panel_bus_reset();
+  draw_all_cells();
+  nt35510_dma_wait();
+  printf("  %-15s %6llu pixels, whole cells %6llu (%.0f%%), %llu windows\n", step,
+         (unsigned long long)panel_pixels, (unsigned long long)*whole,
+         100.0 * panel_pixels / *whole, (unsigned long long)panel_windows);
+  return panel_pixels;
+}
+
+static void steady_frame(void)
+{
+  plot_into_index(measured);
+  draw_all_cells();
+}
+
+static void full_redraw(void)
+{
+  redraw_frame();
+  force_set_markmap();
+  plot_into_index(measured);
+  force_set_markmap();
+  draw_all_cells();
+  nt35510_dma_wait();
+}
+
+int main(void)
+{
+  static uint32_t old[TRACES_MAX][SWEEP_POINTS];
+  static uint16_t before[PANEL_H][PANEL_W];
+  uint64_t pixels, whole;
+  int i, k, t, idx, last_j;
+
+  nt35510_dma_init();
+  panel_dma_start();
+  frequency0 = 1000000;
+  frequency1 = 300000000;
+  update_frequencies();
+  for (k = 0; k < 2; k++)
+    for (i = 0; i < sweep_points; i++) {
+      double a = i * 0.12 + k, m = k ? 0.9 - i * 0.004 : 0.3 + 0.5 * i / sweep_points;
+      measured[k][i][0] = m * cos(a);
+      measured[k][i][1] = m * sin(a);
+    }
+  full_redraw();
+  steady_frame();
+  steady_frame();  // 两页都只剩标记框和曲线信息
+  nt35510_dma_wait();
+
+  // 数据不变的一帧
+  memset(expect, 0, sizeof expect);
+  plot_into_index(measured);
+  ref_markers();
+  ref_upper((traces_on() + 1) / 2);
+  check_marks("steady");
+  pixels = frame("steady", &whole);
+  CHECK(pixels < whole, "steady: %llu pixels", (unsigned long long)pixels);
+
+  // 标记点移动，同 redraw_marker(active_marker, TRUE)
+  memset(expect, 0, sizeof expect);
+  ref_markers();
+  for (i = 0; i < MARK_COLS; i++)  // 旧位置由上一帧的那页擦掉
+    CHECK((markmap[1 - current_mappage][i] & expect[i]) == expect[i],
+          "old marker box not in the previous page, column %d", i);
+  idx = markers[0].index += 7;
+  markers[0].frequency = frequencies[idx];
+  memset(expect, 0, sizeof expect);
+  markmap_marker(0);
+  markmap_upperarea(TRUE);
+  ref_markers();
+  ref_upper(traces_on() / 2 + 2);
+  check_marks("marker move");
+  pixels = frame("marker move", &whole);
+  CHECK(pixels < whole, "marker move: %llu pixels, %llu with whole cells",
+        (unsigned long long)pixels, (unsigned long long)whole);
+  steady_frame();
+
+  // 标记点附近几个点的读数变化
+  memcpy(old, trace_index, sizeof old);
+  for (i = idx - 1; i <= idx + 1; i++)
+    for (k = 0; k < 2; k++) {
+      measured[k][i][0] *= 0.8f;
+      measured[k][i][1] *= 0.8f;
+    }
+  sweep_count++;  // 新的一次扫描
+  memset(expect, 0, sizeof expect);
+  plot_into_index(measured);
+  for (t = 0; t < TRACES_MAX; t++) {
+    if (!trace[t].enabled)
+      continue;
+    for (i = 0; i < sweep_points; i++) {
+      if (trace_index[t][i] == old[t][i])
+        continue;
+      if (i > 0)
+        ref_segment(old[t][i - 1], old[t][i]);
+      if (i < sweep_points - 1)
+        ref_segment(old[t][i], old[t][i + 1]);
+      if (i > 0)
+        ref_segment(trace_index[t][i - 1], trace_index[t][i]);
+      if (i < sweep_points - 1)
+        ref_segment(trace_index[t][i], trace_index[t][i + 1]);
+      if (i == 0)
+        ref_rect(CELL_X(trace_index[t][0]), CELL_Y(trace_index[t][0]), 1, 1);
+    }
+  }
+  ref_markers();
+  ref_upper((traces_on() + 1) / 2);
+  check_marks("readout");
+  pixels = frame("readout", &whole);
+  CHECK(pixels < whole, "readout: %llu pixels, %llu with whole cells",
+        (unsigned long long)pixels, (unsigned long long)whole);
+  steady_frame();
+
+  // 关闭一条直角坐标的曲线 (网格不变)，曲线信息按上次的行数重画
+  memcpy(old, trace_index, sizeof old);
+  last_j = traces_on();
+  t = 1;
+  trace[t].enabled = FALSE;
+  memset(expect, 0, sizeof expect);
+  plot_into_index(measured);
+  for (i = 1; i < sweep_points; i++)
+    ref_segment(old[t][i - 1], old[t][i]);
+  ref_markers();
+  ref_upper((last_j + 1) / 2);
+  check_marks("trace off");
+  frame("trace off", &whole);
+  memset(expect, 0, sizeof expect);  // 下一帧按新的行数
+  plot_into_index(measured);
+  ref_markers();
+  ref_upper((traces_on() + 1) / 2);
+  check_marks("after trace off");
+  frame("after trace off", &whole);
+
+  // 与整屏重画比较
+  memcpy(before, panel, sizeof panel);
+  memset(panel, 0, sizeof panel);
+  full_redraw();
+  k = panel_diff((const uint16_t (*)[PANEL_W])panel, (const uint16_t (*)[PANEL_W])before,
+                 "obj/dirty_diff.ppm");
+  CHECK(k == 0, "%d pixels differ from a full redraw, see obj/dirty_diff.ppm", k);
+
+  panel_dma_stop();
+  return test_result("dirty");
+}
@@ -0,0 +1,112 @@
+/*-----------------------------------------------------------------------------/
+ * Module       : test_fastmath.c
+ * Brief        : fast_log10f/fast_atan2f/fast_sqrtf 与 libm 逐点比较
+ 误差上限即 fastmath.c 文件头给出的数值。
+ 耗时只作参考：PC 有 FPU，libm 很快，F103 上的差距要大得多。
+/-----------------------------------------------------------------------------*/
+#include <math.h>
+#include "test.h"
+#include "nanovna.h"
+
+#define N_RANDOM  2000000
+
+static void test_log10(void)
+{
+  double worst = 0, worst_x = 0;
+  int i;
+
+  for (i = 0; i < N_RANDOM; i++) {
+    // |gamma|^2 的实际范围：-200 dB ~ +40 dB
+    float x = (float)pow(10.0, rng_uniform(-20.0, 4.0));
+    double err = fabs((double)fast_log10f(x) - log10((double)x));
+    if (err > worst) {
+      worst = err;
+      worst_x = x;
+    }
+  }
+  printf("  fast_log10f  max abs err %.3g at %g\n", worst, worst_x);
+  CHECK(worst < 5.5e-5, "fast_log10f error %g", worst);
+  CHECK(fast_log10f(0.0f) < -30.0f, "fast_log10f(0) = %g", fast_log10f(0.0f));
+}
+
+static void test_atan2(void)
+{
+  double worst = 0;
+  int i;
+
+  for (i = 0; i < N_RANDOM; i++) {
+    double a = rng_uniform(-M_PI, M_PI);
+    double r = pow(10.0, rng_uniform(-6.0, 1.0));
+    float y = (float)(r * sin(a)), x = (float)(r * cos(a));
+    double err = fabs((double)fast_atan2f(y, x) - atan2((double)y, (double)x));
+    if (err > M_PI)  // ±pi 处取了另一侧
+      err = fabs(err - 2 * M_PI);
+    if (err > worst)
+      worst = err;
+  }
+  printf("  fast_atan2f  max abs err %.3g rad\n", worst);
+  CHECK(worst < 1.2e-5, "fast_atan2f error %g", worst);
+  CHECK(fast_atan2f(0.0f, 0.0f) == 0.0f, "fast_atan2f(0, 0) = %g", fast_atan2f(0.0f, 0.0f));
+  CHECK(fabsf(fast_atan2f(0.0f, -1.0f)) > 3.1415f, "fast_atan2f(0, -1)");
+  CHECK(fabsf(fast_atan2f(1.0f, 0.0f) - 1.5707963f) < 1e-5f, "fast_atan2f(1, 0)");
+}
+
+static void test_sqrt(void)
+{
+  double worst = 0;
+  int i;
+
+  for (i = 0; i < N_RANDOM; i++) {
+    float x = (float)pow(10.0, rng_uniform(-20.0, 6.0));
+    double ref = sqrt((double)x);
+    double err = fabs((double)fast_sqrtf(x) - ref) / ref;
+    if (err > worst)
+      worst = err;
+  }
+  printf("  fast_sqrtf   max rel err %.3g\n", worst);
+  CHECK(worst < 5.0e-6, "fast_sqrtf error %g", worst);
+  CHECK(fast_sqrtf(0.0f) == 0.0f, "fast_sqrtf(0) = %g", fast_sqrtf(0.0f));
+}
+
+#define N_BENCH  4096
+
+static volatile float sink;
+
+static void bench(void)
+{
+  static float x[N_BENCH], y[N_BENCH];
+  double t0, t_fast[3], t_libm[3];
+  float acc;
+  int i, k;
+
+  for (i = 0; i < N_BENCH; i++) {
+    x[i] = (float)rng_uniform(-2.0, 2.0);
+    y[i] = (float)rng_uniform(-2.0, 2.0);
+  }
+#define TIME(dst, expr) do { \
+    acc = 0; t0 = now_ns(); \
+    for (k = 0; k < 200; k++) \
+      for (i = 0; i < N_BENCH; i++) \
+        acc += (expr); \
+    sink = acc; \
+    dst = (now_ns() - t0) / (200.0 * N_BENCH); \
+  } while (0)
+  TIME(t_fast[0], fast_log10f(fabsf(x[i]) + 1e-3f));
+  TIME(t_libm[0], log10f(fabsf(x[i]) + 1e-3f));
+  TIME(t_fast[1], fast_atan2f(y[i], x[i]));
+  TIME(t_libm[1], atan2f(y[i], x[i]));
+  TIME(t_fast[2], fast_sqrtf(fabsf(x[i])));
+  TIME(t_libm[2], sqrtf(fabsf(x[i])));
+#undef TIME
+  printf("  ns/call (host)  log10 %.1f/%.1f  atan2 %.1f/%.1f  sqrt %.1f/%.1f  (fast/libm)\n",
+         t_fast[0], t_libm[0], t_fast[1], t_libm[1], t_fast[2], t_libm[2]);
+}
+
+int main(void)
+{
+  test_log10();
+  test_atan2();
+  test_sqrt();
+  bench();
+  return test_result("fastmath");
+}
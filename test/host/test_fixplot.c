@@ -0,0 +1,71 @@
+/*-----------------------------------------------------------------------------/
+ * Module       : test_fixplot.c
+ * Brief        : trace_into_index_fix 与浮点的 trace_into_index 比较
+ 两者都是 plot.c 的内部函数，这里直接包含 plot.c。
+ 随机的测量值逐点换算成屏幕坐标，统计两者不同的点。
+ 相差一个像素是允许的（取整边界两侧）。相位在 ±180 度处会跳到另一端，
+ 很小的 gamma 虚部量化成 0 时也一样。
+/-----------------------------------------------------------------------------*/
+#include "../../Usr/plot.c"
+#include "test.h"
+
+#define N_POINTS  500000
+
+static const struct {
+  uint8_t type;
+  float scale;
+  float refpos;
+} trace_set[] = {
+  { TRC_LOGMAG, 10, 7 },
+  { TRC_LOGMAG, 1, 4 },
+  { TRC_PHASE, 90, 4 },
+  { TRC_PHASE, 10, 4 },
+  { TRC_LINEAR, 0.125, 0 },
+  { TRC_SWR, 1, 0 },
+  { TRC_SWR, 0.25, 0 },
+  { TRC_SMITH, 1, 0 },
+  { TRC_POLAR, 1, 0 },
+};
+
+int main(void)
+{
+  long total = 0, off_by_one = 0, wrap = 0, bad = 0;
+  unsigned s;
+  int i;
+
+  for (s = 0; s < sizeof trace_set / sizeof trace_set[0]; s++) {
+    trace_coord_t tc;
+
+    trace[0].type = trace_set[s].type;
+    trace[0].scale = trace_set[s].scale;
+    trace[0].refpos = trace_set[s].refpos;
+    trace[0].channel = 0;
+    trace_coord_init(&tc, 0);
+    for (i = 0; i < N_POINTS; i++) {
+      // |gamma| 在 dB 上均匀分布，-100 dB ~ +3 dB
+      double mag = pow(10, rng_uniform(-5, 0.15)), arg = rng_uniform(-M_PI, M_PI);
+      float coeff[2] = { mag * cos(arg), mag * sin(arg) };
+      int x = i % WIDTH;
+      uint32_t a = trace_into_index(x, 0, 0, coeff);
+      uint32_t b = trace_into_index_fix(x, &tc, 0, 0, coeff);
+      int dx = abs(CELL_X(a) - CELL_X(b)), dy = abs(CELL_Y(a) - CELL_Y(b));
+
+      total++;
+      if (dx == 0 && dy == 0)
+        continue;
+      if (dx <= 1 && dy <= 1)
+        off_by_one++;
+      else if (trace[0].type == TRC_PHASE && coeff[0] < 0 &&
+               (fabs(fabs(arg) - M_PI) < 1e-3 || float_to_fix(coeff[1]) == 0))
+        wrap++;  // 虚部量化成 0 也算在 ±180 度上
+      else if (bad++ < 5)
+        printf("  type %d: (%g, %g) -> float (%d,%d) fix (%d,%d)\n", trace[0].type,
+               coeff[0], coeff[1], CELL_X(a), CELL_Y(a), CELL_X(b), CELL_Y(b));
+    }
+  }
+  printf("  %ld points: %ld off by one pixel, %ld at the phase wrap, %ld worse\n",
+         total, off_by_one, wrap, bad);
+  CHECK(bad == 0, "%ld points more than one pixel apart", bad);
+  CHECK(off_by_one * 1000 < total, "%ld points off by one", off_by_one);
+  return test_result("fixplot");
+}
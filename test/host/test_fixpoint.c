@@ -0,0 +1,157 @@
+/*-----------------------------------------------------------------------------/
+ * Module       : test_fixpoint.c
+ * Brief        : Q24 定点运算 (USE_FIXED_POINT) 与浮点版本比较
+ - fastmath.c 的定点函数：fix_div64/fix_log2/fix_sqrt64/fix_atan2/float_to_fix
+ - calculate_gamma_fix 与 calculate_gamma
+ - apply_error_term_fix 与 apply_error_term_to (appvna.c 的 static 函数，
+   所以这里直接包含 appvna.c)
+/-----------------------------------------------------------------------------*/
+#include "../../Usr/appvna.c"
+#include "test.h"
+
+extern int32_t acc_samp_s, acc_samp_c, acc_ref_s, acc_ref_c;
+
+#define N_RANDOM  1000000
+
+static void test_primitives(void)
+{
+  double worst_div = 0, worst_log = 0, worst_atan = 0;
+  uint64_t x;
+  int i, bad_sqrt = 0;
+
+  for (i = 0; i < N_RANDOM; i++) {
+    // fix_div64：Q48 / Q24 类的分子分母
+    int64_t den = (int64_t)(rng_uniform(1, 2) * pow(2, rng_uniform(20, 60)));
+    int64_t num = (int64_t)(rng_uniform(-1.5, 1.5) * den);
+    double ref = (double)num / den * FIX_ONE;
+    double err = fabs(fix_div64(num, den) - ref);  // LSB
+    if (err > worst_div)
+      worst_div = err;
+
+    // fix_log2(x, 48)：|gamma|^2 的 Q48，-200 dB ~ +20 dB
+    x = (uint64_t)(pow(2, rng_uniform(-66, 6)) * 281474976710656.0);
+    if (x) {
+      err = fabs(fix_log2(x, 48) / 65536.0 - log2(x / 281474976710656.0));
+      if (err > worst_log)
+        worst_log = err;
+    }
+
+    // fix_sqrt64 必须是精确的 floor(sqrt(x))
+    x = ((uint64_t)rng_u32() << 32 | rng_u32()) >> (rng_u32() & 63);
+    {
+      uint64_t r = fix_sqrt64(x);
+      if (r * r > x || (r + 1) * (r + 1) <= x)
+        bad_sqrt++;
+    }
+
+    // fix_atan2：单位 1/4 圈，Q16
+    {
+      double a = rng_uniform(-M_PI, M_PI), m = pow(10, rng_uniform(-5, 0.3));
+      fix_t yq = float_to_fix(m * sin(a)), xq = float_to_fix(m * cos(a));
+      double r2 = atan2(fix_to_float(yq), fix_to_float(xq)) / (M_PI / 2);
+      err = fabs(fix_atan2(yq, xq) / 65536.0 - r2);
+      if (err > 2)  // ±180 度两侧
+        err = fabs(err - 4);
+      if (err > worst_atan)
+        worst_atan = err;
+    }
+  }
+  // 边界
+  for (x = 0; x < 70000; x++) {
+    uint64_t r = fix_sqrt64(x);
+    if (r * r > x || (r + 1) * (r + 1) <= x)
+      bad_sqrt++;
+  }
+  x = ~0ULL;
+  CHECK(fix_sqrt64(x) == 0xffffffffu, "fix_sqrt64(2^64-1) = %u", fix_sqrt64(x));
+  x = (uint64_t)0xffffffffu * 0xffffffffu - 1;
+  CHECK(fix_sqrt64(x) == 0xfffffffeu, "fix_sqrt64((2^32-1)^2-1)");
+
+  printf("  fix_div64 max err %.2f LSB, fix_log2 max err %.3g, fix_atan2 max err %.3g deg, "
+         "fix_sqrt64 %d wrong\n", worst_div, worst_log, worst_atan * 90, bad_sqrt);
+  CHECK(worst_div < 2, "fix_div64 error %g LSB", worst_div);
+  CHECK(worst_log < 2e-4, "fix_log2 error %g", worst_log);
+  CHECK(worst_atan * 90 < 0.01, "fix_atan2 error %g deg", worst_atan * 90);
+  CHECK(bad_sqrt == 0, "fix_sqrt64 %d wrong results", bad_sqrt);
+  CHECK(float_to_fix(200.0f) == FIX_MAX, "float_to_fix saturation");
+  CHECK(float_to_fix(-0.5f) == -FIX_ONE / 2, "float_to_fix(-0.5)");
+}
+
+static void test_gamma(void)
+{
+  double worst = 0;
+  int i;
+
+  for (i = 0; i < N_RANDOM; i++) {
+    // 参考通道电平从很小到接近 int32 上限，|gamma| <= 1.2
+    double ref = pow(10, rng_uniform(3, 9.2)), ra = rng_uniform(-M_PI, M_PI);
+    double g = rng_uniform(0, 1.2), ga = rng_uniform(-M_PI, M_PI);
+    float gf[2];
+    fix_t gq[2];
+
+    acc_ref_s = (int32_t)(ref * sin(ra));
+    acc_ref_c = (int32_t)(ref * cos(ra));
+    acc_samp_s = (int32_t)(ref * g * sin(ra + ga));
+    acc_samp_c = (int32_t)(ref * g * cos(ra + ga));
+    calculate_gamma(gf);
+    calculate_gamma_fix(gq);
+    double err = fmax(fabs(fix_to_float(gq[0]) - gf[0]), fabs(fix_to_float(gq[1]) - gf[1]));
+    if (err > worst)
+      worst = err;
+  }
+  printf("  calculate_gamma_fix max err %.3g\n", worst);
+  CHECK(worst < 1e-6, "calculate_gamma_fix error %g", worst);
+}
+
+static void polar(float v[2], double mag, double arg)
+{
+  v[0] = mag * cos(arg);
+  v[1] = mag * sin(arg);
+}
+
+static void test_error_term(void)
+{
+  double worst11 = 0, worst21 = 0;
+  int i, k;
+
+  for (i = 0; i < N_RANDOM / 10; i++) {
+    float s[2][2], e[5][2];
+    fix_t q[2][2];
+
+    // 实际校准中各误差项的量级
+    polar(e[ETERM_ED], rng_uniform(0, 0.2), rng_uniform(-M_PI, M_PI));
+    polar(e[ETERM_ES], rng_uniform(0, 0.3), rng_uniform(-M_PI, M_PI));
+    polar(e[ETERM_ER], rng_uniform(0.5, 1.5), rng_uniform(-M_PI, M_PI));
+    polar(e[ETERM_ET], rng_uniform(0.5, 2.0), rng_uniform(-M_PI, M_PI));
+    polar(e[ETERM_EX], rng_uniform(0, 1e-3), rng_uniform(-M_PI, M_PI));
+    polar(s[0], rng_uniform(0, 1.2), rng_uniform(-M_PI, M_PI));
+    polar(s[1], rng_uniform(0, 1.5), rng_uniform(-M_PI, M_PI));
+    for (k = 0; k < 5; k++) {
+      cal_data[k][0][0] = e[k][0];
+      cal_data[k][0][1] = e[k][1];
+    }
+    for (k = 0; k < 2; k++) {
+      q[k][0] = float_to_fix(s[k][0]);
+      q[k][1] = float_to_fix(s[k][1]);
+    }
+    apply_error_term_to(s, e);
+    apply_error_term_fix(0, q);
+    double e11 = fmax(fabs(fix_to_float(q[0][0]) - s[0][0]), fabs(fix_to_float(q[0][1]) - s[0][1]));
+    double e21 = fmax(fabs(fix_to_float(q[1][0]) - s[1][0]), fabs(fix_to_float(q[1][1]) - s[1][1]));
+    if (e11 > worst11)
+      worst11 = e11;
+    if (e21 > worst21)
+      worst21 = e21;
+  }
+  printf("  apply_error_term_fix max err S11 %.3g, S21 %.3g\n", worst11, worst21);
+  CHECK(worst11 < 2.2e-5, "corrected S11 error %g", worst11);
+  CHECK(worst21 < 2.2e-5, "corrected S21 error %g", worst21);
+}
+
+int main(void)
+{
+  test_primitives();
+  test_gamma();
+  test_error_term();
+  return test_result("fixpoint");
+}
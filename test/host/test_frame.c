@@ -0,0 +1,257 @@
+/*-----------------------------------------------------------------------------/
+ * Module       : test_frame.c
+ * Brief        : 帧率控制 (plot_frame_due) 和每帧的像素预算 (FRAME_PIXEL_BUDGET)
+ 这里直接包含 plot.c，nt35510.c 用 panel.c 的面板模型，app_loop 在另一个
+ 线程里照常扫描。plot_frame 换成记录每一帧的版本 (时间、送屏的像素、
+ 留到下一帧的条带)，需要时让 app_loop 停在这里，主线程检查屏幕。
+ - 快速扫描：两帧的间隔不小于 FRAME_INTERVAL，帧数少于扫描次数
+ - 慢速扫描：扫描中途每 FRAME_LIVE_INTERVAL 左右有一帧
+ - 每帧送屏的像素不超过预算加一个窗口 (超出后才停)
+ - 暂停时整屏标记，超出预算的条带在后面几帧画完，
+   最后的画面与 draw_all_cells 整屏重画一致
+/-----------------------------------------------------------------------------*/
+#include <pthread.h>
+#include <unistd.h>
+#define plot_frame plot_frame_fw
+#include "../../Usr/plot.c"
+#undef plot_frame
+#include "hw.h"
+#include "panel.h"
+#include "test.h"
+
+void app_init(void);
+void update_frequencies(void);
+void app_loop(void);
+void pause_sweep(void);
+void resume_sweep(void);
+
+/* 一个 CELL 放大 2 倍送屏，超出预算时最多多送这么多 */
+#define WINDOW_PIXELS  (CELLWIDTH*2 * CELLHEIGHT*2)
+#define FRAMES_MAX     4096
+
+typedef struct {
+  uint32_t tick;
+  uint32_t pixels;
+  uint32_t pending;  // 留到下一帧的条带数
+  uint32_t sweep;    // 开始这一帧时的 sweep_count
+} frame_log_t;
+
+static frame_log_t frames[FRAMES_MAX];
+static volatile int nframes;
+
+static pthread_mutex_t park_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t park_cond = PTHREAD_COND_INITIALIZER;
+static int park, parked;
+
+static uint32_t pending_strips(void)
+{
+  uint32_t n = 0;
+  int m;
+  for (m = 0; m < MARK_COLS; m++)
+    n += __builtin_popcount(markmap[current_mappage][m]);
+  return n;
+}
+
+/* app_loop 和 sweep 调用的 plot_frame */
+void plot_frame(void)
+{
+  frame_log_t f;
+
+  pthread_mutex_lock(&park_lock);
+  while (park) {
+    parked = 1;
+    pthread_cond_broadcast(&park_cond);
+    pthread_cond_wait(&park_cond, &park_lock);
+  }
+  parked = 0;
+  pthread_mutex_unlock(&park_lock);
+
+  f.tick = chVTGetSystemTime();
+  f.sweep = sweep_count;
+  plot_frame_fw();
+  f.pixels = render_stats.pixels;
+  f.pending = pending_strips();
+  if (nframes < FRAMES_MAX)
+    frames[nframes] = f;
+  nframes++;
+}
+
+/* 让 app_loop 停在下一次 plot_frame 的开头 */
+static void stop_frames(void)
+{
+  pthread_mutex_lock(&park_lock);
+  park = 1;
+  while (!parked)
+    pthread_cond_wait(&park_cond, &park_lock);
+  pthread_mutex_unlock(&park_lock);
+  nt35510_dma_wait();
+}
+
+static void run_frames(void)
+{
+  pthread_mutex_lock(&park_lock);
+  park = 0;
+  pthread_cond_broadcast(&park_cond);
+  pthread_mutex_unlock(&park_lock);
+}
+
+static void *app_thread(void *arg)
+{
+  (void)arg;
+  for (;;)
+    app_loop();
+  return NULL;
+}
+
+/* 每帧送屏的像素不超过预算 */
+static void check_budget(const char *name, int first, int last)
+{
+  uint32_t worst = 0;
+  int i;
+  for (i = first; i < last; i++)
+    if (frames[i].pixels > worst)
+      worst = frames[i].pixels;
+  CHECK(worst <= FRAME_PIXEL_BUDGET + WINDOW_PIXELS, "%s: a frame pushed %u pixels, budget %u",
+        name, worst, FRAME_PIXEL_BUDGET);
+}
+
+/*
+=======================================
+    扫描时的帧率
+=======================================
+*/
+/* 扫描 ms 毫秒，返回这段时间的第一帧；gap_min、gap_max 是两帧的间隔 */
+static int sweep_for(uint32_t ms, uint32_t *sweeps, uint32_t *gap_min, uint32_t *gap_max)
+{
+  int first, i;
+  uint32_t c, gap;
+
+  stop_frames();
+  resume_sweep();
+  first = nframes;
+  c = sweep_count;
+  run_frames();
+  usleep(ms * 1000);
+  stop_frames();
+  *sweeps = sweep_count - c;
+  *gap_min = 0xffffffff;
+  *gap_max = 0;
+  for (i = first + 1; i < nframes && i < FRAMES_MAX; i++) {
+    gap = frames[i].tick - frames[i - 1].tick;
+    if (gap < *gap_min)
+      *gap_min = gap;
+    if (gap > *gap_max)
+      *gap_max = gap;
+  }
+  return first;
+}
+
+static void test_fast(void)
+{
+  uint32_t sweeps, gap_min, gap_max, ms = 2000;
+  int first, n;
+
+  // 21 点，一次扫描约 20 ms，比 FRAME_INTERVAL 短
+  stop_frames();
+  sweep_points = 21;
+  update_frequencies();
+  host_i2s_period_us = 20;
+  first = sweep_for(ms, &sweeps, &gap_min, &gap_max);
+  n = nframes - first;
+  printf("  fast sweep: %u sweeps, %d frames in %u ms, frame gap %u..%u ms\n",
+         sweeps, n, ms, gap_min, gap_max);
+  CHECK(n > 1, "fast sweep: %d frames", n);
+  CHECK(gap_min >= FRAME_INTERVAL, "fast sweep: frames %u ms apart, interval %d ms",
+        gap_min, FRAME_INTERVAL);
+  CHECK(sweeps > (uint32_t)n, "fast sweep: %u sweeps but %d frames", sweeps, n);
+  check_budget("fast sweep", first, nframes);
+  sweep_points = SWEEP_POINTS;
+  update_frequencies();
+  run_frames();
+}
+
+static void test_slow(void)
+{
+  uint32_t sweeps, gap_min, gap_max, ms = 4000;
+  int first, n, i, live = 0;
+
+  // 每点 9 个半缓存，101 点约 2 s
+  host_i2s_period_us = 2000;
+  first = sweep_for(ms, &sweeps, &gap_min, &gap_max);
+  n = nframes - first;
+  for (i = first + 1; i < nframes; i++)  // 同一次扫描里的第二帧以后都是中途画的
+    live += frames[i].sweep == frames[i - 1].sweep;
+  printf("  slow sweep: %u sweeps, %d frames (%d during a sweep) in %u ms, frame gap %u..%u ms\n",
+         sweeps, n, live, ms, gap_min, gap_max);
+  CHECK(live > 0, "slow sweep: no frames during a sweep");
+  CHECK(gap_min >= FRAME_INTERVAL, "slow sweep: frames %u ms apart", gap_min);
+  CHECK(gap_max < 2 * FRAME_LIVE_INTERVAL, "slow sweep: %u ms without a frame", gap_max);
+  check_budget("slow sweep", first, nframes);
+  host_i2s_period_us = 20;
+  run_frames();
+}
+
+/*
+=======================================
+    超出预算的条带
+=======================================
+*/
+static void test_pending(void)
+{
+  static uint16_t drawn[PANEL_H][PANEL_W];
+  int first, i, t, n, y;
+  long diff;
+
+  // 暂停后数据不再变化，每次 app_loop 都画一帧
+  stop_frames();
+  pause_sweep();
+  run_frames();
+  usleep(200000);
+
+  stop_frames();
+  force_set_markmap();
+  first = nframes;
+  run_frames();
+  for (t = 0; t < 500; t++) {
+    usleep(10000);
+    for (i = first; i < nframes && i < FRAMES_MAX; i++)
+      if (frames[i].pending == 0)
+        break;
+    if (i < nframes)
+      break;
+  }
+  stop_frames();
+  n = i - first + 1;
+  CHECK(i < nframes, "pending strips never drawn");
+  printf("  full redraw: %d frames of at most %u pixels, %u strips left after the first\n",
+         n, FRAME_PIXEL_BUDGET, frames[first].pending);
+  CHECK(n >= 2 && frames[first].pending > 0, "full redraw fits in one frame");
+  check_budget("full redraw", first, i + 1);
+
+  // 擦掉 CELL 的区域后整屏重画，画面不变 (CELL 以外的字不经过 draw_cells)
+  memcpy(drawn, panel, sizeof panel);
+  for (y = OFFSETY*2; y < (OFFSETY + area_height)*2; y++)
+    memset(&panel[y][(OFFSETX - CELLOFFSETX)*2], 0, (CELLOFFSETX + area_width)*2 * sizeof panel[0][0]);
+  force_set_markmap();
+  draw_all_cells();
+  nt35510_dma_wait();
+  diff = panel_diff((const uint16_t (*)[PANEL_W])drawn, (const uint16_t (*)[PANEL_W])panel,
+                    "obj/frame_diff.ppm");
+  CHECK(diff == 0, "%ld pixels differ from a full redraw, see obj/frame_diff.ppm", diff);
+  run_frames();
+}
+
+int main(void)
+{
+  pthread_t th;
+
+  panel_dma_start();
+  app_init();
+  pthread_create(&th, NULL, app_thread, NULL);
+
+  test_fast();
+  test_slow();
+  test_pending();
+  CHECK(panel_bus_conflict == 0, "%ld CPU writes during a DMA transfer", panel_bus_conflict);
+  return test_result("frame");
+}
@@ -0,0 +1,99 @@
+/*-----------------------------------------------------------------------------/
+ * Module       : test_grid.c
+ * Brief        : Smith/导纳/极坐标网格位图 (grid_mask) 与逐点计算比较
+ 这里直接包含 plot.c。对绘图区的每个 CELL，cell_draw_grid_mask 画出的网格
+ 必须和原来逐点调用 smith_grid/smith_grid3/polar_grid 的结果完全一样。
+ 同时比较两种画法画满整个绘图区所用的时间 (主机)。
+/-----------------------------------------------------------------------------*/
+#include "../../Usr/plot.c"
+#include "test.h"
+
+#define BENCH_ROUNDS  20
+
+static const struct {
+  uint16_t mode;
+  const char *name;
+} grid_set[] = {
+  { GRID_SMITH, "smith" },
+  { GRID_ADMIT, "admit" },
+  { GRID_POLAR, "polar" },
+};
+
+// 原来 draw_cell 的画法
+static void cell_draw_grid_pixels(uint16_t *buf, uint16_t mode, int x0, int y0, int w, int h)
+{
+  int x, y;
+  for (y = 0; y < h; y++)
+    for (x = 0; x < w; x++) {
+      uint16_t c;
+      if (mode == GRID_SMITH)
+        c = smith_grid(x + x0, y + y0);
+      else if (mode == GRID_ADMIT)
+        c = smith_grid3(x + x0, y + y0);
+      else
+        c = polar_grid(x + x0, y + y0);
+      buf[y * w + x] |= c;
+    }
+}
+
+// 整个绘图区按 CELL 画一遍，返回不同的像素数
+static long draw_area(uint16_t mode, int use_mask, int compare)
+{
+  static uint16_t a[CELLWIDTH * CELLHEIGHT], b[CELLWIDTH * CELLHEIGHT];
+  long diff = 0;
+  int x0, y0, i;
+
+  for (x0 = -CELLOFFSETX; x0 < area_width; x0 += CELLWIDTH)
+    for (y0 = 0; y0 < area_height; y0 += CELLHEIGHT) {
+      int w = x0 + CELLWIDTH > area_width ? area_width - x0 : CELLWIDTH;
+      int h = y0 + CELLHEIGHT > area_height ? area_height - y0 : CELLHEIGHT;
+
+      memset(a, 0, w * h * sizeof a[0]);
+      if (use_mask || compare) {
+        grid_mask_update(mode);
+        cell_draw_grid_mask(a, x0, y0, w, h);
+      }
+      if (!use_mask || compare) {
+        memset(b, 0, w * h * sizeof b[0]);
+        cell_draw_grid_pixels(b, mode, x0, y0, w, h);
+      }
+      if (compare)
+        for (i = 0; i < w * h; i++)
+          if (a[i] != b[i] && diff++ < 5)
+            printf("  mode %d (%d,%d): mask %04x, pixels %04x\n", mode,
+                   x0 + i % w, y0 + i / w, a[i], b[i]);
+    }
+  return diff;
+}
+
+int main(void)
+{
+  unsigned s;
+  int n;
+
+  for (s = 0; s < sizeof grid_set / sizeof grid_set[0]; s++) {
+    uint16_t mode = grid_set[s].mode;
+    double t0, t1, t2;
+    long diff;
+
+    config.grid_color = 0x8410;
+    diff = draw_area(mode, 1, 1);
+    CHECK(diff == 0, "%s: %ld pixels differ", grid_set[s].name, diff);
+
+    // 颜色改变后位图重新生成，结果仍然一致
+    config.grid_color = 0x07e0;
+    diff = draw_area(mode, 1, 1);
+    CHECK(diff == 0, "%s: %ld pixels differ after a colour change", grid_set[s].name, diff);
+
+    t0 = now_ns();
+    for (n = 0; n < BENCH_ROUNDS; n++)
+      draw_area(mode, 0, 0);
+    t1 = now_ns();
+    for (n = 0; n < BENCH_ROUNDS; n++)
+      draw_area(mode, 1, 0);
+    t2 = now_ns();
+    printf("  %s grid, whole area: per pixel %.0f us, mask %.0f us (host)\n",
+           grid_set[s].name, (t1 - t0) / BENCH_ROUNDS / 1e3, (t2 - t1) / BENCH_ROUNDS / 1e3);
+  }
+  return test_result("grid");
+}
@@ -0,0 +1,200 @@
+/*-----------------------------------------------------------------------------/
+ * Module       : test_lcd.c
+ * Brief        : CELL 的 DMA 送屏 (nt35510_bulk_x2_dma) 和 DMA 填充
+ 这里直接包含 nt35510.c，总线读写 LCD_WR16/LCD_WR32 换成 panel.c 的
+ NT35510 模型，DMA1 通道7 也由 panel.c 模拟。
+ - 随机的区块、填充与参考图比较，DMA 传输期间 CPU 不能写总线
+ - 整屏重画 (redraw_frame + draw_all_cells)：DMA 放慢后结果必须一样，
+   否则说明 CELL 缓存或行缓存在传输完成前被改写
+ - 放大 2 倍送屏每个源像素的 CPU 写指令数：逐点 16 位写 (w > 32 时的旧写法)、
+   行展开后 32 位写 (nt35510_bulk_x2)、DMA (nt35510_bulk_x2_dma)
+/-----------------------------------------------------------------------------*/
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "panel.h"
+#include "../../Usr/nt35510.c"
+#include "test.h"
+
+static uint16_t ref[PANEL_H][PANEL_W];
+
+/*
+=======================================
+    随机的区块和填充
+=======================================
+*/
+static void ref_fill(int x, int y, int w, int h, uint16_t c)
+{
+  int i, j;
+  for (i = y; i < y + h; i++)
+    for (j = x; j < x + w; j++)
+      ref[i][j] = c;
+}
+
+static void test_blocks(void)
+{
+  static uint16_t buf[2][48 * 24];
+  int n, i, j, sel = 0, diff = 0;
+
+  memset(panel, 0, sizeof panel);
+  memset(ref, 0, sizeof ref);
+  for (n = 0; n < 3000; n++) {
+    int op = rng_u32() % 8;
+    int w = 1 + rng_u32() % 48, h = 1 + rng_u32() % 24;
+    int x = rng_u32() % (LCD_WIDTH - w + 1), y = rng_u32() % (LCD_HEIGHT - h + 1);
+    uint16_t c = rng_u32();
+
+    if (op < 5) {
+      // 和 draw_cell 一样两块缓存轮流用，上一块可能还在传输
+      uint16_t *b = buf[sel];
+      sel ^= 1;
+      for (i = 0; i < w * h; i++)
+        b[i] = rng_u32();
+      nt35510_bulk_x2_dma(b, x, y, w, h);
+      for (i = 0; i < h * 2; i++)
+        for (j = 0; j < w * 2; j++)
+          ref[y * 2 + i][x * 2 + j] = b[(i / 2) * w + j / 2];
+    } else if (op == 5) {
+      nt35510_fill_x2(x, y, w, h, c);
+      ref_fill(x * 2, y * 2, w * 2, h * 2, c);
+    } else if (op == 6) {
+      nt35510_pixel_x2(x, y, c);
+      ref_fill(x * 2, y * 2, 2, 2, c);
+    } else {
+      // 整屏填充超过 CNDTR 上限，分几次传输
+      if (rng_u32() % 16 == 0) {
+        w = PANEL_W, h = PANEL_H;
+        x = y = 0;
+      } else {
+        w *= 5, h *= 5;
+        x = rng_u32() % (PANEL_W - w + 1), y = rng_u32() % (PANEL_H - h + 1);
+      }
+      nt35510_fill(x, y, w, h, c);
+      ref_fill(x, y, w, h, c);
+    }
+  }
+  nt35510_dma_wait();
+  for (i = 0; i < PANEL_H; i++)
+    for (j = 0; j < PANEL_W; j++)
+      if (panel[i][j] != ref[i][j] && diff++ < 5)
+        printf("  (%d,%d) %04x, expected %04x\n", j, i, panel[i][j], ref[i][j]);
+  CHECK(diff == 0, "%d pixels differ from the reference", diff);
+}
+
+/*
+=======================================
+    整屏重画
+=======================================
+*/
+void update_frequencies(void);
+void plot_into_index(float measured[2][SWEEP_POINTS][2]);
+void force_set_markmap(void);
+void redraw_frame(void);
+void draw_all_cells(void);
+
+static void redraw(void)
+{
+  redraw_frame();
+  force_set_markmap();
+  draw_all_cells();
+  nt35510_dma_wait();
+}
+
+static void test_redraw(void)
+{
+  static uint16_t fast[PANEL_H][PANEL_W];
+  int i, k;
+  double t;
+
+  frequency0 = 1000000;
+  frequency1 = 300000000;
+  update_frequencies();
+  for (k = 0; k < 2; k++)
+    for (i = 0; i < sweep_points; i++) {
+      double a = i * 0.2 + k, m = k ? 0.9 - i * 0.005 : 0.3 + 0.6 * i / sweep_points;
+      measured[k][i][0] = m * cos(a);
+      measured[k][i][1] = m * sin(a);
+    }
+  plot_into_index(measured);
+
+  panel_bus_reset();
+  t = now_ns();
+  redraw();
+  t = now_ns() - t;
+  memcpy(fast, panel, sizeof panel);
+  {
+    uint64_t total = panel_bus_cpu + panel_bus_dma;
+    printf("  full redraw: %llu halfword writes, CPU %llu, DMA %llu (%.0f%%)\n",
+           (unsigned long long)total, (unsigned long long)panel_bus_cpu,
+           (unsigned long long)panel_bus_dma, 100.0 * panel_bus_dma / total);
+    printf("  FSMC %d HCLK/write at %d MHz: bus %.1f ms, CPU stores %.1f ms "
+           "(%.1f ms when the CPU wrote every pixel); host %.1f ms\n",
+           FSMC_WRITE_HCLK, HCLK_MHZ, panel_bus_ms(total), panel_bus_ms(panel_bus_cpu), panel_bus_ms(total), t / 1e6);
+    printf("  CPU store instructions %llu, %llu with one 16-bit store per panel pixel\n",
+           (unsigned long long)panel_cpu_stores, (unsigned long long)total);
+    CHECK(panel_bus_dma * 10 > total * 8, "only %llu of %llu writes by DMA",
+          (unsigned long long)panel_bus_dma, (unsigned long long)total);
+  }
+
+  // DMA 放慢，绘制下一个 CELL 时上一个还在传输
+  memset(panel, 0, sizeof panel);
+  panel_dma_slow = 1;
+  redraw();
+  panel_dma_slow = 0;
+  CHECK(memcmp(fast, panel, sizeof panel) == 0, "slow DMA changed the picture");
+}
+
+/*
+=======================================
+    放大 2 倍送屏的写指令数
+=======================================
+*/
+static double stores_per_pixel(void (*blit)(const uint16_t *, int, int, int, int), int w, int h)
+{
+  int i;
+
+  for (i = 0; i < w * h; i++)
+    lcd_buffer[i] = rng_u32();
+  nt35510_dma_wait();
+  panel_bus_reset();
+  blit(lcd_buffer, 0, 0, w, h);
+  nt35510_dma_wait();
+  CHECK(panel_bus_cpu + panel_bus_dma == 17 + (uint64_t)w * h * 4, "%dx%d: %llu bus writes",
+        w, h, (unsigned long long)(panel_bus_cpu + panel_bus_dma));  // set_block + RAMWR 共 17 次
+  return (panel_cpu_stores - 17) / (double)(w * h);
+}
+
+static void test_stores(void)
+{
+  // 旧写法：每个源像素 4 次 16 位写
+  double legacy = stores_per_pixel(bulk_x2, LCD_DMA_MAXW + 8, 32);
+  double line = stores_per_pixel(bulk_x2, LCD_DMA_MAXW, 32);
+  double dma = stores_per_pixel(nt35510_bulk_x2_dma, LCD_DMA_MAXW, 32);
+  double fill;
+
+  nt35510_dma_wait();
+  panel_bus_reset();
+  nt35510_fill_x2(0, 0, LCD_WIDTH, LCD_HEIGHT, 0x1234);
+  nt35510_dma_wait();
+  fill = (panel_cpu_stores - 17) / (double)(LCD_WIDTH * LCD_HEIGHT);
+
+  printf("  x2 blit CPU stores per source pixel: 16-bit %.2f, line 32-bit %.2f, DMA %.2f; "
+         "x2 fill %.4f\n", legacy, line, dma, fill);
+  CHECK(legacy == 4 && line == 2 && dma == 0, "unexpected store counts");
+  CHECK(fill < 0.001, "fill_x2 %.4f stores per pixel", fill);
+}
+
+int main(void)
+{
+  nt35510_dma_init();
+  panel_dma_start();
+
+  test_blocks();
+  test_stores();
+  test_redraw();
+  CHECK(panel_bus_conflict == 0, "%ld CPU writes during a DMA transfer", panel_bus_conflict);
+
+  panel_dma_stop();
+  return test_result("lcd");
+}
@@ -0,0 +1,56 @@
+/*-----------------------------------------------------------------------------/
+ * Module       : test_memory.c
+ * Brief        : 曲线存储 (trace_memory_store/get) 的量化误差和扫频范围检查
+/-----------------------------------------------------------------------------*/
+#include <math.h>
+#include "system.h"
+#include "nanovna.h"
+#include "test.h"
+
+void update_frequencies(void);
+
+int main(void)
+{
+  double worst = 0;
+  float v[2];
+  int n, ch, i, k;
+
+  frequency0 = 1000000;
+  frequency1 = 300000000;
+  update_frequencies();
+  for (n = 0; n < 200; n++) {
+    float max[2] = { 0, 0 };
+    for (ch = 0; ch < 2; ch++)
+      for (i = 0; i < sweep_points; i++)
+        for (k = 0; k < 2; k++) {
+          measured[ch][i][k] = rng_uniform(-1, 1) * pow(10, rng_uniform(-4, 0.5));
+          if (fabsf(measured[ch][i][k]) > max[ch])
+            max[ch] = fabsf(measured[ch][i][k]);
+        }
+    trace_memory_store();
+    for (ch = 0; ch < 2; ch++)
+      for (i = 0; i < sweep_points; i++) {
+        CHECK(trace_memory_get(ch, i, v), "trace_memory_get(%d, %d) refused", ch, i);
+        for (k = 0; k < 2; k++) {
+          double err = fabs(v[k] - measured[ch][i][k]) / max[ch];
+          if (err > worst)
+            worst = err;
+        }
+      }
+  }
+  printf("  memory max error %.3g of the channel maximum\n", worst);
+  CHECK(worst <= 1.0 / 32768, "memory error %g", worst);
+
+  // 扫频范围或点数变了，不能再逐点对应
+  set_trace_math(0, MATH_DIV);
+  CHECK(trace_math[0] == MATH_DIV, "math not enabled");
+  frequency1 = 200000000;
+  update_frequencies();
+  CHECK(!trace_memory_get(0, 0, v), "memory used after the span changed");
+  set_trace_math(1, MATH_SUB);
+  CHECK(trace_math[1] == MATH_OFF, "math enabled on a stale memory");
+  frequency1 = 300000000;
+  update_frequencies();
+  CHECK(trace_memory_get(0, 0, v), "memory refused after the span was restored");
+  return test_result("memory");
+}
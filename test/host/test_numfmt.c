@@ -0,0 +1,124 @@
+/*-----------------------------------------------------------------------------/
+ * Module       : test_numfmt.c
+ * Brief        : numfmt.c 与 C 库 printf 比较
+ - fmt_fixed 与 snprintf("%.*f")：prec 0~6，float 的位模式按固定步长
+   遍历整个 32 位区间 (含非规格化数、inf、nan)，再加上随机值和舍入边界。
+   |v| < 2^43 时逐字相同，更大的数比较相对误差
+ - fmt_uint 与 "%0*u"，以及缓存不够时的截断
+ - 主机上的速度 (ns/次)
+/-----------------------------------------------------------------------------*/
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "nanovna.h"
+#include "test.h"
+
+#define BIT_STRIDE  8209   // 约 52 万个位模式
+#define N_RANDOM    1000000
+#define N_BENCH     200000
+
+static long checked, big;
+static double worst_big;
+
+static float from_bits(uint32_t i)
+{
+  union { float f; uint32_t i; } u;
+  u.i = i;
+  return u.f;
+}
+
+static void check_fixed(float v, int prec)
+{
+  char a[64], b[64];
+
+  fmt_fixed(a, sizeof a, v, prec);
+  snprintf(b, sizeof b, "%.*f", prec, v);
+  checked++;
+  if (fabsf(v) < 8796093022208.0f || isnan(v) || isinf(v)) {  // 2^43
+    if (strcmp(a, b) != 0)
+      CHECK(0, "fmt_fixed(%a, %d) = \"%s\", printf \"%s\"", v, prec, a, b);
+  } else {
+    double err = fabs(strtod(a, NULL) - v) / fabs(v);
+    big++;
+    if (err > worst_big)
+      worst_big = err;
+  }
+}
+
+static void test_fixed(void)
+{
+  uint64_t i;
+  int prec, n;
+
+  for (prec = 0; prec <= 6; prec++) {
+    for (i = 0; i <= 0xffffffffULL; i += BIT_STRIDE)
+      check_fixed(from_bits((uint32_t)i), prec);
+    for (n = 0; n < N_RANDOM / 7; n++)
+      check_fixed(from_bits(rng_u32()), prec);
+    // 显示和命令行里常见的量级
+    for (n = 0; n < N_RANDOM / 7; n++)
+      check_fixed((float)(rng_uniform(-1, 1) * pow(10, rng_uniform(-8, 10))), prec);
+    // 正好在舍入边界上的二进制小数：x.5、x.25、x.125 ...
+    for (n = 0; n < 100000; n++) {
+      int k = 1 + rng_u32() % 10;
+      check_fixed((float)((int)(rng_u32() % 200000) - 100000) / (1 << k) / pow(10, prec), prec);
+    }
+  }
+  printf("  fmt_fixed: %ld values, %ld beyond 2^43 with max rel err %.3g\n",
+         checked, big, worst_big);
+  CHECK(worst_big < 1e-16, "fmt_fixed relative error %g beyond 2^43", worst_big);
+}
+
+static void test_uint(void)
+{
+  char a[32], b[32];
+  int n, w, len;
+
+  for (n = 0; n < N_RANDOM; n++) {
+    uint32_t v = rng_u32() >> (rng_u32() & 31);
+    w = rng_u32() % 12;
+    fmt_uint(a, sizeof a, v, w);
+    snprintf(b, sizeof b, "%0*u", w, v);
+    if (strcmp(a, b) != 0)
+      CHECK(0, "fmt_uint(%u, %d) = \"%s\", printf \"%s\"", v, w, a, b);
+  }
+  // 缓存不够时与 snprintf 一样截断，返回写入的长度
+  for (len = 0; len < 12; len++) {
+    memset(a, 'x', sizeof a);
+    memset(b, 'x', sizeof b);
+    n = fmt_fixed(a, len, -1234.5678f, 3);
+    snprintf(b, len, "%.3f", -1234.5678f);
+    CHECK(memcmp(a, b, sizeof a) == 0, "fmt_fixed truncated to %d: \"%.*s\"", len, len, a);
+    CHECK(n == (len ? (len - 1 < 9 ? len - 1 : 9) : 0), "fmt_fixed returned %d for len %d", n, len);
+    n = fmt_str(a, len, "MHz");
+    CHECK(n == (len ? (len - 1 < 3 ? len - 1 : 3) : 0), "fmt_str returned %d for len %d", n, len);
+  }
+}
+
+static void bench(void)
+{
+  static float v[1024];
+  char buf[48];
+  double t0, t1, t2;
+  int i;
+
+  for (i = 0; i < 1024; i++)
+    v[i] = (float)(rng_uniform(-1, 1) * pow(10, rng_uniform(-3, 9)));
+  t0 = now_ns();
+  for (i = 0; i < N_BENCH; i++)
+    fmt_fixed(buf, sizeof buf, v[i & 1023], 6);
+  t1 = now_ns();
+  for (i = 0; i < N_BENCH; i++)
+    snprintf(buf, sizeof buf, "%.6f", v[i & 1023]);
+  t2 = now_ns();
+  printf("  ns/call (host)  fmt_fixed %.0f  snprintf %.0f\n",
+         (t1 - t0) / N_BENCH, (t2 - t1) / N_BENCH);
+}
+
+int main(void)
+{
+  test_fixed();
+  test_uint();
+  bench();
+  return test_result("numfmt");
+}
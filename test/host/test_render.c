@@ -0,0 +1,183 @@
+/*-----------------------------------------------------------------------------/
+ * Module       : test_render.c
+ * Brief        : 固定测试数据的整屏画面与保存的图 (render0.ppm, render1.ppm) 比较
+ 这里直接包含 appvna.c，nt35510.c 用 panel.c 的面板模型编译，
+ LCD 的写入和 DMA 都进到 800x480 的面板。
+ - app_init 之后，render test 的两组数据 (render_test_data) 各整屏重绘一次，
+   面板与 test/host/renderN.ppm 逐点比较；不同时写出 obj/renderN.ppm
+   和差异图 obj/renderN_diff.ppm (不同的点标成品红)
+ - 每帧送屏的像素数、窗口数，按 FSMC 时序折算的总线时间和主机时间
+ - DMA 放慢后重画，画面不变
+ - app_loop 在另一个线程里运行时执行 render test 命令：输出这一帧的统计，
+   结束后 measured 恢复原样，扫描状态 (运行/暂停) 不变
+ 绘图改动有意改变了画面时，看过 obj/renderN.ppm 后用
+ RENDER_UPDATE=1 ./test_render 更新保存的图。
+/-----------------------------------------------------------------------------*/
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "../../Usr/appvna.c"
+#include "hw.h"
+#include "panel.h"
+#include "test.h"
+
+void cmd_register(void);
+
+/*
+=======================================
+    整屏画面
+=======================================
+*/
+static uint16_t golden[PANEL_H][PANEL_W];
+
+/* 载入第 set 组数据后整屏重绘，统计 draw_all_cells 这一帧 */
+static double render_frame(int set)
+{
+  double t;
+
+  render_test_data(set);
+  redraw_frame();
+  plot_into_index(measured);
+  force_set_markmap();
+  nt35510_dma_wait();
+  panel_bus_reset();
+  t = now_ns();
+  draw_all_cells();
+  nt35510_dma_wait();
+  return now_ns() - t;
+}
+
+static void check_frame(int set)
+{
+  const uint16_t (*img)[PANEL_W] = (const uint16_t (*)[PANEL_W])panel;
+  char path[32], out[32], diff_path[32];
+  long diff;
+
+  snprintf(path, sizeof path, "render%d.ppm", set);
+  snprintf(out, sizeof out, "obj/render%d.ppm", set);
+  snprintf(diff_path, sizeof diff_path, "obj/render%d_diff.ppm", set);
+  if (getenv("RENDER_UPDATE")) {
+    CHECK(panel_write_ppm(path, img) == 0, "cannot write %s", path);
+    printf("  %s updated\n", path);
+    return;
+  }
+  if (panel_read_ppm(path, golden) < 0) {
+    panel_write_ppm(out, img);
+    CHECK(0, "cannot read %s; the picture is in %s", path, out);
+    return;
+  }
+  diff = panel_diff((const uint16_t (*)[PANEL_W])golden, img, diff_path);
+  if (diff) {
+    panel_write_ppm(out, img);
+    CHECK(0, "set %d: %ld pixels differ from %s, see %s and %s", set, diff, path, out, diff_path);
+  }
+}
+
+static void test_frames(void)
+{
+  static uint16_t first[2][PANEL_H][PANEL_W];
+  double t;
+  int set;
+
+  for (set = 0; set < 2; set++) {
+    t = render_frame(set);
+    printf("  set %d: %u cells, %llu windows, %llu pixels pushed; "
+           "FSMC %.1f ms (CPU %.1f ms), host %.2f ms per frame\n", set, render_stats.cells,
+           (unsigned long long)panel_windows, (unsigned long long)panel_pixels,
+           panel_bus_ms(panel_bus_cpu + panel_bus_dma), panel_bus_ms(panel_bus_cpu), t / 1e6);
+    CHECK(render_stats.pixels == panel_pixels, "set %d: %u pixels counted, %llu reached the panel",
+          set, render_stats.pixels, (unsigned long long)panel_pixels);
+    check_frame(set);
+    memcpy(first[set], panel, sizeof panel);
+  }
+
+  // 另一组数据之后、DMA 放慢时重画，结果不变
+  panel_dma_slow = 1;
+  for (set = 0; set < 2; set++) {
+    memset(panel, 0, sizeof panel);
+    render_frame(set);
+    CHECK(memcmp(first[set], panel, sizeof panel) == 0, "set %d: redraw with a slow DMA differs",
+          set);
+  }
+  panel_dma_slow = 0;
+}
+
+/*
+=======================================
+    render test 命令
+=======================================
+*/
+static void *app_thread(void *arg)
+{
+  (void)arg;
+  for (;;)
+    app_loop();
+  return NULL;
+}
+
+static void render_test(int set)
+{
+  char line[32];
+  const char *p;
+  unsigned pixels = 0;
+  int start = host_cdc_len;
+
+  snprintf(line, sizeof line, "render test %d", set);
+  host_command(line);
+  host_cdc_out[host_cdc_len] = 0;
+  p = strstr((char *)host_cdc_out + start, "pixels ");
+  CHECK(p && sscanf(p, "pixels %u", &pixels) == 1 && pixels > 0, "render test %d: %s", set,
+        (char *)host_cdc_out + start);
+}
+
+static void wait_sweeps(int n)
+{
+  uint32_t c = sweep_count;
+  int t;
+  for (t = 0; t < 500 && sweep_count - c < (uint32_t)n; t++)
+    usleep(10000);
+  CHECK(sweep_count - c >= (uint32_t)n, "sweep stalled at %u", sweep_count);
+}
+
+static void test_command(void)
+{
+  static float saved[2][SWEEP_POINTS][2];
+  pthread_t th;
+  int set, i, k;
+
+  pthread_create(&th, NULL, app_thread, NULL);
+
+  // 扫描中运行，结束后继续扫描
+  wait_sweeps(2);
+  for (set = 0; set < 2; set++)
+    render_test(set);
+  CHECK(sweep_enabled, "sweep left paused");
+  wait_sweeps(2);
+
+  // 暂停时运行，测量数据原样恢复，扫描仍然暂停
+  host_command("pause");
+  chMtxLock(&mutex);
+  for (k = 0; k < 2; k++)
+    for (i = 0; i < sweep_points; i++) {
+      measured[k][i][0] = rng_uniform(-1, 1);
+      measured[k][i][1] = rng_uniform(-1, 1);
+    }
+  memcpy(saved, measured, sizeof saved);
+  chMtxUnlock(&mutex);
+  for (set = 0; set < 2; set++)
+    render_test(set);
+  CHECK(!sweep_enabled, "sweep resumed");
+  CHECK(memcmp(saved, measured, sizeof saved) == 0, "measured not restored");
+}
+
+int main(void)
+{
+  panel_dma_start();
+  app_init();
+  cmd_register();
+
+  test_frames();
+  test_command();
+  CHECK(panel_bus_conflict == 0, "%ld CPU writes during a DMA transfer", panel_bus_conflict);
+  return test_result("render");
+}
@@ -0,0 +1,135 @@
+/*-----------------------------------------------------------------------------/
+ * Module       : test_segidx.c
+ * Brief        : Smith/极坐标曲线的 CELL 线段索引 (build_segment_index)
+ 这里直接包含 plot.c。Smith 和极坐标曲线经 plot_into_index 建立索引后，
+ 每个 CELL 用索引画一次，再清掉 seg_indexed 逐段画一次，两次的 CELL 缓存
+ 必须完全一样。CELL 的起始行取整行和半行 (跨两行 CELL) 两种。
+ 曲线有平滑的、随机跳动的，跳动大时 seg_pool 放不下，该曲线退回逐段绘制。
+ 统计每帧光栅化的线段数 (cell_drawline 调用次数)。
+/-----------------------------------------------------------------------------*/
+#include "../../Usr/plot.c"
+#include "hw.h"
+#include "test.h"
+
+void update_frequencies(void);
+
+static const struct {
+  const char *name;
+  uint8_t type[TRACES_MAX];  // 0xff: 关闭
+  int jagged;                // 相邻点的相位随机跳动
+} trace_set[] = {
+  { "smith",          { TRC_SMITH, 0xff, 0xff, 0xff }, 0 },
+  { "polar",          { TRC_POLAR, 0xff, 0xff, 0xff }, 0 },
+  { "smith+polar",    { TRC_SMITH, TRC_POLAR, 0xff, 0xff }, 0 },
+  { "4 traces",       { TRC_SMITH, TRC_POLAR, TRC_SMITH, TRC_LOGMAG }, 0 },
+  { "jagged",         { TRC_SMITH, TRC_POLAR, 0xff, 0xff }, 1 },
+};
+
+static void fill_measured(int jagged)
+{
+  int k, i;
+
+  for (k = 0; k < 2; k++)
+    for (i = 0; i < sweep_points; i++) {
+      double a = jagged ? rng_uniform(-M_PI, M_PI) : i * 0.15 + k;
+      double m = jagged ? rng_uniform(0, 1) : 0.2 + 0.7 * i / sweep_points;
+      measured[k][i][0] = m * cos(a);
+      measured[k][i][1] = m * sin(a);
+    }
+}
+
+/* 本 CELL 要画的 Smith/极坐标线段数 */
+static long cell_segments(int m, int y0, int h)
+{
+  long n = 0;
+  int t, row;
+
+  for (t = 0; t < TRACES_MAX; t++) {
+    if (!trace[t].enabled || (trace[t].type != TRC_SMITH && trace[t].type != TRC_POLAR))
+      continue;
+    if (!(seg_indexed & (1 << t))) {
+      n += sweep_points - 1;
+      continue;
+    }
+    for (row = y0 / CELLHEIGHT; row <= (y0 + h - 1) / CELLHEIGHT; row++)
+      n += seg_start[t][row * CELL_COLS + m + 1] - seg_start[t][row * CELL_COLS + m];
+  }
+  return n;
+}
+
+/* 画满绘图区，比较两种画法，返回不同的像素数 */
+static long draw_area(int y_offset, long *indexed, long *plain)
+{
+  static uint16_t a[CELLWIDTH * CELLHEIGHT];
+  int cols = (area_width + CELLWIDTH - 1) / CELLWIDTH;
+  uint8_t saved = seg_indexed;
+  long diff = 0;
+  int m, y0, h, i;
+
+  *indexed = *plain = 0;
+  for (m = 0; m < cols; m++)
+    for (y0 = 0; y0 < area_height; y0 += h) {
+      h = y0 == 0 && y_offset ? y_offset : CELLHEIGHT;
+      if (y0 + h > area_height)
+        h = area_height - y0;
+
+      seg_indexed = saved;
+      *indexed += cell_segments(m, y0, h);
+      draw_cell(m, y0, h);
+      memcpy(a, CELL_BUFFER(cell_buffer_sel ^ 1), sizeof a);
+
+      seg_indexed = 0;
+      *plain += cell_segments(m, y0, h);
+      draw_cell(m, y0, h);
+      for (i = 0; i < CELLWIDTH * CELLHEIGHT; i++)
+        if (a[i] != CELL_BUFFER(cell_buffer_sel ^ 1)[i] && diff++ < 5)
+          printf("  cell %d row %d (%d,%d): indexed %04x, all segments %04x\n", m, y0,
+                 i % CELLWIDTH, i / CELLWIDTH, a[i], CELL_BUFFER(cell_buffer_sel ^ 1)[i]);
+    }
+  seg_indexed = saved;
+  nt35510_dma_wait();
+  return diff;
+}
+
+int main(void)
+{
+  unsigned s;
+  int t, y_offset;
+
+  nt35510_dma_init();
+  host_lcd_dma_start();
+  frequency0 = 1000000;
+  frequency1 = 300000000;
+  update_frequencies();
+
+  for (s = 0; s < sizeof trace_set / sizeof trace_set[0]; s++) {
+    long indexed, plain, diff;
+    int fallback = 0;
+
+    for (t = 0; t < TRACES_MAX; t++) {
+      trace[t].enabled = trace_set[s].type[t] != 0xff;
+      trace[t].type = trace[t].enabled ? trace_set[s].type[t] : TRC_LOGMAG;
+      trace[t].channel = t & 1;
+      trace[t].scale = trace[t].type == TRC_LOGMAG ? 10 : 1;
+      trace[t].refpos = trace[t].type == TRC_LOGMAG ? 7 : 0;
+    }
+    fill_measured(trace_set[s].jagged);
+    plot_into_index(measured);
+    for (t = 0; t < TRACES_MAX; t++)
+      if (trace[t].enabled && (trace[t].type == TRC_SMITH || trace[t].type == TRC_POLAR) &&
+          !(seg_indexed & (1 << t)))
+        fallback++;
+
+    for (y_offset = 0; y_offset <= CELLHEIGHT / 2; y_offset += CELLHEIGHT / 2) {
+      diff = draw_area(y_offset, &indexed, &plain);
+      CHECK(diff == 0, "%s, rows from %d: %ld pixels differ", trace_set[s].name, y_offset, diff);
+      CHECK(indexed <= plain, "%s: %ld segments with the index, %ld without",
+            trace_set[s].name, indexed, plain);
+    }
+    printf("  %-12s segments per frame: index %ld, all %ld (%.1f%%); %d traces not indexed\n",
+           trace_set[s].name, indexed, plain, plain ? 100.0 * indexed / plain : 0.0, fallback);
+    if (!trace_set[s].jagged)
+      CHECK(fallback == 0, "%s: %d smooth traces fell back", trace_set[s].name, fallback);
+  }
+  return test_result("segidx");
+}
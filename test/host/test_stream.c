@@ -0,0 +1,200 @@
+/*-----------------------------------------------------------------------------/
+ * Module       : test_stream.c
+ * Brief        : stream/event 推送的数据和命令输出不交错
+ 这里直接包含 appvna.c。app_loop 在另一个线程里扫描，推送记录和事件，
+ 同时不断执行命令，其中 help、frequencies、link、wait 不取测量锁。
+ 然后把 host_cdc_out 从头解析：
+ - 每条命令的输出完整：help/frequencies 与停止推送时的参考输出相同，
+   bindata 的帧 CRC 正确，wait 的结果行前面只能是推送的数据
+ - 两条命令之间只有 CRC 正确的记录和 "!sweep n" 行
+ - 记录按扫描序号和点号连续，中间丢过的下一条带 STREAM_DROPPED，
+   事件的扫描序号递增，暂停后最后一次扫描的事件也会补发
+ - 最后 link 报告的命令执行时间不全是 0 (主机上的 CYCCNT 按时钟走)
+/-----------------------------------------------------------------------------*/
+#include <pthread.h>
+#include <unistd.h>
+#include "../../Usr/appvna.c"
+#include "hw.h"
+#include "test.h"
+
+void cmd_register(void);
+
+#define N_COMMANDS  400
+
+// 前 N_RANDOM 种随机执行，最后暂停扫描、关掉事件
+static const char *commands[] = {
+  "help", "frequencies", "link", "bindata f", "wait", "pause", "event off"
+};
+#define N_RANDOM  5
+
+static struct {
+  int kind, start, end;
+} run[N_COMMANDS + 2];
+
+static uint8_t reference[2][8192];
+static int reference_len[2];
+static uint32_t records, drops, events, last_event;
+static stream_rec_t last_rec;
+
+static void *app_thread(void *arg)
+{
+  (void)arg;
+  for (;;)
+    app_loop();
+  return NULL;
+}
+
+/* 从 p 开始的一段推送数据：记录或事件行，返回长度，不是推送的数据返回 0 */
+static int pushed(const uint8_t *p, int len)
+{
+  stream_rec_t r;
+  uint32_t seq;
+  int n;
+
+  if (len >= (int)sizeof r) {
+    memcpy(&r, p, sizeof r);
+    if (r.magic == STREAM_MAGIC && r.crc == crc32(0, &r, offsetof(stream_rec_t, crc))) {
+      if (records && !(r.flags & STREAM_DROPPED)) {
+        int next = (last_rec.flags & STREAM_LAST)
+          ? r.index == 0 && r.seq == (uint16_t)(last_rec.seq + 1)
+          : r.index == last_rec.index + 1 && r.seq == last_rec.seq;
+        CHECK(next, "record %u/%u follows %u/%u without STREAM_DROPPED",
+              r.seq, r.index, last_rec.seq, last_rec.index);
+      }
+      if (r.flags & STREAM_DROPPED)
+        drops++;
+      records++;
+      last_rec = r;
+      return sizeof r;
+    }
+  }
+  if (len > 7 && memcmp(p, "!sweep ", 7) == 0) {
+    for (n = 7; n < len && p[n] != '\n'; n++)
+      ;
+    if (n < len && sscanf((const char *)p + 7, "%u", &seq) == 1) {
+      CHECK(seq > last_event, "event %u after %u", seq, last_event);
+      last_event = seq;
+      events++;
+      return n + 1;
+    }
+  }
+  return 0;
+}
+
+/* [pos, end) 全部是推送的数据 */
+static void check_pushed(int pos, int end, const char *where)
+{
+  int n;
+
+  while (pos < end) {
+    n = pushed(host_cdc_out + pos, end - pos);
+    if (n == 0) {
+      CHECK(0, "%s: stray byte %02x at %d", where, host_cdc_out[pos], pos);
+      return;
+    }
+    pos += n;
+  }
+}
+
+static void check_command(int i)
+{
+  const uint8_t *p = host_cdc_out + run[i].start;
+  int len = run[i].end - run[i].start, n;
+  bin_header_t h;
+
+  switch (run[i].kind) {
+  case 0:
+  case 1:
+    CHECK(len == reference_len[run[i].kind] && memcmp(p, reference[run[i].kind], len) == 0,
+          "command %d (%s): output differs from the reference", i, commands[run[i].kind]);
+    break;
+  case 2:
+    for (n = 0; n < len; n++)
+      if (p[n] != '\r' && p[n] != '\n' && (p[n] < ' ' || p[n] > '~'))
+        break;
+    CHECK(len > 0 && n == len, "command %d (link): byte %02x at %d", i, n < len ? p[n] : 0, n);
+    break;
+  case 3:
+    memcpy(&h, p, sizeof h);
+    CHECK(len == (int)sizeof h + h.size && h.magic == BIN_MAGIC &&
+          h.crc == crc32(0, p + sizeof h, h.size), "command %d (bindata): bad frame", i);
+    break;
+  case 4:
+    // 等待期间推送的数据在前，剩下的是结果行
+    while (len > 0 && (n = pushed(p, len)) > 0) {
+      p += n;
+      len -= n;
+    }
+    for (n = 0; n < len && p[n] >= '0' && p[n] <= '9'; n++)
+      ;
+    CHECK(n > 0 && n == len - 2 && memcmp(p + n, "\r\n", 2) == 0,
+          "command %d (wait): \"%.*s\"", i, len, p);
+    break;
+  default:
+    CHECK(len == 0, "command %d (%s): \"%.*s\"", i, commands[run[i].kind], len, p);
+    break;
+  }
+}
+
+static void run_command(int i, int kind)
+{
+  run[i].kind = kind;
+  CDC_TxLock_FS(1);  // 命令开始的位置，host_command 返回时已经放开
+  run[i].start = host_cdc_len;
+  run[i].end = run[i].start + host_command(commands[kind]);
+}
+
+int main(void)
+{
+  pthread_t th;
+  int i, k, base;
+
+  host_lcd_dma_start();
+  app_init();
+  cmd_register();
+  pthread_create(&th, NULL, app_thread, NULL);
+
+  // 没有推送时的参考输出
+  for (k = 0; k < 2; k++) {
+    int start = host_cdc_len;
+    reference_len[k] = host_command(commands[k]);
+    memcpy(reference[k], host_cdc_out + start, reference_len[k]);
+  }
+
+  host_command("stream on");
+  host_command("event on");
+  base = host_cdc_len;
+  for (i = 0; i < N_COMMANDS && host_cdc_len < HOST_CDC_OUT_SIZE * 3 / 4; i++) {
+    run_command(i, rng_u32() % N_RANDOM);
+    usleep(rng_u32() % 2000);
+  }
+  // 暂停后最后一次扫描的事件一定发出
+  run_command(i++, 5);
+  usleep(100000);
+  run_command(i++, 6);
+
+  for (k = 0; k < i; k++) {
+    check_pushed(k ? run[k - 1].end : base, run[k].start, "between commands");
+    check_command(k);
+  }
+  CHECK(last_event == sweep_count, "last event %u, sweep_count %u", last_event, sweep_count);
+  printf("  %d commands, %u records (%u after drops), %u events, %d bytes\n",
+         i, records, drops, events, run[i - 1].end);
+  CHECK(records > 1000 && events > 10, "too little pushed data to test");
+
+  // 命令执行时间按 DWT 周期计数，几百条命令下来最长的不会是 0
+  {
+    unsigned total = 0, p50 = 0, p90 = 0, p99 = 0, max = 0;
+    const char *s;
+    int start = host_cdc_len;
+
+    host_command("link");
+    host_cdc_out[host_cdc_len] = 0;
+    s = strstr((const char *)host_cdc_out + start, "commands ");
+    CHECK(s && sscanf(s, "commands %u p50 %u p90 %u p99 %u max %u us", &total, &p50, &p90, &p99,
+                      &max) == 5, "link: no command times");
+    CHECK(total >= (unsigned)i && max > 0 && p50 <= p90 && p90 <= p99 && p99 <= max,
+          "link: %u commands, p50 %u p90 %u p99 %u max %u us", total, p50, p90, p99, max);
+  }
+  return test_result("stream");
+}
@@ -0,0 +1,214 @@
+/*-----------------------------------------------------------------------------/
+ * Module       : test_text.c
+ * Brief        : 一串字符一个窗口的文字绘制 (text_run) 与原来逐字绘制比较
+ 这里直接包含 nt35510.c，总线写入进到 panel.c 的面板模型。
+ 原来的写法 (每个字符把字模展开到 lcd_buffer，再用 nt35510_bulk 或
+ nt35510_bulk_x2 设一个窗口送出) 抄在下面作为参考。
+ 每种字体、原样和放大 2 倍，随机的字符串和颜色，两种写法画在同样的
+ 底图上，整屏逐点比较。字符串超出屏幕右边时，text_run 只画完整的字符，
+ 原来的写法画出的半个字符不算，那里的底图必须保持不变。
+ 统计两种写法的窗口数、总线写次数、CPU 写指令数和按 FSMC 时序折算的时间。
+/-----------------------------------------------------------------------------*/
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "panel.h"
+#include "../../Usr/nt35510.c"
+#include "test.h"
+
+#define RUNS  300
+
+extern MWCFONT font_06x13, font_08x15, font_10x20, font_12x24;
+
+/*
+=======================================
+    原来的逐字绘制
+=======================================
+*/
+static void glyph_to_buffer(uint32_t (*glyph)(const void *, uint8_t, int), const void *font,
+                            uint8_t ch, int w, int h, uint16_t fg, uint16_t bg)
+{
+  uint16_t *buf = lcd_buffer;
+  int c, r;
+  for (c = 0; c < h; c++) {
+    uint32_t bits = glyph(font, ch, c);
+    for (r = 0; r < w; r++, bits <<= 1)
+      *buf++ = (0x80000000UL & bits) ? fg : bg;
+  }
+}
+
+/* 字体种类，x, y 同对应的 nt35510_drawstring* 的参数 */
+enum { MWC_X1, MWC_X2, F5X7_X2, F10X14, HZ24, KINDS };
+static const char *kind_name[KINDS] = { "mwc", "mwc x2", "5x7 x2", "10x14", "hanzi 24" };
+
+static void legacy_string(int kind, MWCFONT *font, const char *str, int x, int y,
+                          uint16_t fg, uint16_t bg)
+{
+  for (; *str; str++) {
+    uint8_t ch = *str;
+    switch (kind) {
+    case MWC_X1:
+      glyph_to_buffer(glyph_mwc, font, ch, font->maxwidth, font->height, fg, bg);
+      nt35510_bulk(x, y, font->maxwidth, font->height);
+      x += font->maxwidth;
+      break;
+    case MWC_X2:
+      glyph_to_buffer(glyph_mwc, font, ch, font->maxwidth, font->height, fg, bg);
+      nt35510_bulk_x2(x, y, font->maxwidth, font->height);
+      x += font->maxwidth;
+      break;
+    case F5X7_X2:
+      glyph_to_buffer(glyph_5x7, NULL, ch, 5, 7, fg, bg);
+      nt35510_bulk_x2(x, y, 5, 7);
+      x += 5;
+      break;
+    case F10X14:
+      glyph_to_buffer(glyph_10x14, NULL, ch, 10, 14, fg, bg);
+      nt35510_bulk(x*2, y*2, 10, 14);
+      x += 5;
+      break;
+    case HZ24:
+      glyph_to_buffer(glyph_hz24, NULL, ch, 24, 24, fg, bg);
+      nt35510_bulk(x*2, y*2, 24, 24);
+      x += 12;
+      break;
+    }
+  }
+}
+
+static void new_string(int kind, MWCFONT *font, const char *str, int x, int y,
+                       uint16_t fg, uint16_t bg)
+{
+  switch (kind) {
+  case MWC_X1:  nt35510_drawstring(font, str, x, y, fg, bg); break;
+  case MWC_X2:  nt35510_drawstring_x2(font, str, x, y, fg, bg); break;
+  case F5X7_X2: nt35510_drawstring_5x7_x2(str, x, y, fg, bg); break;
+  case F10X14:  nt35510_drawstring_5x7(str, x, y, fg, bg); break;
+  case HZ24:    nt35510_drawhz24x24(str, x, y, fg, bg); break;
+  }
+}
+
+/*
+=======================================
+    比较
+=======================================
+*/
+static uint16_t base[PANEL_H][PANEL_W], old[PANEL_H][PANEL_W];
+
+static struct {
+  uint64_t windows, halfwords, stores;
+  double host;
+} stat[2][KINDS];
+
+static void count(int k, int kind, double t)
+{
+  stat[k][kind].windows += panel_windows;
+  stat[k][kind].halfwords += panel_bus_cpu + panel_bus_dma;
+  stat[k][kind].stores += panel_cpu_stores;
+  stat[k][kind].host += t;
+}
+
+/* 一个字符在面板上的宽和高，坐标换算 */
+static void geometry(int kind, MWCFONT *font, int *gw, int *gh, int *unit)
+{
+  switch (kind) {
+  case MWC_X1:  *gw = font->maxwidth;     *gh = font->height;     *unit = 1; break;
+  case MWC_X2:  *gw = font->maxwidth * 2; *gh = font->height * 2; *unit = 2; break;
+  case F5X7_X2: *gw = 10;                 *gh = 14;               *unit = 2; break;
+  case F10X14:  *gw = 10;                 *gh = 14;               *unit = 2; break;
+  default:      *gw = 24;                 *gh = 24;               *unit = 2; break;
+  }
+}
+
+static long run(int kind, MWCFONT *font, int clip)
+{
+  char str[24];
+  int gw, gh, unit, n, i, x, y, px, py, fit;
+  uint16_t fg = rng_u32(), bg = rng_u32();
+  long diff = 0;
+  double t;
+
+  geometry(kind, font, &gw, &gh, &unit);
+  n = 1 + rng_u32() % 20;
+  for (i = 0; i < n; i++)
+    str[i] = kind == HZ24 ? 1 + rng_u32() % 32 : 32 + rng_u32() % 95;
+  str[n] = '\0';
+  if (clip)  // 最后几个字符超出右边，可能从字符中间截断
+    px = PANEL_W - gw * (1 + rng_u32() % n) + rng_u32() % gw;
+  else
+    px = rng_u32() % (PANEL_W - n * gw + 1);
+  px -= px % unit;
+  py = rng_u32() % (PANEL_H - gh + 1);
+  py -= py % unit;
+  x = px / unit;
+  y = py / unit;
+  fit = (PANEL_W - px) / gw;
+  if (fit > n)
+    fit = n;
+
+  nt35510_dma_wait();
+  memcpy(panel, base, sizeof panel);
+  panel_bus_reset();
+  t = now_ns();
+  legacy_string(kind, font, str, x, y, fg, bg);
+  count(0, kind, now_ns() - t);
+  CHECK(panel_windows == (uint64_t)n, "%s: %llu windows for %d glyphs", kind_name[kind],
+        (unsigned long long)panel_windows, n);
+  memcpy(old, panel, sizeof panel);
+  for (i = py; i < py + gh; i++)  // 放不下的字符不画
+    memcpy(&old[i][px + fit * gw], &base[i][px + fit * gw],
+           (PANEL_W - px - fit * gw) * sizeof base[0][0]);
+
+  memcpy(panel, base, sizeof panel);
+  panel_bus_reset();
+  t = now_ns();
+  new_string(kind, font, str, x, y, fg, bg);
+  nt35510_dma_wait();
+  count(1, kind, now_ns() - t);
+  CHECK(panel_windows == (fit > 0), "%s: %llu windows for one run", kind_name[kind],
+        (unsigned long long)panel_windows);
+
+  for (i = 0; i < PANEL_H; i++)
+    for (px = 0; px < PANEL_W; px++)
+      if (panel[i][px] != old[i][px] && diff++ < 3)
+        printf("  %s \"%s\" at (%d,%d)%s: (%d,%d) %04x, per glyph %04x\n", kind_name[kind],
+               str, x, y, clip ? " clipped" : "", px, i, panel[i][px], old[i][px]);
+  return diff;
+}
+
+int main(void)
+{
+  static MWCFONT *fonts[] = { &font_06x13, &font_08x15, &font_10x20, &font_12x24 };
+  int kind, f, r, k, nf;
+  long diff;
+
+  nt35510_dma_init();
+  panel_dma_start();
+  for (r = 0; r < PANEL_H; r++)
+    for (k = 0; k < PANEL_W; k++)
+      base[r][k] = rng_u32();
+
+  for (kind = 0; kind < KINDS; kind++) {
+    nf = kind == MWC_X1 || kind == MWC_X2 ? 4 : 1;
+    for (f = 0; f < nf; f++) {
+      diff = 0;
+      for (r = 0; r < RUNS; r++)
+        diff += run(kind, fonts[f], r % 4 == 0);
+      CHECK(diff == 0, "%s %s: %ld pixels differ from per-glyph drawing", kind_name[kind],
+            nf > 1 ? fonts[f]->name : "", diff);
+    }
+  }
+
+  printf("  %d strings per font, per glyph -> one window per string:\n", RUNS);
+  for (kind = 0; kind < KINDS; kind++)
+    printf("  %-9s windows %6llu -> %5llu, FSMC %6.1f -> %6.1f ms, CPU stores %8llu -> %8llu, "
+           "host %5.1f -> %5.1f ms\n", kind_name[kind],
+           (unsigned long long)stat[0][kind].windows, (unsigned long long)stat[1][kind].windows,
+           panel_bus_ms(stat[0][kind].halfwords), panel_bus_ms(stat[1][kind].halfwords),
+           (unsigned long long)stat[0][kind].stores, (unsigned long long)stat[1][kind].stores,
+           stat[0][kind].host / 1e6, stat[1][kind].host / 1e6);
+  CHECK(panel_bus_conflict == 0, "%ld CPU writes during a DMA transfer", panel_bus_conflict);
+  panel_dma_stop();
+  return test_result("text");
+}
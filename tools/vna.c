@@ -0,0 +1,307 @@
+/*-----------------------------------------------------------------------------/
+ * Module       : vna.c
+ * Brief        : 主机端的 USB 串口客户端
+ 设备发出的字节流由三种数据交错组成：
+ - 命令的回显、输出和提示符 "ch> "，输出里可能有 bindata 的帧
+ - stream 记录 (32 字节，以 17 5A 开头，带 CRC)
+ - event 行 "!sweep <n>\r\n"
+ 设备每次整段写入，推送的数据不会插进命令的输出 (只可能出现在回显、
+ 提示符前后和 wait 等待期间)，所以这里在每个位置先认推送的数据，
+ 再认帧头 (5A B1)，帧按帧头里的长度整段取走，剩下的才是文本。
+/-----------------------------------------------------------------------------*/
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <poll.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include "vna.h"
+
+#define PROMPT      "ch> "
+#define PROMPT_LEN  4
+
+uint32_t vna_crc32(uint32_t crc, const void *data, int len)
+{
+  const uint8_t *p = data;
+  int k;
+
+  crc = ~crc;
+  while (len-- > 0) {
+    crc ^= *p++;
+    for (k = 0; k < 8; k++)
+      crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+  }
+  return ~crc;
+}
+
+static int64_t vna_ms(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+int vna_open(vna_t *v, const char *path)
+{
+  struct termios t;
+
+  memset(v, 0, sizeof *v);
+  v->fd = open(path, O_RDWR | O_NOCTTY);
+  if (v->fd < 0)
+    return -1;
+  if (tcgetattr(v->fd, &t) == 0) {  // USB 串口的波特率没有意义
+    cfmakeraw(&t);
+    t.c_cc[VMIN] = 1;
+    t.c_cc[VTIME] = 0;
+    tcsetattr(v->fd, TCSANOW, &t);
+  }
+  return 0;
+}
+
+void vna_close(vna_t *v)
+{
+  if (v->fd >= 0)
+    close(v->fd);
+  v->fd = -1;
+}
+
+/* 读一次，等 timeout_ms。返回读到的字节数，超时 0，出错 -1 */
+static int vna_read(vna_t *v, int timeout_ms)
+{
+  struct pollfd pfd = { v->fd, POLLIN, 0 };
+  int n;
+
+  if (v->len == VNA_BUF_SIZE)
+    return -1;
+  n = poll(&pfd, 1, timeout_ms < 0 ? 0 : timeout_ms);
+  if (n <= 0)
+    return n < 0 && errno != EINTR ? -1 : 0;
+  n = read(v->fd, v->buf + v->len, VNA_BUF_SIZE - v->len);
+  if (n < 0)
+    return errno == EINTR || errno == EAGAIN ? 0 : -1;
+  v->len += n;
+  v->rx_bytes += n;
+  return n;
+}
+
+/*
+=======================================
+    分离推送的数据
+=======================================
+*/
+enum { ITEM_MORE, ITEM_TEXT, ITEM_PUSHED, ITEM_FRAME };
+
+/* p 处的一项，长度存入 *n；数据不够判断时返回 ITEM_MORE */
+static int vna_item(vna_t *v, const uint8_t *p, int len, int *n)
+{
+  vna_record_t r;
+  vna_header_t h;
+  uint32_t seq;
+  int i;
+
+  *n = 1;
+  if (p[0] == (VNA_STREAM_MAGIC & 0xff)) {
+    if (len < 2 || (p[1] == VNA_STREAM_MAGIC >> 8 && len < (int)sizeof r))
+      return ITEM_MORE;
+    memcpy(&r, p, sizeof r);
+    if (r.magic == VNA_STREAM_MAGIC &&
+        r.crc == vna_crc32(0, &r, (int)((uint8_t *)&r.crc - (uint8_t *)&r))) {
+      v->records++;
+      if (v->on_record)
+        v->on_record(v->ctx, &r);
+      *n = sizeof r;
+      return ITEM_PUSHED;
+    }
+  } else if (p[0] == '!') {
+    static const char tag[] = "!sweep ";
+    for (i = 1; i < len && i < 7; i++)
+      if (p[i] != tag[i])
+        return ITEM_TEXT;
+    for (seq = 0; i < len && p[i] >= '0' && p[i] <= '9'; i++)
+      seq = seq * 10 + p[i] - '0';
+    if (i + 2 > len)
+      return i < 24 ? ITEM_MORE : ITEM_TEXT;
+    if (i > 7 && p[i] == '\r' && p[i + 1] == '\n') {
+      v->events++;
+      if (v->on_event)
+        v->on_event(v->ctx, seq);
+      *n = i + 2;
+      return ITEM_PUSHED;
+    }
+  } else if (p[0] == (VNA_BIN_MAGIC & 0xff)) {
+    if (len < 2 || (p[1] == VNA_BIN_MAGIC >> 8 && len < (int)sizeof h))
+      return ITEM_MORE;
+    memcpy(&h, p, sizeof h);
+    if (h.magic == VNA_BIN_MAGIC && h.format >= VNA_FMT_U32 && h.format <= VNA_FMT_I16X2 &&
+        (int)sizeof h + h.size <= VNA_BUF_SIZE) {
+      if (len < (int)sizeof h + h.size)
+        return ITEM_MORE;
+      *n = sizeof h + h.size;
+      return ITEM_FRAME;
+    }
+  }
+  return ITEM_TEXT;
+}
+
+/*
+ * 处理收到的数据，推送的交给回调，其余追加到 out (为 NULL 时丢弃)。
+ * *text 是 out 末尾连续文本的长度，遇到帧时清零。返回 out 的新长度
+ */
+static int vna_demux(vna_t *v, uint8_t *out, int size, int out_len, int *text)
+{
+  int pos = 0, n, m, kind;
+
+  while (pos < v->len) {
+    kind = vna_item(v, v->buf + pos, v->len - pos, &n);
+    if (kind == ITEM_MORE)
+      break;
+    if (kind != ITEM_PUSHED && out) {
+      m = out_len + n > size ? size - out_len : n;  // 放不下时截掉，vna_command 返回 -1
+      memcpy(out + out_len, v->buf + pos, m);
+      out_len += m;
+      *text = kind == ITEM_TEXT ? *text + m : 0;
+    }
+    pos += n;
+  }
+  memmove(v->buf, v->buf + pos, v->len - pos);
+  v->len -= pos;
+  return out_len;
+}
+
+int vna_poll(vna_t *v, int timeout_ms)
+{
+  int64_t end = vna_ms() + timeout_ms;
+  int n, text = 0;
+
+  do {
+    n = vna_read(v, (int)(end - vna_ms()));
+    if (n < 0)
+      return -1;
+    vna_demux(v, NULL, 0, 0, &text);
+  } while (n > 0 && vna_ms() < end);
+  return 0;
+}
+
+/*
+=======================================
+    执行命令
+=======================================
+*/
+int vna_command(vna_t *v, const char *cmd, uint8_t *out, int size, int timeout_ms)
+{
+  int64_t end;
+  int len = 0, text = 0, echo = -1, i, n;
+
+  vna_demux(v, NULL, 0, 0, &text);  // 上一条命令之后的推送数据
+  text = 0;
+  n = strlen(cmd);
+  if (write(v->fd, cmd, n) != n || write(v->fd, "\r", 1) != 1)
+    return -1;
+
+  end = vna_ms() + timeout_ms;
+  for (;;) {
+    if (vna_read(v, (int)(end - vna_ms())) < 0)
+      return -1;
+    len = vna_demux(v, out, size, len, &text);
+    if (echo < 0) {  // 回显以 "\r\n" 结束，之后才是输出
+      for (i = 0; i + 1 < len; i++)
+        if (out[i] == '\r' && out[i + 1] == '\n')
+          break;
+      if (i + 1 < len)
+        echo = i + 2;
+    }
+    if (echo >= 0 && len - echo >= PROMPT_LEN && text >= PROMPT_LEN &&
+        memcmp(out + len - PROMPT_LEN, PROMPT, PROMPT_LEN) == 0)
+      break;
+    if (len == size || vna_ms() >= end)
+      return -1;
+  }
+  len -= echo + PROMPT_LEN;
+  memmove(out, out + echo, len);
+  return len;
+}
+
+/*
+=======================================
+    帧和解码
+=======================================
+*/
+int vna_frame(const uint8_t *p, int len, vna_header_t *h, const uint8_t **data)
+{
+  if (len < (int)sizeof *h)
+    return 0;
+  memcpy(h, p, sizeof *h);
+  if (h->magic != VNA_BIN_MAGIC || len < (int)sizeof *h + h->size ||
+      h->crc != vna_crc32(0, p + sizeof *h, h->size))
+    return 0;
+  *data = p + sizeof *h;
+  return sizeof *h + h->size;
+}
+
+/* VNA_FMT_U32 原样，VNA_FMT_U32DD 按二阶差分累加 */
+int vna_decode_u32(const vna_header_t *h, const uint8_t *data, uint32_t *v)
+{
+  uint32_t d = 0, z;
+  int i, n, shift;
+
+  if (h->points > VNA_POINTS_MAX)
+    return -1;
+  if (h->format == VNA_FMT_U32) {
+    if (h->size != h->points * 4)
+      return -1;
+    memcpy(v, data, h->size);
+    return h->points;
+  }
+  if (h->format != VNA_FMT_U32DD || (h->points > 0 && h->size < 4))
+    return -1;
+  if (h->points == 0)
+    return h->size == 0 ? 0 : -1;
+  memcpy(&v[0], data, 4);
+  n = 4;
+  for (i = 1; i < h->points; i++) {
+    z = 0;
+    for (shift = 0; ; shift += 7) {
+      if (n >= h->size || shift > 28)
+        return -1;
+      z |= (uint32_t)(data[n] & 0x7f) << shift;
+      if (!(data[n++] & 0x80))
+        break;
+    }
+    d += (z >> 1) ^ -(z & 1);  // zigzag
+    v[i] = v[i - 1] + d;
+  }
+  return n == h->size ? h->points : -1;
+}
+
+/* VNA_FMT_F32X2 原样，VNA_FMT_I16X2 每块 q * 2^e */
+int vna_decode_f32x2(const vna_header_t *h, const uint8_t *data, float (*v)[2])
+{
+  int i, j, m, n = 0;
+  float scale;
+  int16_t q;
+
+  if (h->points > VNA_POINTS_MAX)
+    return -1;
+  if (h->format == VNA_FMT_F32X2) {
+    if (h->size != h->points * 8)
+      return -1;
+    memcpy(v, data, h->size);
+    return h->points;
+  }
+  if (h->format != VNA_FMT_I16X2)
+    return -1;
+  for (i = 0; i < h->points; i += VNA_BLOCK) {
+    m = h->points - i < VNA_BLOCK ? h->points - i : VNA_BLOCK;
+    if (n + 1 + m * 4 > h->size)
+      return -1;
+    scale = ldexpf(1.0f, (int8_t)data[n++]);
+    for (j = 0; j < m * 2; j++) {
+      q = (int16_t)(data[n] | data[n + 1] << 8);
+      n += 2;
+      v[i + j / 2][j & 1] = q * scale;
+    }
+  }
+  return n == h->size ? h->points : -1;
+}
@@ -0,0 +1,87 @@
+/*-----------------------------------------------------------------------------/
+ * Module       : vna.h
+ * Brief        : 主机端的 USB 串口客户端
+ 执行命令、收 bindata 帧、接收 stream/event 推送的数据。
+ 帧头和记录的格式与 Usr/nanovna.h 的 bin_header_t/stream_rec_t 相同，
+ 小端，这里假设主机也是小端。
+/-----------------------------------------------------------------------------*/
+#ifndef VNA_H
+#define VNA_H
+#include <stdint.h>
+
+#define VNA_BIN_MAGIC      0xB15A
+#define VNA_FMT_U32        1  // uint32，每点一个
+#define VNA_FMT_F32X2      2  // float 实部、虚部
+#define VNA_FMT_U32DD      3  // 第一个点 uint32，之后是二阶差分的 zigzag varint
+#define VNA_FMT_I16X2      4  // 每 VNA_BLOCK 点一个 int8 指数 e，每点 int16 实部、虚部
+#define VNA_BLOCK          16
+
+#define VNA_STREAM_MAGIC   0x5A17
+#define VNA_STREAM_FIRST   0x01
+#define VNA_STREAM_LAST    0x02
+#define VNA_STREAM_DROPPED 0x04
+#define VNA_STREAM_CAL     0x08
+
+#define VNA_POINTS_MAX     1024
+#define VNA_BUF_SIZE       (64*1024)  // 收到还没处理的数据，要放得下最大的一帧
+
+typedef struct {
+  uint16_t magic;
+  uint8_t  format;
+  uint8_t  array;   // 'f' 频率，0-8 同 data 命令
+  uint32_t seq;
+  uint16_t points;
+  uint16_t size;
+  uint32_t crc;     // 数据的 CRC-32
+} vna_header_t;
+
+typedef struct {
+  uint16_t magic;
+  uint8_t  flags;
+  uint8_t  reserved;
+  uint16_t index;
+  uint16_t seq;
+  uint32_t freq;
+  float    s11[2];
+  float    s21[2];
+  uint32_t crc;     // 前 28 字节的 CRC-32
+} vna_record_t;
+
+typedef struct vna {
+  int fd;
+  uint8_t buf[VNA_BUF_SIZE];
+  int len;
+  // 推送的数据，在 vna_command/vna_poll 里回调
+  void (*on_record)(void *ctx, const vna_record_t *r);
+  void (*on_event)(void *ctx, uint32_t seq);
+  void *ctx;
+  uint32_t records, events;
+  uint32_t rx_bytes;  // 从设备收到的全部字节
+} vna_t;
+
+uint32_t vna_crc32(uint32_t crc, const void *data, int len);
+
+/* 打开串口 (或 pty)，设为原始模式，失败返回 -1 */
+int vna_open(vna_t *v, const char *path);
+void vna_close(vna_t *v);
+
+/*
+ * 执行一条命令，等到提示符 "ch> "。
+ * out 里是命令的输出：去掉回显和提示符，推送的数据交给回调，
+ * bindata 的帧原样保留。返回输出长度，超时或出错返回 -1
+ */
+int vna_command(vna_t *v, const char *cmd, uint8_t *out, int size, int timeout_ms);
+
+/* 不执行命令，只接收推送的数据，timeout_ms 内没有数据时返回 */
+int vna_poll(vna_t *v, int timeout_ms);
+
+/*
+ * 从 p 开始取一帧，帧头存入 h，*data 指向数据。
+ * 返回帧的总长度；不是完整的帧或 CRC 不对返回 0
+ */
+int vna_frame(const uint8_t *p, int len, vna_header_t *h, const uint8_t **data);
+
+/* 展开一帧的数据，返回点数，格式不对或数据不完整返回 -1 */
+int vna_decode_u32(const vna_header_t *h, const uint8_t *data, uint32_t *v);
+int vna_decode_f32x2(const vna_header_t *h, const uint8_t *data, float (*v)[2]);
+#endif
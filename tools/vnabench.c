@@ -0,0 +1,301 @@
+/*-----------------------------------------------------------------------------/
+ * Module       : vnabench.c
+ * Brief        : 从主机一侧测 USB 串口的延迟和吞吐量
+ 用法：vnabench [device] [seconds]
+ 没有给出 device 时启动 ./vnasim，通过它的 pty 测。
+ - 延迟：反复执行一条不取测量锁的短命令 (event)，从写入到收到提示符
+ - bindata：原样和压缩 (z) 两种，每秒的字节数和帧数，每帧检查 CRC 并展开；
+   暂停扫描后比较两种的结果，频率相同，S 参数误差在块浮点的精度以内
+ - 推送：stream/event 打开 seconds 秒，每秒的扫描次数，记录是否连续、丢了多少
+ 测量都在主机上计时。开始时 "link reset"，最后打印设备的 link 统计
+ (设备自己看到的收发量和命令执行时间)，两边可以对照。
+ 有检查失败时返回 1。
+/-----------------------------------------------------------------------------*/
+#include <math.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include "vna.h"
+
+#define LATENCY_RUNS  500
+#define TIMEOUT_MS    3000
+#define OUT_SIZE      (64*1024)
+
+static vna_t vna;
+static uint8_t out[OUT_SIZE];
+static int failures;
+static pid_t sim_pid;
+
+#define CHECK(cond, ...) do { \
+  if (!(cond)) { \
+    failures++; \
+    printf("  FAIL: "); \
+    printf(__VA_ARGS__); \
+    printf("\n"); \
+  } \
+} while (0)
+
+static double now_s(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* 启动模拟设备，返回它打印的 pty 路径 */
+static const char *start_sim(void)
+{
+  static char path[256];
+  int fd[2];
+  FILE *f;
+
+  if (pipe(fd) < 0)
+    return NULL;
+  sim_pid = fork();
+  if (sim_pid == 0) {
+    dup2(fd[1], 1);
+    close(fd[0]);
+    execl("./vnasim", "vnasim", (char *)NULL);
+    perror("vnabench: ./vnasim");
+    _exit(1);
+  }
+  close(fd[1]);
+  f = fdopen(fd[0], "r");
+  if (sim_pid < 0 || !f || !fgets(path, sizeof path, f))
+    return NULL;
+  path[strcspn(path, "\r\n")] = '\0';
+  return path;
+}
+
+static int command(const char *cmd)
+{
+  int n = vna_command(&vna, cmd, out, sizeof out, TIMEOUT_MS);
+  CHECK(n >= 0, "\"%s\": no prompt", cmd);
+  return n;
+}
+
+/*
+=======================================
+    命令延迟
+=======================================
+*/
+static int cmp_double(const void *a, const void *b)
+{
+  double x = *(const double *)a, y = *(const double *)b;
+  return x < y ? -1 : x > y;
+}
+
+static void bench_latency(void)
+{
+  static double t[LATENCY_RUNS];
+  double t0;
+  int i;
+
+  for (i = 0; i < LATENCY_RUNS; i++) {
+    t0 = now_s();
+    if (command("event") < 0)
+      return;
+    t[i] = (now_s() - t0) * 1e6;
+  }
+  qsort(t, LATENCY_RUNS, sizeof t[0], cmp_double);
+  printf("latency    %d x \"event\": p50 %.0f p90 %.0f p99 %.0f max %.0f us\n", LATENCY_RUNS,
+         t[LATENCY_RUNS / 2], t[LATENCY_RUNS * 9 / 10], t[LATENCY_RUNS * 99 / 100],
+         t[LATENCY_RUNS - 1]);
+}
+
+/*
+=======================================
+    bindata
+=======================================
+*/
+static uint32_t freq[VNA_POINTS_MAX];
+static float data[2][VNA_POINTS_MAX][2];
+static vna_header_t header[3];
+
+/* 检查并展开一次 "bindata [z] f 0 1" 的输出，返回点数，出错返回 -1 */
+static int decode_response(int len, const char *cmd)
+{
+  static const uint8_t array[3] = { 'f', 0, 1 };
+  const uint8_t *p = out, *d;
+  int k, n, points = -1;
+
+  for (k = 0; k < 3; k++) {
+    n = vna_frame(p, len, &header[k], &d);
+    if (n == 0) {
+      CHECK(0, "\"%s\": bad frame %d, %d bytes left", cmd, k, len);
+      return -1;
+    }
+    n = k == 0 ? vna_decode_u32(&header[k], d, freq)
+               : vna_decode_f32x2(&header[k], d, data[k - 1]);
+    if (k == 0)
+      points = n;
+    if (n < 0 || n != points || header[k].array != array[k] || header[k].seq != header[0].seq) {
+      CHECK(0, "\"%s\": frame %d (array %d, %d points, seq %u) does not decode", cmd, k,
+            header[k].array, header[k].points, header[k].seq);
+      return -1;
+    }
+    p += sizeof header[k] + header[k].size;
+    len -= sizeof header[k] + header[k].size;
+  }
+  CHECK(len == 0, "\"%s\": %d bytes after the frames", cmd, len);
+  return len == 0 ? points : -1;
+}
+
+static void bench_bindata(const char *cmd, double seconds)
+{
+  double t0, t;
+  uint32_t bytes = 0, runs = 0;
+  int n;
+
+  t0 = now_s();
+  do {
+    n = command(cmd);
+    if (n < 0 || decode_response(n, cmd) < 0)
+      return;
+    bytes += n;
+    runs++;
+    t = now_s() - t0;
+  } while (t < seconds);
+  printf("%-16s %5u runs, %4u bytes each: %7.0f bytes/s, %5.0f frames/s, %5.2f ms/run\n",
+         cmd, runs, bytes / runs, bytes / t, runs * 3 / t, t * 1e3 / runs);
+}
+
+/* 压缩前后的结果相同：频率无损，S 参数误差不超过块内最大值的 1/32767 */
+static void check_packed(void)
+{
+  static uint32_t freq0[VNA_POINTS_MAX];
+  static float data0[2][VNA_POINTS_MAX][2];
+  float m, err, worst = 0;
+  int a, i, j, k, points;
+
+  command("pause");
+  points = decode_response(command("bindata f 0 1"), "bindata f 0 1");
+  memcpy(freq0, freq, sizeof freq);
+  memcpy(data0, data, sizeof data);
+  if (points > 0 && decode_response(command("bindata z f 0 1"), "bindata z f 0 1") == points) {
+    CHECK(memcmp(freq, freq0, points * sizeof freq[0]) == 0, "packed frequencies differ");
+    for (a = 0; a < 2; a++) {
+      for (i = 0; i < points; i += VNA_BLOCK) {
+        k = points - i < VNA_BLOCK ? points - i : VNA_BLOCK;
+        for (m = 0, j = 0; j < k * 2; j++)
+          m = fmaxf(m, fabsf(data0[a][i + j / 2][j & 1]));
+        for (j = 0; j < k * 2; j++) {
+          err = fabsf(data[a][i + j / 2][j & 1] - data0[a][i + j / 2][j & 1]);
+          CHECK(err <= m / 32767, "array %d point %d: packed error %g, block max %g",
+                a, i + j / 2, err, m);
+          if (m > 0 && err / m > worst)
+            worst = err / m;
+        }
+      }
+    }
+    printf("packed           %d points: frequencies exact, worst S error %.2g of block max "
+           "(bound %.2g)\n", points, worst, 1.0 / 32767);
+  }
+  command("resume");
+}
+
+/*
+=======================================
+    推送
+=======================================
+*/
+static struct {
+  uint32_t records, dropped, gaps, events, bad_events, first_event, last_event;
+  double first_t, last_t;
+  vna_record_t last;
+} push;
+
+static void on_record(void *ctx, const vna_record_t *r)
+{
+  (void)ctx;
+  if (push.records && !(r->flags & VNA_STREAM_DROPPED)) {
+    int next = (push.last.flags & VNA_STREAM_LAST)
+      ? r->index == 0 && r->seq == (uint16_t)(push.last.seq + 1)
+      : r->index == push.last.index + 1 && r->seq == push.last.seq;
+    if (!next)
+      push.gaps++;
+  }
+  if (r->flags & VNA_STREAM_DROPPED)
+    push.dropped++;
+  push.records++;
+  push.last = *r;
+}
+
+/* 事件可能合并 (发不出去时只补发最新的一次)，扫描次数按序号算 */
+static void on_event(void *ctx, uint32_t seq)
+{
+  (void)ctx;
+  if (push.events == 0) {
+    push.first_event = seq;
+    push.first_t = now_s();
+  } else if (seq <= push.last_event) {
+    push.bad_events++;
+  }
+  push.events++;
+  push.last_event = seq;
+  push.last_t = now_s();
+}
+
+static void bench_push(double seconds)
+{
+  uint32_t bytes = vna.rx_bytes;
+  double t0, t, sweeps = 0;
+
+  memset(&push, 0, sizeof push);
+  vna.on_record = on_record;
+  vna.on_event = on_event;
+  command("event on");
+  command("stream on");
+  t0 = now_s();
+  while ((t = now_s() - t0) < seconds)
+    vna_poll(&vna, 100);
+  command("stream off");
+  command("event off");
+  vna.on_record = NULL;
+  vna.on_event = NULL;
+
+  CHECK(push.records > 0 && push.events > 1, "too little pushed data");
+  CHECK(push.gaps == 0, "%u record gaps without VNA_STREAM_DROPPED", push.gaps);
+  CHECK(push.bad_events == 0, "%u events out of order", push.bad_events);
+  if (push.last_t > push.first_t)
+    sweeps = (push.last_event - push.first_event) / (push.last_t - push.first_t);
+  printf("push             %.1f s: %.2f sweeps/s, %u events, %u records (%.0f/s, %u after drops), "
+         "%.0f bytes/s\n", t, sweeps, push.events, push.records, push.records / t,
+         push.dropped, (vna.rx_bytes - bytes) / t);
+}
+
+int main(int argc, char *argv[])
+{
+  const char *path = argc > 1 ? argv[1] : start_sim();
+  double seconds = argc > 2 ? atof(argv[2]) : 2;
+  int n;
+
+  if (!path || vna_open(&vna, path) < 0) {
+    fprintf(stderr, "vnabench: cannot open %s\n", path ? path : "./vnasim");
+    return 1;
+  }
+  printf("device %s\n", path);
+  command("link reset");
+  bench_latency();
+  bench_bindata("bindata f 0 1", seconds);
+  bench_bindata("bindata z f 0 1", seconds);
+  check_packed();
+  bench_push(seconds);
+
+  // 设备一侧的统计，只作对照
+  n = command("link");
+  if (n > 0)
+    printf("device link:\n%.*s", n, out);
+
+  vna_close(&vna);
+  if (sim_pid > 0) {
+    kill(sim_pid, SIGTERM);
+    waitpid(sim_pid, NULL, 0);
+  }
+  printf("%s\n", failures ? "FAILED" : "OK");
+  return failures ? 1 : 0;
+}
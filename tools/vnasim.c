@@ -0,0 +1,137 @@
+/*-----------------------------------------------------------------------------/
+ * Module       : vnasim.c
+ * Brief        : 在 PC 上运行的模拟设备，通过 pty 当作 USB 串口
+ 固件的命令任务 (Usr/appcmd.c、Usr/serial.c)、USB 串口 (Src/usbd_cdc_if.c)
+ 和应用层 (Usr/appvna.c 等) 原样编译，硬件和 RTOS 用 test/host 的桩，
+ I2S 线程生成测量数据，扫描照常进行。USB 库换成 hw.c 模拟的端点：
+ - IN：每次传输按 64 字节分包，每包用时 packet_us，写到 pty 的主设备，
+   然后在模拟的中断里调用 CDC_TxComplete_FS
+ - OUT：从 pty 读到的数据按 64 字节分包，接收槽准备好时交给 CDC_Receive_FS，
+   没准备好时等待 (NAK)
+ 启动后打印从设备的路径，主机程序 (vnabench 等) 打开它即可。
+ 用法：vnasim [packet_us]
+/-----------------------------------------------------------------------------*/
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+#include "usbd_cdc_if.h"
+#include "hw.h"
+
+#define PACKET  CDC_DATA_FS_MAX_PACKET_SIZE
+
+void app_init(void);
+void app_loop(void);
+void cmd_init(void);
+void cmd_loop(void *pvParameters);
+
+static int master;
+
+/*
+=======================================
+    pty 与模拟的端点 (test/host/hw.c)
+=======================================
+*/
+/* IN 传输写到 pty 的主设备，主机不读时在这里等，和 USB 的 NAK 一样 */
+static void pty_write(const uint8_t *p, int len)
+{
+  int n;
+
+  while (len > 0) {
+    n = write(master, p, len);
+    if (n < 0 && errno != EINTR && errno != EAGAIN) {
+      perror("vnasim: write");
+      exit(1);
+    }
+    if (n > 0) {
+      p += n;
+      len -= n;
+    }
+  }
+}
+
+/* 从 pty 读到的数据按 64 字节分包，接收槽没准备好时等待 (NAK) */
+static void *pty_read(void *arg)
+{
+  uint8_t buf[PACKET];
+  int n;
+
+  (void)arg;
+  for (;;) {
+    n = read(master, buf, sizeof buf);
+    if (n <= 0) {  // 主机关闭从设备时 EIO，等下一个主机打开
+      usleep(1000);
+      continue;
+    }
+    while (!host_usb_out(buf, n))
+      usleep(20);
+    if (host_usb_packet_us)
+      usleep(host_usb_packet_us);
+  }
+  return NULL;
+}
+
+/*
+=======================================
+    任务
+=======================================
+*/
+static void *app_task(void *arg)
+{
+  (void)arg;
+  for (;;)
+    app_loop();
+  return NULL;
+}
+
+static void *cmd_task(void *arg)
+{
+  for (;;)
+    cmd_loop(arg);
+  return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+  struct termios t;
+  pthread_t th;
+  int slave;
+
+  if (argc > 1)
+    host_usb_packet_us = atoi(argv[1]);
+
+  master = posix_openpt(O_RDWR | O_NOCTTY);
+  if (master < 0 || grantpt(master) < 0 || unlockpt(master) < 0) {
+    perror("vnasim: pty");
+    return 1;
+  }
+  // 一直打开从设备：设成原始模式，不回显，主机关闭后主设备也不会读到 EIO
+  slave = open(ptsname(master), O_RDWR | O_NOCTTY);
+  if (slave < 0 || tcgetattr(slave, &t) < 0) {
+    perror("vnasim: slave");
+    return 1;
+  }
+  cfmakeraw(&t);
+  tcsetattr(slave, TCSANOW, &t);
+
+  host_usb_in = pty_write;
+  host_usb_start();
+  pthread_create(&th, NULL, pty_read, NULL);
+
+  // 同 main.c 的 StartTask001、StartTaskCmd
+  host_lcd_dma_start();
+  app_init();
+  cmd_init();
+  pthread_create(&th, NULL, app_task, NULL);
+  pthread_create(&th, NULL, cmd_task, NULL);
+
+  printf("%s\n", ptsname(master));
+  fflush(stdout);
+  pthread_join(th, NULL);
+  return 0;
+}